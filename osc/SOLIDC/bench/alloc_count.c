@@ -0,0 +1,37 @@
+#include "bench.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+
+/*
+ * Interposes the glibc allocator for the whole process (including libc's
+ * own callers such as fopen) and counts every allocation.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static _Atomic unsigned long long allocations;
+
+void *malloc(size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+
+unsigned long long bench_alloc_count(void) {
+    return atomic_load_explicit(&allocations, memory_order_relaxed);
+}
@@ -0,0 +1,447 @@
+#include "bench.h"
+#include "components.h"
+#include "config.h"
+#include "controller.h"
+#include "disk_transport.h"
+#include "mmap_transport.h"
+#include "pipelines.h"
+#include "policy.h"
+#include "tcp_transport.h"
+#include "uring_transport.h"
+#include "user_table.h"
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_OPS 200000
+#define BENCH_TX_COUNT 64
+
+static Transaction bench_txs[BENCH_TX_COUNT];
+static char bench_users[BENCH_TX_COUNT][16];
+/* bench_txs again as one TransactionBatch over a UserTable. */
+static unsigned int batch_tids[BENCH_TX_COUNT];
+static double batch_amounts[BENCH_TX_COUNT];
+static unsigned int batch_user_ids[BENCH_TX_COUNT];
+static UserTable bench_user_table;
+static TransactionBatch bench_batch;
+
+uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const uint64_t *sorted, size_t n, double p) {
+    size_t idx = (size_t)(p * (double)(n - 1));
+    return sorted[idx];
+}
+
+int bench_run(const char *name, BenchOp op, void *arg, size_t ops,
+              BenchResult *out) {
+    uint64_t *samples = malloc(ops * sizeof(*samples));
+    unsigned long long allocs_before;
+    uint64_t start;
+    size_t i;
+    int rc = 0;
+
+    if (!samples || ops == 0) {
+        free(samples);
+        return -1;
+    }
+
+    allocs_before = bench_alloc_count();
+    start = bench_now_ns();
+    for (i = 0; i < ops; i++) {
+        uint64_t t0 = bench_now_ns();
+        if (op(arg, i) < 0) {
+            rc = -1;
+        }
+        samples[i] = bench_now_ns() - t0;
+    }
+    out->total_ns = (double)(bench_now_ns() - start);
+    out->allocs = bench_alloc_count() - allocs_before;
+
+    qsort(samples, ops, sizeof(*samples), cmp_u64);
+    out->name = name;
+    out->ops = ops;
+    out->p50_ns = percentile(samples, ops, 0.50);
+    out->p99_ns = percentile(samples, ops, 0.99);
+    out->p999_ns = percentile(samples, ops, 0.999);
+    free(samples);
+    return rc;
+}
+
+void bench_print_header(void) {
+    printf("%-28s %10s %12s %10s %9s %9s %9s\n", "benchmark", "ns/op",
+           "records/s", "allocs/op", "p50", "p99", "p999");
+}
+
+void bench_print(const BenchResult *r) {
+    double ns_per_op = r->total_ns / (double)r->ops;
+    printf("%-28s %10.1f %12.0f %10.2f %9llu %9llu %9llu\n", r->name,
+           ns_per_op, 1e9 / ns_per_op, (double)r->allocs / (double)r->ops,
+           (unsigned long long)r->p50_ns, (unsigned long long)r->p99_ns,
+           (unsigned long long)r->p999_ns);
+}
+
+/* ---- local sinks so network senders have something to talk to ---- */
+
+static void *tcp_sink_main(void *arg) {
+    int lfd = *(int *)arg;
+    char buf[65536];
+
+    for (;;) {
+        int cfd = accept(lfd, NULL, NULL);
+        if (cfd < 0) {
+            return NULL;
+        }
+        while (recv(cfd, buf, sizeof(buf), 0) > 0) {
+        }
+        close(cfd);
+    }
+}
+
+static void *udp_sink_main(void *arg) {
+    int fd = *(int *)arg;
+    char buf[65536];
+
+    while (recv(fd, buf, sizeof(buf), 0) >= 0) {
+    }
+    return NULL;
+}
+
+static int start_sink(int type, void *(*fn)(void *), int *fd_out) {
+    struct sockaddr_in addr;
+    pthread_t th;
+    int one = 1;
+    int fd = socket(AF_INET, type, 0);
+
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(LOG_PORT);
+    inet_pton(AF_INET, LOG_HOST, &addr.sin_addr);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        (type == SOCK_STREAM && listen(fd, 16) < 0)) {
+        close(fd);
+        return -1;
+    }
+    *fd_out = fd;
+    if (pthread_create(&th, NULL, fn, fd_out) != 0) {
+        close(fd);
+        return -1;
+    }
+    pthread_detach(th);
+    return 0;
+}
+
+/* ---- benchmark cases ---- */
+
+static int op_format(void *arg, size_t i) {
+    const Formatter *f = arg;
+    char buf[MAX_BUFFER_SIZE];
+    return f->format(&bench_txs[i % BENCH_TX_COUNT], buf, sizeof(buf)) < 0
+               ? -1
+               : 0;
+}
+
+/* The *_batch64 rows time one op per BENCH_TX_COUNT records. */
+static int op_format_batch(void *arg, size_t i) {
+    const Formatter *f = arg;
+    char buf[LOG_BATCH_BUFFER_SIZE];
+    size_t lens[BENCH_TX_COUNT];
+    size_t done = 0;
+
+    (void)i;
+    while (done < bench_batch.count) {
+        int n = f->format_batch(&bench_batch, done, BENCH_TX_COUNT, buf,
+                                sizeof(buf), lens);
+        if (n <= 0) {
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+typedef struct SendCase {
+    const Sender *sender;
+    char records[BENCH_TX_COUNT][MAX_BUFFER_SIZE];
+    size_t lens[BENCH_TX_COUNT];
+} SendCase;
+
+static int op_send(void *arg, size_t i) {
+    SendCase *c = arg;
+    size_t k = i % BENCH_TX_COUNT;
+    return c->sender->send(c->records[k], c->lens[k]);
+}
+
+static void prepare_send_case(SendCase *c, const Sender *sender,
+                              const Formatter *f) {
+    size_t k;
+    c->sender = sender;
+    for (k = 0; k < BENCH_TX_COUNT; k++) {
+        int n = f->format(&bench_txs[k], c->records[k], MAX_BUFFER_SIZE);
+        c->lens[k] = n > 0 ? (size_t)n : 0;
+    }
+}
+
+typedef struct PolicyCase {
+    LogPolicy policy;
+} PolicyCase;
+
+/* Whether the policy keeps the record does not matter here. */
+static int op_policy(void *arg, size_t i) {
+    const PolicyCase *c = arg;
+    c->policy(&bench_txs[i % BENCH_TX_COUNT]);
+    return 0;
+}
+
+static int op_process(void *arg, size_t i) {
+    return process_transaction_with_ctx(arg, &bench_txs[i % BENCH_TX_COUNT]);
+}
+
+static int op_process_batch(void *arg, size_t i) {
+    (void)i;
+    return process_batch_with_ctx(arg, &bench_batch);
+}
+
+static void report(const char *name, BenchOp op, void *arg, size_t ops) {
+    BenchResult r = {0};
+    if (bench_run(name, op, arg, ops, &r) < 0) {
+        printf("%-28s (some operations failed)\n", name);
+    }
+    bench_print(&r);
+}
+
+/* Segments are numbered from 1 with no gaps, plain or compressed. */
+static void remove_segments(const char *prefix) {
+    char name[256];
+    char packed[256];
+    unsigned int seq;
+
+    for (seq = 1;; seq++) {
+        snprintf(name, sizeof(name), "%s.%06u", prefix, seq);
+        snprintf(packed, sizeof(packed), "%s.%06u.lz4", prefix, seq);
+        if (unlink(name) < 0 && unlink(packed) < 0) {
+            break;
+        }
+    }
+}
+
+static void init_transactions(void) {
+    size_t k;
+    for (k = 0; k < BENCH_TX_COUNT; k++) {
+        snprintf(bench_users[k], sizeof(bench_users[k]), "user%02zu", k);
+        bench_txs[k].tid = (unsigned int)(1000 + k * 7919);
+        bench_txs[k].user = bench_users[k];
+        bench_txs[k].amount = (double)(k * 1234 % 100000) / 100.0;
+        batch_tids[k] = bench_txs[k].tid;
+        batch_amounts[k] = bench_txs[k].amount;
+        batch_user_ids[k] =
+            (unsigned int)user_table_intern(&bench_user_table, bench_users[k]);
+    }
+    bench_batch.tids = batch_tids;
+    bench_batch.amounts = batch_amounts;
+    bench_batch.user_ids = batch_user_ids;
+    bench_batch.count = BENCH_TX_COUNT;
+    user_table_bind(&bench_user_table, &bench_batch);
+}
+
+int main(int argc, char **argv) {
+    size_t ops = BENCH_DEFAULT_OPS;
+    char dir[] = "/tmp/trbench-XXXXXX";
+    char path[sizeof(dir) + 16];
+    char seg_path[sizeof(dir) + 16];
+    static SendCase send_case;
+    DiskTransportOptions disk_opts = {0};
+    MmapTransportOptions mmap_opts = {0};
+    UringTransportOptions uring_opts = {0};
+    TcpTransportOptions tcp_opts = {0};
+    PolicyOptions policy_opts;
+    PolicyCase policy_case;
+    int tcp_fd = -1;
+    int udp_fd = -1;
+    int have_tcp;
+    int have_udp;
+
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        ops = strtoul(argv[2], NULL, 10);
+    }
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    snprintf(path, sizeof(path), "%s/bench.log", dir);
+    snprintf(seg_path, sizeof(seg_path), "%s/bench.seg", dir);
+    if (user_table_init(&bench_user_table) < 0) {
+        perror("user_table_init");
+        return EXIT_FAILURE;
+    }
+    init_transactions();
+
+    disk_opts.path = path;
+    disk_opts.flush_interval_ms = DISK_FLUSH_INTERVAL_MS;
+    disk_transport_configure(&disk_opts);
+    mmap_opts.path = seg_path;
+    mmap_transport_configure(&mmap_opts);
+    uring_opts.disk_path = path;
+    uring_transport_configure(&uring_opts);
+    tcp_opts.nodelay = TCP_NODELAY_ENABLED;
+    tcp_opts.backoff_initial_ms = TCP_BACKOFF_INITIAL_MS;
+    tcp_opts.backoff_max_ms = TCP_BACKOFF_MAX_MS;
+    tcp_opts.replay_buffer_size = TCP_REPLAY_BUFFER_SIZE;
+    tcp_transport_configure(&tcp_opts);
+
+    have_tcp = start_sink(SOCK_STREAM, tcp_sink_main, &tcp_fd) == 0;
+    have_udp = start_sink(SOCK_DGRAM, udp_sink_main, &udp_fd) == 0;
+
+    printf("ops per case: %zu, latency percentiles in ns\n", ops);
+    bench_print_header();
+
+    report("format/text", op_format, (void *)&TEXT_FORMATTER, ops);
+    report("format/json", op_format, (void *)&JSON_FORMATTER, ops);
+    report("format/binary", op_format, (void *)&BINARY_FORMATTER, ops);
+    report("format_batch64/text", op_format_batch, (void *)&TEXT_FORMATTER,
+           ops / BENCH_TX_COUNT);
+    report("format_batch64/json", op_format_batch, (void *)&JSON_FORMATTER,
+           ops / BENCH_TX_COUNT);
+    report("format_batch64/binary", op_format_batch,
+           (void *)&BINARY_FORMATTER, ops / BENCH_TX_COUNT);
+
+    policy_options_defaults(&policy_opts);
+    policy_configure(&policy_opts);
+    policy_case.policy = sample_by_tid;
+    report("policy/sample", op_policy, &policy_case, ops);
+    policy_case.policy = rate_limit_by_user;
+    report("policy/rate_limit", op_policy, &policy_case, ops);
+
+    prepare_send_case(&send_case, &DISK_SENDER, &TEXT_FORMATTER);
+    DISK_CONNECTABLE.connect();
+    report("send/disk", op_send, &send_case, ops);
+    DISK_CONNECTABLE.disconnect();
+
+    /* Same load with a rotation every MiB and background compression. */
+    disk_opts.rotate_bytes = 1024 * 1024;
+    disk_opts.compress = 1;
+    disk_transport_configure(&disk_opts);
+    DISK_CONNECTABLE.connect();
+    report("send/disk_rotate", op_send, &send_case, ops);
+    DISK_CONNECTABLE.disconnect();
+    remove_segments(path);
+    disk_opts.rotate_bytes = 0;
+    disk_opts.compress = 0;
+    disk_transport_configure(&disk_opts);
+
+    prepare_send_case(&send_case, URING_DISK_TRANSPORT.sender,
+                      &TEXT_FORMATTER);
+    URING_DISK_TRANSPORT.connectable->connect();
+    report("send/uring_disk", op_send, &send_case, ops);
+    URING_DISK_TRANSPORT.connectable->disconnect();
+
+    prepare_send_case(&send_case, &MMAP_SENDER, &TEXT_FORMATTER);
+    if (MMAP_CONNECTABLE.connect() == 0) {
+        report("send/mmap", op_send, &send_case, ops);
+        MMAP_CONNECTABLE.disconnect();
+    } else {
+        printf("%-28s (skipped: cannot map %s)\n", "send/mmap", seg_path);
+    }
+
+    if (have_udp) {
+        prepare_send_case(&send_case, &UDP_SENDER, &JSON_FORMATTER);
+        report("send/udp", op_send, &send_case, ops);
+        UDP_CONNECTABLE.disconnect();
+    } else {
+        printf("%-28s (skipped: cannot bind %s:%d/udp)\n", "send/udp",
+               LOG_HOST, LOG_PORT);
+    }
+
+    if (have_tcp && TCP_CONNECTABLE.connect() == 0) {
+        prepare_send_case(&send_case, &TCP_SENDER, &JSON_FORMATTER);
+        report("send/tcp", op_send, &send_case, ops);
+        TCP_CONNECTABLE.disconnect();
+    } else {
+        printf("%-28s (skipped: no local TCP sink)\n", "send/tcp");
+    }
+
+    if (have_tcp) {
+        static AsyncLog async[2];
+        /* Only counted in a METRICS=1 build; compare the e2e rows. */
+        static SinkMetrics metrics[2];
+        LogSink sinks[] = {
+            {
+                .name = "disk",
+                .formatter = &TEXT_FORMATTER,
+                .transport = &DISK_TRANSPORT,
+                .metrics = &metrics[0],
+            },
+            {
+                .name = "tcp",
+                .formatter = &JSON_FORMATTER,
+                .transport = &TCP_TRANSPORT,
+                .policy = should_log_on_network,
+                .metrics = &metrics[1],
+            },
+        };
+        AppContext ctx = {
+            .sinks = sinks,
+            .sink_count = 2,
+            .debug_sink = &STDERR_DEBUG_SINK,
+        };
+
+        if (app_context_start(&ctx) == 0) {
+            report("e2e/process_transaction", op_process, &ctx, ops);
+            app_context_stop(&ctx);
+        }
+        if (app_context_start(&ctx) == 0) {
+            report("e2e/process_batch64", op_process_batch, &ctx,
+                   ops / BENCH_TX_COUNT);
+            app_context_stop(&ctx);
+        }
+
+        /* Same wiring, compiled in; build with LTO_FLAGS=-flto to inline. */
+        ctx.pipeline = production_pipeline;
+        if (app_context_start(&ctx) == 0) {
+            report("e2e/static_pipeline", op_process, &ctx, ops);
+            app_context_stop(&ctx);
+        }
+        ctx.pipeline = NULL;
+
+        if (async_log_init(&async[0], NULL, &STDERR_DEBUG_SINK) == 0 &&
+            async_log_init(&async[1], NULL, &STDERR_DEBUG_SINK) == 0) {
+            sinks[0].async = &async[0];
+            sinks[1].async = &async[1];
+            if (app_context_start(&ctx) == 0) {
+                report("e2e/process_transaction_async", op_process, &ctx,
+                       ops);
+                app_context_stop(&ctx);
+            }
+        }
+        async_log_destroy(&async[0]);
+        async_log_destroy(&async[1]);
+    }
+
+    bench_scaling(ops);
+    /* Every group-commit send waits for an fdatasync; keep the runs short. */
+    bench_group_commit(path, ops / 20);
+
+    user_table_destroy(&bench_user_table);
+    unlink(path);
+    remove_segments(seg_path);
+    rmdir(dir);
+    return EXIT_SUCCESS;
+}
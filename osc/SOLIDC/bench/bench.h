@@ -0,0 +1,38 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Process-wide heap allocation count, maintained by alloc_count.c. */
+unsigned long long bench_alloc_count(void);
+
+typedef struct BenchResult {
+    const char *name;
+    size_t ops;
+    double total_ns;
+    unsigned long long allocs;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+} BenchResult;
+
+/* One measured operation; returns 0 on success, -1 on failure. */
+typedef int (*BenchOp)(void *arg, size_t i);
+
+uint64_t bench_now_ns(void);
+int bench_run(const char *name, BenchOp op, void *arg, size_t ops,
+              BenchResult *out);
+void bench_print_header(void);
+void bench_print(const BenchResult *r);
+
+/* Producer scaling from 1 to 64 threads, sync vs sharded async. */
+void bench_scaling(size_t ops);
+
+/*
+ * Group-commit disk sends from 1 to 64 threads; path is the log to use.
+ * Leaves the disk transport configured without group commit.
+ */
+void bench_group_commit(const char *path, size_t ops);
+
+#endif // BENCH_H
@@ -0,0 +1,203 @@
+#include "bench.h"
+#include "components.h"
+#include "controller.h"
+#include "disk_transport.h"
+#include <string.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SCALING_MAX_THREADS 64
+
+typedef struct ScalingWorker {
+    pthread_t thread;
+    const AppContext *ctx;
+    pthread_barrier_t *start;
+    size_t ops;
+    unsigned int first_tid;
+} ScalingWorker;
+
+static void *scaling_worker(void *arg) {
+    ScalingWorker *w = arg;
+    Transaction t = {0, "scaling", 42.5};
+    size_t i;
+
+    pthread_barrier_wait(w->start);
+    for (i = 0; i < w->ops; i++) {
+        t.tid = w->first_tid + (unsigned int)i;
+        process_transaction_with_ctx(w->ctx, &t);
+    }
+    return NULL;
+}
+
+/* Returns records/s for `threads` producers sharing ctx. */
+static double run_producers(const AppContext *ctx, size_t threads,
+                            size_t ops) {
+    ScalingWorker workers[SCALING_MAX_THREADS];
+    pthread_barrier_t start;
+    uint64_t t0;
+    size_t per_thread = ops / threads;
+    size_t i;
+
+    if (app_context_start(ctx) < 0) {
+        return 0.0;
+    }
+    pthread_barrier_init(&start, NULL, (unsigned int)threads + 1);
+    for (i = 0; i < threads; i++) {
+        workers[i].ctx = ctx;
+        workers[i].start = &start;
+        workers[i].ops = per_thread;
+        workers[i].first_tid = (unsigned int)(i * per_thread);
+        pthread_create(&workers[i].thread, NULL, scaling_worker, &workers[i]);
+    }
+
+    pthread_barrier_wait(&start);
+    t0 = bench_now_ns();
+    for (i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    /* Async throughput includes draining the ring to the transport. */
+    app_context_stop(ctx);
+    pthread_barrier_destroy(&start);
+
+    return (double)(per_thread * threads) * 1e9 /
+           (double)(bench_now_ns() - t0);
+}
+
+void bench_scaling(size_t ops) {
+    LogSink sink = {
+        .name = "disk",
+        .formatter = &TEXT_FORMATTER,
+        .transport = &DISK_TRANSPORT,
+    };
+    AppContext ctx = {
+        .sinks = &sink,
+        .sink_count = 1,
+        .debug_sink = &STDERR_DEBUG_SINK,
+    };
+    size_t threads;
+
+    printf("\nproducer scaling, TEXT -> disk, %zu records per run\n", ops);
+    printf("%8s %16s %16s\n", "threads", "sync rec/s", "async rec/s");
+
+    for (threads = 1; threads <= SCALING_MAX_THREADS; threads *= 2) {
+        AsyncLogOptions opts = {0};
+        static AsyncLog async;
+        double sync_rate;
+        double async_rate = 0.0;
+
+        sink.async = NULL;
+        sync_rate = run_producers(&ctx, threads, ops);
+
+        opts.shards = threads;
+        opts.backpressure = ASYNC_BACKPRESSURE_BLOCK;
+        if (async_log_init(&async, &opts, ctx.debug_sink) == 0) {
+            sink.async = &async;
+            async_rate = run_producers(&ctx, threads, ops);
+            async_log_destroy(&async);
+        }
+
+        printf("%8zu %16.0f %16.0f\n", threads, sync_rate, async_rate);
+    }
+}
+
+typedef struct CommitWorker {
+    pthread_t thread;
+    pthread_barrier_t *start;
+    size_t ops;
+    size_t failed;
+} CommitWorker;
+
+static void *commit_worker(void *arg) {
+    static const char record[] = "Transaction 1: User commit sent 42.50\n";
+    CommitWorker *w = arg;
+    size_t i;
+
+    pthread_barrier_wait(w->start);
+    for (i = 0; i < w->ops; i++) {
+        if (DISK_SENDER.send(record, sizeof(record) - 1) < 0) {
+            w->failed++;
+        }
+    }
+    return NULL;
+}
+
+/* Commit stats accumulate across runs; prints this run's share. */
+static void print_commit_row(size_t threads, size_t records, double secs,
+                             size_t failed) {
+    static DiskCommitStats prev;
+    DiskCommitStats st;
+    unsigned long long commits;
+    unsigned long long waits;
+
+    disk_transport_commit_stats(&st);
+    commits = st.commits - prev.commits;
+    waits = st.waits - prev.waits;
+    printf("%8zu %12.0f %12.1f %14.1f %14.1f %8zu\n", threads,
+           (double)records / secs,
+           commits ? (double)(st.records - prev.records) / (double)commits
+                   : 0.0,
+           commits ? (double)(st.sync_ns_total - prev.sync_ns_total) /
+                         (double)commits / 1e3
+                   : 0.0,
+           waits ? (double)(st.wait_ns_total - prev.wait_ns_total) /
+                       (double)waits / 1e3
+                 : 0.0,
+           failed);
+    prev = st;
+}
+
+void bench_group_commit(const char *path, size_t ops) {
+    DiskTransportOptions opts = {0};
+    size_t threads;
+
+    opts.path = path;
+    opts.group_commit = 1;
+    opts.commit_interval_us = DISK_COMMIT_INTERVAL_US;
+    opts.commit_batch = DISK_COMMIT_BATCH;
+
+    printf("\ngroup commit, interval %u us, batch %u, %zu records per run\n",
+           (unsigned int)DISK_COMMIT_INTERVAL_US,
+           (unsigned int)DISK_COMMIT_BATCH, ops);
+    printf("%8s %12s %12s %14s %14s %8s\n", "threads", "records/s",
+           "rec/fsync", "avg sync us", "avg wait us", "failed");
+
+    for (threads = 1; threads <= SCALING_MAX_THREADS; threads *= 2) {
+        CommitWorker workers[SCALING_MAX_THREADS];
+        pthread_barrier_t start;
+        size_t per_thread = ops / threads ? ops / threads : 1;
+        size_t failed = 0;
+        uint64_t t0;
+        double secs;
+        size_t i;
+
+        if (disk_transport_configure(&opts) < 0 ||
+            DISK_CONNECTABLE.connect() < 0) {
+            printf("%8zu (skipped: cannot open %s)\n", threads, path);
+            continue;
+        }
+        pthread_barrier_init(&start, NULL, (unsigned int)threads + 1);
+        for (i = 0; i < threads; i++) {
+            memset(&workers[i], 0, sizeof(workers[i]));
+            workers[i].start = &start;
+            workers[i].ops = per_thread;
+            pthread_create(&workers[i].thread, NULL, commit_worker,
+                           &workers[i]);
+        }
+        pthread_barrier_wait(&start);
+        t0 = bench_now_ns();
+        for (i = 0; i < threads; i++) {
+            pthread_join(workers[i].thread, NULL);
+            failed += workers[i].failed;
+        }
+        secs = (double)(bench_now_ns() - t0) / 1e9;
+        pthread_barrier_destroy(&start);
+        DISK_CONNECTABLE.disconnect();
+
+        print_commit_row(threads, per_thread * threads, secs, failed);
+    }
+
+    opts.group_commit = 0;
+    opts.flush_interval_ms = DISK_FLUSH_INTERVAL_MS;
+    disk_transport_configure(&opts);
+}
@@ -0,0 +1,357 @@
+#include "include/async_debug.h"
+#include "include/config.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define DEBUG_COMPONENT_MAX 32
+#define DEBUG_MESSAGE_MAX 256
+#define DEBUG_LOCK_SPINS 8
+
+typedef struct DebugEntry {
+    int used;
+    int printed; /* first occurrence written */
+    int hit;     /* seen again during the current interval */
+    DebugLevel level;
+    uint64_t hash;
+    unsigned long long repeats; /* occurrences not yet reported */
+    char component[DEBUG_COMPONENT_MAX];
+    char message[DEBUG_MESSAGE_MAX];
+} DebugEntry;
+
+/* A line the writer prints once it has let go of the table lock. */
+typedef struct DebugLine {
+    DebugLevel level;
+    char component[DEBUG_COMPONENT_MAX];
+    char message[DEBUG_MESSAGE_MAX + 48]; /* room for the repeat count */
+} DebugLine;
+
+/*
+ * Producers and the writer share one open-addressing table under dbg_lock.
+ * Producers only ever trylock it; the writer holds it just long enough to
+ * copy out the lines it is about to print.
+ */
+static struct {
+    DebugEntry table[DEBUG_TABLE_SIZE];
+    const DebugSink *target;
+    unsigned int interval_ms;
+    unsigned int burst;
+    unsigned long long dropped_unreported;
+    int stop;
+    pthread_t thread;
+    AsyncDebugStats stats;
+} dbg;
+
+static _Atomic int dbg_running;
+static _Atomic unsigned long long dbg_busy_drops;
+static pthread_mutex_t dbg_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dbg_wake = PTHREAD_COND_INITIALIZER;
+
+/* FNV-1a over the level, component and message. */
+static uint64_t entry_hash(DebugLevel level, const char *component,
+                           const char *message) {
+    uint64_t h = 1469598103934665603ULL ^ (uint64_t)level;
+    const char *p;
+
+    for (p = component; *p; p++) {
+        h = (h ^ (unsigned char)*p) * 1099511628211ULL;
+    }
+    h = (h ^ 0xff) * 1099511628211ULL;
+    for (p = message; *p; p++) {
+        h = (h ^ (unsigned char)*p) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static int entry_matches(const DebugEntry *e, uint64_t hash, DebugLevel level,
+                         const char *component, const char *message) {
+    return e->hash == hash && e->level == level &&
+           strncmp(e->component, component, DEBUG_COMPONENT_MAX - 1) == 0 &&
+           strncmp(e->message, message, DEBUG_MESSAGE_MAX - 1) == 0;
+}
+
+/* The entry for the message, a free slot for it, or NULL when full. */
+static DebugEntry *table_find(uint64_t hash, DebugLevel level,
+                              const char *component, const char *message) {
+    size_t i;
+
+    for (i = 0; i < DEBUG_TABLE_SIZE; i++) {
+        DebugEntry *e = &dbg.table[(hash + i) % DEBUG_TABLE_SIZE];
+
+        if (!e->used || entry_matches(e, hash, level, component, message)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void bounded_copy(char *dst, const char *src, size_t size) {
+    size_t n = strlen(src);
+
+    if (n >= size) {
+        n = size - 1;
+    }
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+}
+
+static void async_debug_log(DebugLevel level, const char *component,
+                            const char *message) {
+    unsigned int spins = 0;
+    uint64_t hash;
+    DebugEntry *e;
+
+    component = component ? component : "app";
+    message = message ? message : "(null)";
+    if (!atomic_load_explicit(&dbg_running, memory_order_acquire)) {
+        debug_log(dbg.target ? dbg.target : &STDERR_DEBUG_SINK, level,
+                  component, message);
+        return;
+    }
+
+    hash = entry_hash(level, component, message);
+    /*
+     * Other holders only update the table; the writer does its I/O
+     * unlocked. Yield a few times for them, then count the message lost.
+     */
+    while (pthread_mutex_trylock(&dbg_lock) != 0) {
+        if (++spins > DEBUG_LOCK_SPINS) {
+            atomic_fetch_add_explicit(&dbg_busy_drops, 1,
+                                      memory_order_relaxed);
+            return;
+        }
+        sched_yield();
+    }
+    if (!dbg.stop) {
+        e = table_find(hash, level, component, message);
+        dbg.stats.accepted++;
+        if (!e) {
+            dbg.stats.dropped++;
+            dbg.dropped_unreported++;
+        } else if (e->used) {
+            e->repeats++;
+            e->hit = 1;
+        } else {
+            e->used = 1;
+            e->printed = 0;
+            e->hit = 1;
+            e->level = level;
+            e->hash = hash;
+            e->repeats = 0;
+            bounded_copy(e->component, component, sizeof(e->component));
+            bounded_copy(e->message, message, sizeof(e->message));
+            pthread_cond_signal(&dbg_wake);
+        }
+    }
+    pthread_mutex_unlock(&dbg_lock);
+}
+
+static void add_line(DebugLine *lines, size_t *n, const DebugEntry *e,
+                     unsigned long long repeats) {
+    DebugLine *l = &lines[(*n)++];
+
+    l->level = e->level;
+    memcpy(l->component, e->component, sizeof(l->component));
+    if (repeats > 0) {
+        snprintf(l->message, sizeof(l->message), "%s (repeated %llu times)",
+                 e->message, repeats);
+    } else {
+        memcpy(l->message, e->message, sizeof(e->message));
+    }
+}
+
+/* Drops entries that went quiet and reinserts the rest without holes. */
+static void table_compact(void) {
+    static DebugEntry keep[DEBUG_TABLE_SIZE];
+    size_t n = 0;
+    size_t i;
+
+    for (i = 0; i < DEBUG_TABLE_SIZE; i++) {
+        DebugEntry *e = &dbg.table[i];
+
+        if (e->used && (e->hit || !e->printed)) {
+            e->hit = 0;
+            keep[n++] = *e;
+        }
+        e->used = 0;
+    }
+    for (i = 0; i < n; i++) {
+        size_t k = keep[i].hash % DEBUG_TABLE_SIZE;
+
+        while (dbg.table[k].used) {
+            k = (k + 1) % DEBUG_TABLE_SIZE;
+        }
+        dbg.table[k] = keep[i];
+    }
+}
+
+/*
+ * Collects what is due under the lock: first occurrences up to *budget,
+ * and at the end of an interval (or when flushing everything) the repeat
+ * counts and the number of messages the table could not take.
+ */
+static size_t collect_locked(DebugLine *lines, unsigned int *budget,
+                             int window_end, int flush) {
+    unsigned long long busy =
+        atomic_exchange_explicit(&dbg_busy_drops, 0, memory_order_relaxed);
+    unsigned long long dropped = dbg.dropped_unreported + busy;
+    size_t n = 0;
+    size_t i;
+
+    dbg.stats.dropped += busy;
+    for (i = 0; i < DEBUG_TABLE_SIZE; i++) {
+        DebugEntry *e = &dbg.table[i];
+
+        if (!e->used) {
+            continue;
+        }
+        if (!e->printed && (flush || *budget > 0)) {
+            /* A final flush folds any repeats into the first line. */
+            unsigned long long r = flush ? e->repeats : 0;
+
+            dbg.stats.suppressed += r;
+            add_line(lines, &n, e, r);
+            e->repeats -= r;
+            e->printed = 1;
+            if (*budget > 0) {
+                (*budget)--;
+            }
+        } else if (e->printed && e->repeats > 0 && (window_end || flush)) {
+            dbg.stats.suppressed += e->repeats;
+            add_line(lines, &n, e, e->repeats);
+            e->repeats = 0;
+        }
+    }
+    if (!window_end && !flush) {
+        dbg.dropped_unreported = dropped;
+    } else {
+        table_compact();
+        dbg.dropped_unreported = 0;
+        if (dropped > 0) {
+            DebugLine *l = &lines[n++];
+
+            l->level = DEBUG_LEVEL_WARN;
+            strcpy(l->component, "debug");
+            snprintf(l->message, sizeof(l->message),
+                     "%llu messages dropped", dropped);
+        }
+    }
+    dbg.stats.printed += n;
+    return n;
+}
+
+static void emit(const DebugLine *lines, size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        debug_log(dbg.target, lines[i].level, lines[i].component,
+                  lines[i].message);
+    }
+}
+
+static long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Waits on dbg_wake for at most ns; the condvar uses CLOCK_REALTIME. */
+static void wait_for(long long ns) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ns / 1000000000LL;
+    ts.tv_nsec += ns % 1000000000LL;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&dbg_wake, &dbg_lock, &ts);
+}
+
+static void *writer_main(void *arg) {
+    static DebugLine lines[DEBUG_TABLE_SIZE + 1];
+    long long interval_ns = (long long)dbg.interval_ms * 1000000LL;
+    long long window_end_ns = monotonic_ns() + interval_ns;
+    unsigned int budget = dbg.burst;
+
+    (void)arg;
+    pthread_mutex_lock(&dbg_lock);
+    for (;;) {
+        long long now = monotonic_ns();
+        int window_end = 0;
+        int stop;
+        size_t n;
+
+        if (!dbg.stop && now < window_end_ns) {
+            wait_for(window_end_ns - now);
+            now = monotonic_ns();
+        }
+        if (now >= window_end_ns) {
+            window_end = 1;
+            budget = dbg.burst;
+            window_end_ns = now + interval_ns;
+        }
+        stop = dbg.stop;
+        n = collect_locked(lines, &budget, window_end, stop);
+        pthread_mutex_unlock(&dbg_lock);
+        emit(lines, n);
+        if (stop) {
+            return NULL;
+        }
+        pthread_mutex_lock(&dbg_lock);
+    }
+}
+
+int async_debug_start(const AsyncDebugOptions *opts) {
+    pthread_mutex_lock(&dbg_lock);
+    if (atomic_load_explicit(&dbg_running, memory_order_relaxed)) {
+        pthread_mutex_unlock(&dbg_lock);
+        return -1;
+    }
+    memset(dbg.table, 0, sizeof(dbg.table));
+    dbg.target = opts && opts->target ? opts->target : &STDERR_DEBUG_SINK;
+    dbg.interval_ms = opts && opts->interval_ms ? opts->interval_ms
+                                                 : DEBUG_RATE_INTERVAL_MS;
+    dbg.burst = opts && opts->burst ? opts->burst : DEBUG_RATE_BURST;
+    dbg.dropped_unreported = 0;
+    dbg.stop = 0;
+    if (pthread_create(&dbg.thread, NULL, writer_main, NULL) != 0) {
+        pthread_mutex_unlock(&dbg_lock);
+        return -1;
+    }
+    atomic_store_explicit(&dbg_running, 1, memory_order_release);
+    pthread_mutex_unlock(&dbg_lock);
+    return 0;
+}
+
+int async_debug_stop(void) {
+    pthread_mutex_lock(&dbg_lock);
+    if (!atomic_load_explicit(&dbg_running, memory_order_relaxed)) {
+        pthread_mutex_unlock(&dbg_lock);
+        return -1;
+    }
+    atomic_store_explicit(&dbg_running, 0, memory_order_release);
+    dbg.stop = 1;
+    pthread_cond_signal(&dbg_wake);
+    pthread_mutex_unlock(&dbg_lock);
+    return pthread_join(dbg.thread, NULL) == 0 ? 0 : -1;
+}
+
+void async_debug_stats(AsyncDebugStats *out) {
+    if (!out) {
+        return;
+    }
+    pthread_mutex_lock(&dbg_lock);
+    *out = dbg.stats;
+    out->dropped +=
+        atomic_load_explicit(&dbg_busy_drops, memory_order_relaxed);
+    pthread_mutex_unlock(&dbg_lock);
+}
+
+const DebugSink ASYNC_DEBUG_SINK = { .log = async_debug_log };
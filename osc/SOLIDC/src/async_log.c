@@ -0,0 +1,525 @@
+#include "include/async_log.h"
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define ASYNC_SPIN_LIMIT 64
+#define ASYNC_IDLE_SLEEP_NS 50000L
+#define ASYNC_CACHE_LINE 64
+
+/* Per-thread shard ticket; 0 means the thread has not been assigned yet. */
+static _Thread_local size_t shard_ticket;
+static _Atomic size_t next_ticket;
+
+static size_t round_up_pow2(size_t n) {
+    size_t p = 2;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+static void backoff(unsigned int *spins) {
+    if (*spins < ASYNC_SPIN_LIMIT) {
+        (*spins)++;
+        sched_yield();
+        return;
+    }
+    struct timespec ts = {0, ASYNC_IDLE_SLEEP_NS};
+    nanosleep(&ts, NULL);
+}
+
+/* Claims the next free slot for writing, or NULL when the ring is full. */
+static AsyncSlot *ring_claim(AsyncShard *r, size_t mask, size_t *out_pos) {
+    size_t pos = atomic_load_explicit(&r->enqueue_pos, memory_order_relaxed);
+
+    for (;;) {
+        AsyncSlot *s = &r->slots[pos & mask];
+        size_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &r->enqueue_pos, &pos, pos + 1, memory_order_relaxed,
+                    memory_order_relaxed)) {
+                *out_pos = pos;
+                return s;
+            }
+        } else if (dif < 0) {
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&r->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+static void ring_publish(AsyncSlot *s, size_t pos) {
+    atomic_store_explicit(&s->seq, pos + 1, memory_order_release);
+}
+
+/* Takes the oldest published slot, or NULL when nothing is ready. */
+static AsyncSlot *ring_take(AsyncShard *r, size_t mask, size_t *out_pos) {
+    size_t pos = atomic_load_explicit(&r->dequeue_pos, memory_order_relaxed);
+
+    for (;;) {
+        AsyncSlot *s = &r->slots[pos & mask];
+        size_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &r->dequeue_pos, &pos, pos + 1, memory_order_relaxed,
+                    memory_order_relaxed)) {
+                *out_pos = pos;
+                return s;
+            }
+        } else if (dif < 0) {
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&r->dequeue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+static void ring_release(AsyncSlot *s, size_t mask, size_t pos) {
+    free(s->big);
+    s->big = NULL;
+    atomic_store_explicit(&s->seq, pos + mask + 1, memory_order_release);
+}
+
+static char *slot_bytes(AsyncSlot *s) {
+    return s->big ? s->big : s->data;
+}
+
+static void writer_report(AsyncLog *q, int rc, size_t records) {
+    if (rc == 0) {
+        atomic_fetch_add_explicit(&q->written, records, memory_order_relaxed);
+        return;
+    }
+
+    atomic_fetch_add_explicit(&q->send_failures, records,
+                              memory_order_relaxed);
+    if (errno != 0) {
+        debug_log_errno(q->debug_sink, "async_log", "writer send");
+    } else {
+        debug_log(q->debug_sink, DEBUG_LEVEL_ERROR, "async_log",
+                  "writer send failed");
+    }
+}
+
+/* Sends one run of slots that share the same sender. */
+static void writer_send_run(AsyncLog *q, AsyncSlot **run, size_t n) {
+    struct iovec iov[LOG_BATCH_MAX_RECORDS];
+    const AsyncSlot *first = run[0];
+    long long t0;
+    size_t bytes = 0;
+    size_t i;
+    int rc;
+
+    if (!first->sender || first->len == 0) {
+        return;
+    }
+
+    errno = 0;
+    if (n > 1 && first->batch_sender && first->batch_sender->send_batch) {
+        for (i = 0; i < n; i++) {
+            iov[i].iov_base = slot_bytes(run[i]);
+            iov[i].iov_len = run[i]->len;
+            bytes += run[i]->len;
+        }
+        t0 = metrics_start(q->metrics);
+        rc = first->batch_sender->send_batch(iov, n);
+        metrics_sent(q->metrics, t0, rc, n, bytes);
+        writer_report(q, rc, n);
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        errno = 0;
+        t0 = metrics_start(q->metrics);
+        rc = first->sender->send(slot_bytes(run[i]), run[i]->len);
+        metrics_sent(q->metrics, t0, rc, 1, run[i]->len);
+        writer_report(q, rc, 1);
+    }
+}
+
+static int same_destination(const AsyncSlot *a, const AsyncSlot *b) {
+    /* Empty slots (failed formats) never join a run. */
+    return a->len > 0 && b->len > 0 && a->sender == b->sender &&
+           a->batch_sender == b->batch_sender;
+}
+
+/* Takes up to q->batch ready slots and writes them in order. */
+static size_t writer_drain_once(AsyncLog *q, AsyncShard *r) {
+    AsyncSlot *taken[LOG_BATCH_MAX_RECORDS];
+    size_t pos[LOG_BATCH_MAX_RECORDS];
+    size_t n = 0;
+    size_t start = 0;
+    size_t i;
+
+    while (n < q->batch) {
+        AsyncSlot *s = ring_take(r, q->mask, &pos[n]);
+        if (!s) {
+            break;
+        }
+        taken[n++] = s;
+    }
+
+    for (i = 1; i <= n; i++) {
+        if (i == n || !same_destination(taken[start], taken[i])) {
+            writer_send_run(q, &taken[start], i - start);
+            start = i;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        ring_release(taken[i], q->mask, pos[i]);
+    }
+    return n;
+}
+
+static size_t writer_drain_all(AsyncLog *q) {
+    size_t total = 0;
+    size_t i;
+
+    for (i = 0; i < q->shard_count; i++) {
+        total += writer_drain_once(q, &q->shards[i]);
+    }
+    return total;
+}
+
+static void *writer_main(void *arg) {
+    AsyncLog *q = arg;
+    unsigned int spins = 0;
+
+    for (;;) {
+        if (writer_drain_all(q) > 0) {
+            spins = 0;
+            continue;
+        }
+        if (!atomic_load_explicit(&q->running, memory_order_acquire)) {
+            /* Re-check after observing stop so late publishes are drained. */
+            if (writer_drain_all(q) == 0) {
+                break;
+            }
+            continue;
+        }
+        backoff(&spins);
+    }
+
+    return NULL;
+}
+
+int async_log_init(AsyncLog *q, const AsyncLogOptions *opts,
+                   const DebugSink *debug_sink) {
+    size_t capacity = ASYNC_QUEUE_CAPACITY;
+    size_t shard_count = 1;
+    size_t bytes;
+    size_t i;
+    size_t j;
+
+    if (!q) {
+        return -1;
+    }
+    if (opts && opts->capacity > 0) {
+        capacity = opts->capacity;
+    }
+    if (opts && opts->shards > 1) {
+        shard_count = opts->shards;
+    }
+    capacity = round_up_pow2(capacity);
+
+    memset(q, 0, sizeof(*q));
+    bytes = shard_count * sizeof(*q->shards);
+    bytes = (bytes + ASYNC_CACHE_LINE - 1) & ~(size_t)(ASYNC_CACHE_LINE - 1);
+    q->shards = aligned_alloc(ASYNC_CACHE_LINE, bytes);
+    if (!q->shards) {
+        return -1;
+    }
+    memset(q->shards, 0, bytes);
+
+    for (i = 0; i < shard_count; i++) {
+        AsyncShard *r = &q->shards[i];
+
+        r->slots = malloc(capacity * sizeof(*r->slots));
+        if (!r->slots) {
+            q->shard_count = i;
+            async_log_destroy(q);
+            return -1;
+        }
+        for (j = 0; j < capacity; j++) {
+            atomic_init(&r->slots[j].seq, j);
+            r->slots[j].big = NULL;
+        }
+    }
+    q->shard_count = shard_count;
+    q->mask = capacity - 1;
+    q->batch = LOG_BATCH_MAX_RECORDS;
+    if (opts && opts->batch > 0 && opts->batch < LOG_BATCH_MAX_RECORDS) {
+        q->batch = opts->batch;
+    }
+    q->backpressure = opts ? opts->backpressure : ASYNC_BACKPRESSURE_BLOCK;
+    q->debug_sink = debug_sink;
+    return 0;
+}
+
+int async_log_start(AsyncLog *q) {
+    if (!q || !q->shards || q->started) {
+        return -1;
+    }
+
+    atomic_store_explicit(&q->running, 1, memory_order_release);
+    if (pthread_create(&q->writer, NULL, writer_main, q) != 0) {
+        atomic_store_explicit(&q->running, 0, memory_order_release);
+        debug_log(q->debug_sink, DEBUG_LEVEL_ERROR, "async_log",
+                  "failed to start writer thread");
+        return -1;
+    }
+    q->started = 1;
+    return 0;
+}
+
+static AsyncShard *producer_shard(AsyncLog *q) {
+    if (q->shard_count == 1) {
+        return &q->shards[0];
+    }
+    if (shard_ticket == 0) {
+        shard_ticket =
+            atomic_fetch_add_explicit(&next_ticket, 1, memory_order_relaxed) +
+            1;
+    }
+    return &q->shards[(shard_ticket - 1) % q->shard_count];
+}
+
+static AsyncSlot *claim_with_backpressure(AsyncLog *q, AsyncShard *r,
+                                          size_t *pos) {
+    unsigned int spins = 0;
+
+    for (;;) {
+        AsyncSlot *s;
+
+        if (!atomic_load_explicit(&q->running, memory_order_acquire)) {
+            atomic_fetch_add_explicit(&r->dropped_stopped, 1,
+                                      memory_order_relaxed);
+            return NULL;
+        }
+        s = ring_claim(r, q->mask, pos);
+        if (s) {
+            return s;
+        }
+
+        switch (q->backpressure) {
+        case ASYNC_BACKPRESSURE_DROP_NEWEST:
+            atomic_fetch_add_explicit(&r->dropped_newest, 1,
+                                      memory_order_relaxed);
+            return NULL;
+        case ASYNC_BACKPRESSURE_DROP_OLDEST: {
+            size_t old_pos;
+            AsyncSlot *old = ring_take(r, q->mask, &old_pos);
+            if (old) {
+                ring_release(old, q->mask, old_pos);
+                atomic_fetch_add_explicit(&r->dropped_oldest, 1,
+                                          memory_order_relaxed);
+                continue;
+            }
+            /* Every queued slot is owned by the writer: wait for it. */
+            backoff(&spins);
+            break;
+        }
+        case ASYNC_BACKPRESSURE_BLOCK:
+        default:
+            backoff(&spins);
+            break;
+        }
+    }
+}
+
+char *async_log_reserve(AsyncLog *q, size_t size, AsyncReservation *res) {
+    AsyncSlot *s;
+
+    if (!q || !q->shards || !res) {
+        return NULL;
+    }
+
+    res->shard = producer_shard(q);
+    s = claim_with_backpressure(q, res->shard, &res->pos);
+    if (!s) {
+        return NULL;
+    }
+    res->slot = s;
+    if (size <= MAX_BUFFER_SIZE) {
+        return s->data;
+    }
+
+    s->big = malloc(size);
+    if (!s->big) {
+        /* The slot is already claimed; publish it empty so the ring moves. */
+        async_log_commit(q, res, NULL, NULL, 0);
+        debug_log(q->debug_sink, DEBUG_LEVEL_ERROR, "async_log",
+                  "no memory for an oversized record");
+        return NULL;
+    }
+    return s->big;
+}
+
+int async_log_commit(AsyncLog *q, AsyncReservation *res, const Sender *sender,
+                     const BatchSender *batch_sender, size_t len) {
+    AsyncSlot *s;
+
+    if (!q || !res || !res->slot) {
+        return -1;
+    }
+    s = res->slot;
+    if (len == 0 || !sender) {
+        /* Empty slots are skipped by the writer, which frees any block. */
+        s->sender = NULL;
+        s->batch_sender = NULL;
+        s->len = 0;
+        ring_publish(s, res->pos);
+        return -1;
+    }
+
+    s->sender = sender;
+    s->batch_sender = batch_sender;
+    s->len = len;
+    ring_publish(s, res->pos);
+    atomic_fetch_add_explicit(&res->shard->submitted, 1, memory_order_relaxed);
+    return 0;
+}
+
+/*
+ * Tries the slot first: most records fit it even when the formatter's bound
+ * does not. Only a record that really needs more gets a heap block.
+ */
+int async_log_format(AsyncLog *q, const Formatter *f, const Sender *sender,
+                     const BatchSender *batch_sender, const Transaction *t) {
+    AsyncReservation res;
+    size_t space = MAX_BUFFER_SIZE;
+    long long t0;
+    char *buf;
+    int n;
+
+    if (!q || !q->shards || !f || !f->format || !sender || !sender->send ||
+        !t) {
+        debug_log(q ? q->debug_sink : NULL, DEBUG_LEVEL_ERROR, "async_log",
+                  "invalid logger dependencies");
+        return -1;
+    }
+
+    buf = async_log_reserve(q, space, &res);
+    if (!buf) {
+        return -1;
+    }
+
+    t0 = metrics_start(q->metrics);
+    n = f->format(t, buf, space);
+    if ((n < 0 || (size_t)n >= space) && f->max_len &&
+        f->max_len(t) + 1 > MAX_BUFFER_SIZE &&
+        f->max_len(t) < (size_t)INT_MAX) {
+        space = f->max_len(t) + 1;
+        res.slot->big = malloc(space);
+        n = res.slot->big ? f->format(t, res.slot->big, space) : -1;
+    }
+    metrics_formatted(q->metrics, t0, n >= 0 && (size_t)n < space);
+    if (n < 0 || (size_t)n >= space) {
+        async_log_commit(q, &res, NULL, NULL, 0);
+        debug_log(q->debug_sink, DEBUG_LEVEL_ERROR, "async_log",
+                  "formatter failed or produced invalid length");
+        return -1;
+    }
+    return async_log_commit(q, &res, sender, batch_sender, (size_t)n);
+}
+
+int async_log_transaction(AsyncLog *q, const Logger *lg,
+                          const Transaction *t) {
+    if (!lg) {
+        debug_log(q ? q->debug_sink : NULL, DEBUG_LEVEL_ERROR, "async_log",
+                  "invalid logger dependencies");
+        return -1;
+    }
+    return async_log_format(q, lg->formatter, lg->sender, lg->batch_sender, t);
+}
+
+int async_log_submit(AsyncLog *q, const Sender *sender,
+                     const BatchSender *batch_sender, const char *msg,
+                     size_t len) {
+    AsyncReservation res;
+    char *buf;
+
+    if (!q || !q->shards || !sender || !sender->send || !msg || len == 0) {
+        debug_log(q ? q->debug_sink : NULL, DEBUG_LEVEL_ERROR, "async_log",
+                  "invalid sender or record");
+        return -1;
+    }
+
+    buf = async_log_reserve(q, len, &res);
+    if (!buf) {
+        return -1;
+    }
+    memcpy(buf, msg, len);
+    return async_log_commit(q, &res, sender, batch_sender, len);
+}
+
+int async_log_stop(AsyncLog *q) {
+    if (!q || !q->started) {
+        return -1;
+    }
+
+    atomic_store_explicit(&q->running, 0, memory_order_release);
+    if (pthread_join(q->writer, NULL) != 0) {
+        debug_log(q->debug_sink, DEBUG_LEVEL_ERROR, "async_log",
+                  "failed to join writer thread");
+        return -1;
+    }
+    q->started = 0;
+    return 0;
+}
+
+void async_log_destroy(AsyncLog *q) {
+    size_t i;
+
+    if (!q) {
+        return;
+    }
+    if (q->started) {
+        async_log_stop(q);
+    }
+    if (q->shards) {
+        for (i = 0; i < q->shard_count; i++) {
+            size_t j;
+
+            /* Records never drained may still own a heap block. */
+            for (j = 0; q->shards[i].slots && j <= q->mask; j++) {
+                free(q->shards[i].slots[j].big);
+            }
+            free(q->shards[i].slots);
+        }
+    }
+    free(q->shards);
+    q->shards = NULL;
+    q->shard_count = 0;
+}
+
+void async_log_stats(const AsyncLog *q, AsyncLogStats *out) {
+    size_t i;
+
+    if (!q || !out) {
+        return;
+    }
+    memset(out, 0, sizeof(*out));
+    for (i = 0; i < q->shard_count; i++) {
+        const AsyncShard *r = &q->shards[i];
+        out->submitted +=
+            atomic_load_explicit(&r->submitted, memory_order_relaxed);
+        out->dropped_newest +=
+            atomic_load_explicit(&r->dropped_newest, memory_order_relaxed);
+        out->dropped_oldest +=
+            atomic_load_explicit(&r->dropped_oldest, memory_order_relaxed);
+        out->dropped_stopped +=
+            atomic_load_explicit(&r->dropped_stopped, memory_order_relaxed);
+    }
+    out->written = atomic_load_explicit(&q->written, memory_order_relaxed);
+    out->send_failures =
+        atomic_load_explicit(&q->send_failures, memory_order_relaxed);
+}
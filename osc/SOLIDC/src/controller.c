@@ -1,71 +1,446 @@
 #include "include/controller.h"
 #include "include/config.h"
+#include <stdatomic.h>
+#include <stdio.h>
+
+typedef struct FormattedRecord {
+    const Formatter *formatter;
+    const char *msg; /* a stack buffer, or the record arena when oversized */
+    long len;        /* -1 when formatting failed */
+} FormattedRecord;
+
+/* A reload may change the limit while other threads produce. */
+static _Atomic double network_max_amount = MAX_TRANSACTION_AMOUNT_TO_LOG;
 
 int should_log_on_network(const Transaction *t) {
     // Policy to WHEN to log
     if (!t) {
         return 0;
     }
-    return t->amount <= MAX_TRANSACTION_AMOUNT_TO_LOG;
+    return t->amount <=
+           atomic_load_explicit(&network_max_amount, memory_order_relaxed);
+}
+
+void set_network_max_amount(double max_amount) {
+    atomic_store_explicit(&network_max_amount, max_amount,
+                          memory_order_relaxed);
+}
+
+static void sink_error(const AppContext *ctx, const LogSink *sink,
+                       const char *what) {
+    char msg[128];
+
+    snprintf(msg, sizeof(msg), "sink %s: %s", sink->name ? sink->name : "?",
+             what);
+    debug_log(ctx->debug_sink, DEBUG_LEVEL_ERROR, "controller", msg);
+}
+
+static const Connectable *sink_connectable(const LogSink *sink) {
+    return sink->transport ? sink->transport->connectable : NULL;
+}
+
+static const Flushable *sink_flushable(const LogSink *sink) {
+    return sink->transport ? sink->transport->flushable : NULL;
+}
+
+/* Several sinks may share one transport; its lifecycle runs only once. */
+static int shares_connectable(const AppContext *ctx, size_t i) {
+    size_t j;
+
+    for (j = 0; j < i; j++) {
+        if (sink_connectable(&ctx->sinks[j]) ==
+            sink_connectable(&ctx->sinks[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int shares_flushable(const AppContext *ctx, size_t i) {
+    size_t j;
+
+    for (j = 0; j < i; j++) {
+        if (sink_flushable(&ctx->sinks[j]) == sink_flushable(&ctx->sinks[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int shares_async(const AppContext *ctx, size_t i) {
+    size_t j;
+
+    for (j = 0; j < i; j++) {
+        if (ctx->sinks[j].async == ctx->sinks[i].async) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int valid_sink(const LogSink *sink) {
+    return sink->formatter && sink->formatter->format && sink->transport &&
+           sink->transport->sender && sink->transport->sender->send;
 }
 
+/*
+ * Every sink is brought up even when an earlier one fails, so a collector
+ * that is down at startup (and reconnects later) does not leave the other
+ * sinks, or its own async writer, idle. Returns -1 if anything failed.
+ */
 int app_context_start(const AppContext *ctx) {
-    if (!ctx) {
+    size_t i;
+    int rc = 0;
+
+    if (!ctx || (!ctx->sinks && ctx->sink_count > 0)) {
         return -1;
     }
-    if (ctx->network_connectable && ctx->network_connectable->connect) {
-        if (ctx->network_connectable->connect() < 0) {
-            debug_log(ctx->debug_sink, DEBUG_LEVEL_ERROR, "controller",
-                      "network connect capability failed");
+    for (i = 0; i < ctx->sink_count; i++) {
+        const LogSink *sink = &ctx->sinks[i];
+        const Connectable *c = sink_connectable(sink);
+
+        if (!valid_sink(sink)) {
+            sink_error(ctx, sink, "missing formatter or sender");
             return -1;
         }
+        if (c && c->connect && !shares_connectable(ctx, i) &&
+            c->connect() < 0) {
+            sink_error(ctx, sink, "connect capability failed");
+            rc = -1;
+        }
+    }
+    for (i = 0; i < ctx->sink_count; i++) {
+        const LogSink *sink = &ctx->sinks[i];
+
+        if (!sink->async || shares_async(ctx, i)) {
+            continue;
+        }
+        /* The writer's sends count against the first sink on the ring. */
+        sink->async->metrics = sink->metrics;
+        if (async_log_start(sink->async) < 0) {
+            sink_error(ctx, sink, "async writer start failed");
+            rc = -1;
+        }
+    }
+    return rc;
+}
+
+/*
+ * Returns the record for sink's formatter, formatting it into the next free
+ * buffer on first use. Beyond LOG_MAX_FORMATTERS distinct formatters the
+ * last buffer is reused, so the overflow formatters run once per sink.
+ */
+static const char *formatted_for(const LogSink *sink, const Transaction *t,
+                                 FormattedRecord *recs, size_t *count,
+                                 char (*bufs)[MAX_BUFFER_SIZE], size_t *len) {
+    size_t k;
+
+    for (k = 0; k < *count; k++) {
+        if (recs[k].formatter == sink->formatter) {
+            break;
+        }
+    }
+    if (k == *count) {
+        if (*count < LOG_MAX_FORMATTERS) {
+            (*count)++;
+        } else {
+            k = LOG_MAX_FORMATTERS - 1;
+        }
+        long long t0 = metrics_start(sink->metrics);
+
+        recs[k].formatter = sink->formatter;
+        recs[k].msg = bufs[k];
+        recs[k].len = sink->formatter->format(t, bufs[k], MAX_BUFFER_SIZE);
+        if (recs[k].len < 0 || recs[k].len >= MAX_BUFFER_SIZE) {
+            size_t big_len;
+
+            recs[k].msg = log_format_oversized(sink->formatter, t, k, &big_len);
+            recs[k].len = recs[k].msg ? (long)big_len : -1;
+        }
+        metrics_observe(sink->metrics, METRIC_FORMAT_NS, t0);
+    }
+    if (recs[k].len < 0) {
+        return NULL;
+    }
+    *len = (size_t)recs[k].len;
+    return recs[k].msg;
+}
+
+/* A formatter no other sink uses can format straight into its transport. */
+static int shares_formatter(const AppContext *ctx, size_t i) {
+    size_t j;
+
+    for (j = 0; j < ctx->sink_count; j++) {
+        if (j != i && ctx->sinks[j].formatter == ctx->sinks[i].formatter) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int log_in_place(const AppContext *ctx, const LogSink *sink,
+                        const Transaction *t) {
+    const Transport *tr = sink->transport;
+    Logger lg = {sink->formatter, tr->sender, tr->batch_sender,
+                 tr->reservable, sink->metrics};
+
+    if (sink->async) {
+        if (async_log_format(sink->async, sink->formatter, tr->sender,
+                             tr->batch_sender, t) < 0) {
+            sink_error(ctx, sink, "record dropped by async writer");
+            return -1;
+        }
+    } else if (log_transaction(&lg, t, ctx->debug_sink) < 0) {
+        sink_error(ctx, sink, "logging failed");
+        return -1;
     }
     return 0;
 }
 
 int process_transaction_with_ctx(const AppContext *ctx, const Transaction *t) {
-    if (!ctx || !t || !ctx->should_log_on_network) {
+    char bufs[LOG_MAX_FORMATTERS][MAX_BUFFER_SIZE];
+    FormattedRecord recs[LOG_MAX_FORMATTERS];
+    size_t formatted = 0;
+    size_t i;
+    int rc = 0;
+
+    if (!ctx || !t || (!ctx->sinks && ctx->sink_count > 0)) {
         if (ctx) {
             debug_log(ctx->debug_sink, DEBUG_LEVEL_ERROR, "controller",
-                      "invalid input or missing policy");
+                      "invalid input or missing sinks");
         }
         return -1;
     }
+    if (ctx->pipeline) {
+        return ctx->pipeline(t, ctx->debug_sink);
+    }
 
-    if (log_transaction(&ctx->local_logger, t, ctx->debug_sink) < 0) {
-        debug_log(ctx->debug_sink, DEBUG_LEVEL_ERROR, "controller",
-                  "local logging failed");
-        return -1;
+    for (i = 0; i < ctx->sink_count; i++) {
+        const LogSink *sink = &ctx->sinks[i];
+        const Transport *tr = sink->transport;
+        const char *msg;
+        size_t len;
+
+        if (sink->policy && !sink->policy(t)) {
+            continue;
+        }
+        if (!valid_sink(sink)) {
+            sink_error(ctx, sink, "missing formatter or sender");
+            rc = -1;
+            continue;
+        }
+
+        if (!shares_formatter(ctx, i)) {
+            if (log_in_place(ctx, sink, t) < 0) {
+                rc = -1;
+            }
+            continue;
+        }
+
+        msg = formatted_for(sink, t, recs, &formatted, bufs, &len);
+        metrics_add(sink->metrics,
+                    msg ? METRIC_RECORDS : METRIC_FORMAT_FAILURES, 1);
+        if (!msg) {
+            sink_error(ctx, sink, "formatter failed or produced invalid length");
+            rc = -1;
+            continue;
+        }
+
+        if (sink->async) {
+            if (async_log_submit(sink->async, tr->sender, tr->batch_sender,
+                                 msg, len) < 0) {
+                sink_error(ctx, sink, "record dropped by async writer");
+                rc = -1;
+            }
+        } else {
+            long long t0 = metrics_start(sink->metrics);
+            int sent = log_record(tr->sender, msg, len, ctx->debug_sink);
+
+            metrics_sent(sink->metrics, t0, sent, 1, len);
+            if (sent < 0) {
+                sink_error(ctx, sink, "logging failed");
+                rc = -1;
+            }
+        }
     }
 
-    if (ctx->should_log_on_network(t)) {
-        if (log_transaction(&ctx->network_logger, t, ctx->debug_sink) < 0) {
+    return rc;
+}
+
+/* Sends the records of b that sink's policy keeps, a block at a time. */
+static int log_batch_filtered(const AppContext *ctx, const LogSink *sink,
+                              const Logger *lg, const TransactionBatch *b) {
+    unsigned int tids[LOG_BATCH_MAX_RECORDS];
+    double amounts[LOG_BATCH_MAX_RECORDS];
+    unsigned int user_ids[LOG_BATCH_MAX_RECORDS];
+    TransactionBatch sub = {tids, amounts, user_ids, 0, b->users,
+                            b->user_count};
+    size_t i;
+    int rc = 0;
+
+    for (i = 0; i < b->count; i++) {
+        Transaction t = transaction_batch_at(b, i);
+
+        if (sink->policy(&t)) {
+            tids[sub.count] = b->tids[i];
+            amounts[sub.count] = b->amounts[i];
+            user_ids[sub.count] = b->user_ids[i];
+            sub.count++;
+        }
+        if (sub.count == LOG_BATCH_MAX_RECORDS ||
+            (i + 1 == b->count && sub.count > 0)) {
+            if (log_batch(lg, &sub, ctx->debug_sink) < 0) {
+                rc = -1;
+            }
+            sub.count = 0;
+        }
+    }
+    return rc;
+}
+
+int process_batch_with_ctx(const AppContext *ctx, const TransactionBatch *b) {
+    size_t i;
+    size_t k;
+    int rc = 0;
+
+    if (!ctx || !transaction_batch_valid(b) ||
+        (!ctx->sinks && ctx->sink_count > 0)) {
+        if (ctx) {
             debug_log(ctx->debug_sink, DEBUG_LEVEL_ERROR, "controller",
-                      "network logging failed");
-            return -1;
+                      "invalid batch or missing sinks");
         }
+        return -1;
     }
+    if (ctx->pipeline) {
+        for (k = 0; k < b->count; k++) {
+            Transaction t = transaction_batch_at(b, k);
 
-    return 0;
+            if (ctx->pipeline(&t, ctx->debug_sink) < 0) {
+                rc = -1;
+            }
+        }
+        return rc;
+    }
+
+    for (i = 0; i < ctx->sink_count; i++) {
+        const LogSink *sink = &ctx->sinks[i];
+        const Transport *tr = sink->transport;
+        Logger lg;
+        int sent;
+
+        if (!valid_sink(sink)) {
+            sink_error(ctx, sink, "missing formatter or sender");
+            rc = -1;
+            continue;
+        }
+
+        if (sink->async) {
+            for (k = 0; k < b->count; k++) {
+                Transaction t = transaction_batch_at(b, k);
+
+                if ((!sink->policy || sink->policy(&t)) &&
+                    log_in_place(ctx, sink, &t) < 0) {
+                    rc = -1;
+                }
+            }
+            continue;
+        }
+
+        lg.formatter = sink->formatter;
+        lg.sender = tr->sender;
+        lg.batch_sender = tr->batch_sender;
+        lg.reservable = tr->reservable;
+        lg.metrics = sink->metrics;
+        sent = sink->policy ? log_batch_filtered(ctx, sink, &lg, b)
+                            : log_batch(&lg, b, ctx->debug_sink);
+        if (sent < 0) {
+            sink_error(ctx, sink, "logging failed");
+            rc = -1;
+        }
+    }
+
+    return rc;
 }
 
 int app_context_stop(const AppContext *ctx) {
-    if (!ctx) {
+    size_t i;
+    int rc = 0;
+
+    if (!ctx || (!ctx->sinks && ctx->sink_count > 0)) {
         return -1;
     }
 
-    if (ctx->local_flushable && ctx->local_flushable->flush &&
-        ctx->local_flushable->flush() < 0) {
-        debug_log(ctx->debug_sink, DEBUG_LEVEL_ERROR, "controller",
-                  "local flush capability failed");
-        return -1;
+    /* Drain queued records before the transports are flushed and closed. */
+    for (i = 0; i < ctx->sink_count; i++) {
+        const LogSink *sink = &ctx->sinks[i];
+
+        if (sink->async && sink->async->started &&
+            async_log_stop(sink->async) < 0) {
+            sink_error(ctx, sink, "async writer drain failed");
+            rc = -1;
+        }
+    }
+
+    for (i = 0; i < ctx->sink_count; i++) {
+        const LogSink *sink = &ctx->sinks[i];
+        const Flushable *f = sink_flushable(sink);
+
+        if (f && f->flush && !shares_flushable(ctx, i) && f->flush() < 0) {
+            sink_error(ctx, sink, "flush capability failed");
+            rc = -1;
+        }
     }
-    if (ctx->network_connectable && ctx->network_connectable->disconnect &&
-        ctx->network_connectable->disconnect() < 0) {
-        debug_log(ctx->debug_sink, DEBUG_LEVEL_ERROR, "controller",
-                  "network disconnect capability failed");
+    for (i = 0; i < ctx->sink_count; i++) {
+        const LogSink *sink = &ctx->sinks[i];
+        const Connectable *c = sink_connectable(sink);
+
+        if (c && c->disconnect && !shares_connectable(ctx, i) &&
+            c->disconnect() < 0) {
+            sink_error(ctx, sink, "disconnect capability failed");
+            rc = -1;
+        }
+    }
+
+    return rc;
+}
+
+int app_context_metrics(const AppContext *ctx, size_t i,
+                        MetricsSnapshot *out) {
+    const LogSink *sink;
+    const Connectable *c;
+
+    if (!ctx || !out || i >= ctx->sink_count || !ctx->sinks) {
         return -1;
     }
+    sink = &ctx->sinks[i];
+    metrics_read(sink->metrics, out);
+    if (sink->async) {
+        AsyncLogStats st;
+        unsigned long long done;
 
+        async_log_stats(sink->async, &st);
+        done = st.written + st.send_failures + st.dropped_oldest;
+        out->queue_depth = st.submitted > done ? st.submitted - done : 0;
+        out->dropped =
+            st.dropped_newest + st.dropped_oldest + st.dropped_stopped;
+    }
+    c = sink_connectable(sink);
+    if (c && c->reconnects) {
+        out->reconnects = c->reconnects();
+    }
     return 0;
 }
+
+void app_context_print_metrics(const AppContext *ctx, FILE *out) {
+    MetricsSnapshot snap;
+    size_t i;
+
+    for (i = 0; ctx && i < ctx->sink_count; i++) {
+        if (ctx->sinks[i].metrics && app_context_metrics(ctx, i, &snap) == 0) {
+            metrics_print(out, ctx->sinks[i].name, &snap);
+        }
+    }
+    if (out) {
+        fflush(out);
+    }
+}
@@ -0,0 +1,125 @@
+#include "binlog.h"
+#include "interfaces.h"
+#include <string.h>
+
+/* Writes one BINLOG_VERSION record; see binlog.h for the layout. */
+static int binary_format(const Transaction *t, char *out, size_t sz) {
+    unsigned char *p = (unsigned char *)out;
+    size_t user_len;
+    size_t body_len;
+    size_t total;
+
+    if (!t || !out || sz == 0 || !t->user) {
+        return -1;
+    }
+
+    user_len = strlen(t->user);
+    body_len = 1 + binlog_varint_len(t->tid) + 8 +
+               binlog_varint_len(user_len) + user_len;
+    total = binlog_varint_len(body_len) + body_len;
+    if (total >= sz) {
+        return -1;
+    }
+
+    p += binlog_put_varint(p, body_len);
+    *p++ = BINLOG_VERSION;
+    p += binlog_put_varint(p, t->tid);
+    binlog_put_f64(p, t->amount);
+    p += 8;
+    p += binlog_put_varint(p, user_len);
+    memcpy(p, t->user, user_len);
+
+    return (int)total;
+}
+
+static size_t binary_max_len(const Transaction *t) {
+    size_t user_len = t && t->user ? strlen(t->user) : 0;
+    size_t body_len = 1 + BINLOG_VARINT_MAX_LEN + 8 + BINLOG_VARINT_MAX_LEN +
+                      user_len;
+    return BINLOG_VARINT_MAX_LEN + body_len;
+}
+
+/* No numbers to render here; the batch saves the strlen per record. */
+static int binary_format_batch(const TransactionBatch *b, size_t first,
+                               size_t max, char *out, size_t size,
+                               size_t *lens) {
+    unsigned char *p = (unsigned char *)out;
+    size_t n;
+    size_t k;
+
+    if (!b || !out || !lens || first >= b->count) {
+        return -1;
+    }
+    n = b->count - first;
+    n = n < max ? n : max;
+
+    for (k = 0; k < n; k++) {
+        unsigned int id = b->user_ids[first + k];
+        unsigned int tid = b->tids[first + k];
+        const InternedUser *u;
+        size_t body_len;
+        size_t total;
+
+        if (id >= b->user_count) {
+            return -1;
+        }
+        u = &b->users[id];
+        body_len = 1 + binlog_varint_len(tid) + 8 +
+                   binlog_varint_len(u->name_len) + u->name_len;
+        total = binlog_varint_len(body_len) + body_len;
+        if (total > size - (size_t)(p - (unsigned char *)out)) {
+            break;
+        }
+
+        p += binlog_put_varint(p, body_len);
+        *p++ = BINLOG_VERSION;
+        p += binlog_put_varint(p, tid);
+        binlog_put_f64(p, b->amounts[first + k]);
+        p += 8;
+        p += binlog_put_varint(p, u->name_len);
+        memcpy(p, u->name, u->name_len);
+        p += u->name_len;
+        lens[k] = total;
+    }
+    return (int)k;
+}
+
+/* A BINLOG_AGGREGATE_VERSION record; see binlog.h. */
+static int binary_format_aggregate(const AggregateRecord *a, char *out,
+                                   size_t sz) {
+    unsigned char *p = (unsigned char *)out;
+    size_t user_len;
+    size_t body_len;
+    size_t total;
+
+    if (!a || !out || sz == 0 || !a->user) {
+        return -1;
+    }
+
+    user_len = strlen(a->user);
+    body_len = 1 + binlog_varint_len(a->count) + 8 +
+               binlog_varint_len(a->window_ms) + binlog_varint_len(user_len) +
+               user_len;
+    total = binlog_varint_len(body_len) + body_len;
+    if (total >= sz) {
+        return -1;
+    }
+
+    p += binlog_put_varint(p, body_len);
+    *p++ = BINLOG_AGGREGATE_VERSION;
+    p += binlog_put_varint(p, a->count);
+    binlog_put_f64(p, a->sum);
+    p += 8;
+    p += binlog_put_varint(p, a->window_ms);
+    p += binlog_put_varint(p, user_len);
+    memcpy(p, a->user, user_len);
+
+    return (int)total;
+}
+
+const Formatter BINARY_FORMATTER = {
+    .format = binary_format,
+    .max_len = binary_max_len,
+    .format_batch = binary_format_batch,
+    .format_aggregate = binary_format_aggregate,
+};
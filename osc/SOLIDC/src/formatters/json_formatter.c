@@ -1,40 +1,223 @@
 #include "interfaces.h"
-#include "cJSON.h"
-#include <stdio.h>
-#include <stdlib.h>
+#include "json_quote.h"
+#include "numfmt.h"
+#include <string.h>
+
+#define JSON_BATCH_BLOCK 64
+
+/*
+ * Streams {"tid":..,"user":"..","amount":..} straight into the caller's
+ * buffer. Output is byte-identical to cJSON_PrintUnformatted on the same
+ * object: numbers follow cJSON's print_number rules and strings follow its
+ * print_string_ptr escaping, but nothing is allocated.
+ */
+typedef struct JsonWriter {
+    char *p;
+    char *end; /* one past the last usable byte, leaving room for NUL */
+} JsonWriter;
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static int jw_raw(JsonWriter *w, const char *s, size_t n) {
+    if ((size_t)(w->end - w->p) < n) {
+        return -1;
+    }
+    memcpy(w->p, s, n);
+    w->p += n;
+    return 0;
+}
+
+static int jw_number(JsonWriter *w, double d) {
+    int n = numfmt_json(w->p, (size_t)(w->end - w->p), d);
+    if (n < 0) {
+        return -1;
+    }
+    w->p += n;
+    return 0;
+}
+
+static int jw_string(JsonWriter *w, const char *s) {
+    const unsigned char *in = (const unsigned char *)s;
+
+    if (jw_raw(w, "\"", 1) < 0) {
+        return -1;
+    }
+
+    while (*in) {
+        const unsigned char *run = in;
+        char esc[6];
+        size_t esc_len = 2;
+
+        while (*in > 31 && *in != '\"' && *in != '\\') {
+            in++;
+        }
+        if (jw_raw(w, (const char *)run, (size_t)(in - run)) < 0) {
+            return -1;
+        }
+        if (!*in) {
+            break;
+        }
+
+        esc[0] = '\\';
+        switch (*in) {
+        case '\\':
+            esc[1] = '\\';
+            break;
+        case '\"':
+            esc[1] = '\"';
+            break;
+        case '\b':
+            esc[1] = 'b';
+            break;
+        case '\f':
+            esc[1] = 'f';
+            break;
+        case '\n':
+            esc[1] = 'n';
+            break;
+        case '\r':
+            esc[1] = 'r';
+            break;
+        case '\t':
+            esc[1] = 't';
+            break;
+        default:
+            esc[1] = 'u';
+            esc[2] = '0';
+            esc[3] = '0';
+            esc[4] = hex_digits[*in >> 4];
+            esc[5] = hex_digits[*in & 0x0f];
+            esc_len = 6;
+            break;
+        }
+        if (jw_raw(w, esc, esc_len) < 0) {
+            return -1;
+        }
+        in++;
+    }
+
+    return jw_raw(w, "\"", 1);
+}
 
 static int json_format(const Transaction *t, char *out, size_t sz) {
-    int n;
-    cJSON *root = cJSON_CreateObject();
-    char *json_str;
+    JsonWriter w;
 
-    if (!t || !out || sz == 0 || !t->user || !root) {
-        cJSON_Delete(root);
+    if (!t || !out || sz == 0 || !t->user) {
         return -1;
     }
 
-    if (!cJSON_AddNumberToObject(root, "tid", t->tid) ||
-        !cJSON_AddStringToObject(root, "user", t->user) ||
-        !cJSON_AddNumberToObject(root, "amount", t->amount)) {
-        cJSON_Delete(root);
+    w.p = out;
+    w.end = out + sz - 1;
+
+    if (jw_raw(&w, "{\"tid\":", 7) < 0 || jw_number(&w, t->tid) < 0 ||
+        jw_raw(&w, ",\"user\":", 8) < 0 || jw_string(&w, t->user) < 0 ||
+        jw_raw(&w, ",\"amount\":", 10) < 0 || jw_number(&w, t->amount) < 0 ||
+        jw_raw(&w, "}", 1) < 0) {
+        return -1;
+    }
+
+    *w.p = '\0';
+    return (int)(w.p - out);
+}
+
+static size_t json_max_len(const Transaction *t) {
+    size_t user_len = t && t->user ? strlen(t->user) : 0;
+    return 7 + NUMFMT_JSON_MAX_LEN + 8 + JSON_QUOTE_MAX_LEN(user_len) + 10 +
+           NUMFMT_JSON_MAX_LEN + 1;
+}
+
+int json_quote(const char *s, char *out, size_t size) {
+    JsonWriter w;
+
+    if (!s || !out) {
+        return -1;
+    }
+    w.p = out;
+    w.end = out + size;
+    if (jw_string(&w, s) < 0) {
         return -1;
     }
+    return (int)(w.p - out);
+}
+
+/*
+ * Numbers for a block are formatted column by column first; each record is
+ * then four literal pieces, two cells and the user's precomputed JSON.
+ */
+static int json_format_batch(const TransactionBatch *b, size_t first,
+                             size_t max, char *out, size_t size,
+                             size_t *lens) {
+    NumfmtCell tids[JSON_BATCH_BLOCK];
+    NumfmtCell amounts[JSON_BATCH_BLOCK];
+    char *p = out;
+    size_t n;
+    size_t k;
+
+    if (!b || !out || !lens || first >= b->count) {
+        return -1;
+    }
+    n = b->count - first;
+    n = n < max ? n : max;
+    n = n < JSON_BATCH_BLOCK ? n : JSON_BATCH_BLOCK;
+    /* tids are below 2^32, where numfmt_json prints the same as "%u". */
+    numfmt_u32_column(b->tids + first, n, tids);
+    numfmt_json_column(b->amounts + first, n, amounts);
+
+    for (k = 0; k < n; k++) {
+        unsigned int id = b->user_ids[first + k];
+        const InternedUser *u;
+        size_t len;
+
+        if (id >= b->user_count) {
+            return -1;
+        }
+        u = &b->users[id];
+        len = 7 + tids[k].len + 8 + u->json_len + 10 + amounts[k].len + 1;
+        if (len > size - (size_t)(p - out)) {
+            break;
+        }
+        memcpy(p, "{\"tid\":", 7);
+        memcpy(p + 7, tids[k].s, tids[k].len);
+        p += 7 + tids[k].len;
+        memcpy(p, ",\"user\":", 8);
+        memcpy(p + 8, u->json, u->json_len);
+        p += 8 + u->json_len;
+        memcpy(p, ",\"amount\":", 10);
+        memcpy(p + 10, amounts[k].s, amounts[k].len);
+        p += 10 + amounts[k].len;
+        *p++ = '}';
+        lens[k] = len;
+    }
+    return (int)k;
+}
+
+/* {"user":..,"count":..,"sum":..,"window_ms":..}, as cJSON would print it. */
+static int json_format_aggregate(const AggregateRecord *a, char *out,
+                                 size_t sz) {
+    JsonWriter w;
 
-    json_str = cJSON_PrintUnformatted(root);
-    if (!json_str) {
-        cJSON_Delete(root);
+    if (!a || !out || sz == 0 || !a->user) {
         return -1;
     }
 
-    n = snprintf(out, sz, "%s", json_str);
-    free(json_str);
-    cJSON_Delete(root);
+    w.p = out;
+    w.end = out + sz - 1;
 
-    if (n < 0 || (size_t)n >= sz) {
+    if (jw_raw(&w, "{\"user\":", 8) < 0 || jw_string(&w, a->user) < 0 ||
+        jw_raw(&w, ",\"count\":", 9) < 0 || jw_number(&w, a->count) < 0 ||
+        jw_raw(&w, ",\"sum\":", 7) < 0 || jw_number(&w, a->sum) < 0 ||
+        jw_raw(&w, ",\"window_ms\":", 13) < 0 ||
+        jw_number(&w, a->window_ms) < 0 || jw_raw(&w, "}", 1) < 0) {
         return -1;
     }
 
-    return n;
+    *w.p = '\0';
+    return (int)(w.p - out);
 }
 
-const Formatter JSON_FORMATTER = { .format = json_format };
+const Formatter JSON_FORMATTER = {
+    .format = json_format,
+    .max_len = json_max_len,
+    .format_batch = json_format_batch,
+    .format_aggregate = json_format_aggregate,
+};
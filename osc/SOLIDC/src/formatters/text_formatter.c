@@ -1,19 +1,185 @@
 #include "interfaces.h"
-#include <stdio.h>
+#include "numfmt.h"
+#include <string.h>
 
+#define TEXT_PREFIX "Transaction "
+#define TEXT_USER ": User "
+#define TEXT_SENT " sent "
+#define TEXT_BATCH_BLOCK 64
+#define TEXT_AGG_PREFIX "Aggregate: User "
+#define TEXT_AGG_COUNT " count "
+#define TEXT_AGG_SUM " sum "
+#define TEXT_AGG_WINDOW " window_ms "
+
+/* Assembles "Transaction %u: User %s sent %.2f\n" without printf. */
 static int text_format(const Transaction *t, char *out, size_t sz) {
-    int n;
+    char tid[NUMFMT_U32_MAX_LEN];
+    size_t tid_len;
+    size_t user_len;
+    size_t fixed_len;
+    char *p = out;
+    int amount_len;
 
     if (!t || !out || sz == 0 || !t->user) {
         return -1;
     }
 
-    n = snprintf(out, sz, "Transaction %u: User %s sent %.2f\n", t->tid,
-                 t->user, t->amount);
-    if (n < 0 || (size_t)n >= sz) {
+    tid_len = numfmt_u32(tid, t->tid);
+    user_len = strlen(t->user);
+    fixed_len = sizeof(TEXT_PREFIX) - 1 + tid_len + sizeof(TEXT_USER) - 1 +
+                user_len + sizeof(TEXT_SENT) - 1;
+    /* Leave room for the trailing newline and NUL after the amount. */
+    if (fixed_len + 2 >= sz) {
+        return -1;
+    }
+
+    memcpy(p, TEXT_PREFIX, sizeof(TEXT_PREFIX) - 1);
+    p += sizeof(TEXT_PREFIX) - 1;
+    memcpy(p, tid, tid_len);
+    p += tid_len;
+    memcpy(p, TEXT_USER, sizeof(TEXT_USER) - 1);
+    p += sizeof(TEXT_USER) - 1;
+    memcpy(p, t->user, user_len);
+    p += user_len;
+    memcpy(p, TEXT_SENT, sizeof(TEXT_SENT) - 1);
+    p += sizeof(TEXT_SENT) - 1;
+
+    amount_len = numfmt_fixed2(p, sz - fixed_len - 2, t->amount);
+    if (amount_len < 0) {
+        return -1;
+    }
+    p += amount_len;
+    *p++ = '\n';
+    *p = '\0';
+
+    return (int)(p - out);
+}
+
+static size_t text_max_len(const Transaction *t) {
+    return sizeof(TEXT_PREFIX) - 1 + NUMFMT_U32_MAX_LEN + sizeof(TEXT_USER) -
+           1 + (t && t->user ? strlen(t->user) : 0) + sizeof(TEXT_SENT) - 1 +
+           NUMFMT_FIXED2_MAX_LEN + 1;
+}
+
+/* As json_format_batch: number columns first, then memcpy per record. */
+static int text_format_batch(const TransactionBatch *b, size_t first,
+                             size_t max, char *out, size_t size,
+                             size_t *lens) {
+    NumfmtCell tids[TEXT_BATCH_BLOCK];
+    NumfmtCell amounts[TEXT_BATCH_BLOCK];
+    char *p = out;
+    size_t n;
+    size_t k;
+
+    if (!b || !out || !lens || first >= b->count) {
+        return -1;
+    }
+    n = b->count - first;
+    n = n < max ? n : max;
+    n = n < TEXT_BATCH_BLOCK ? n : TEXT_BATCH_BLOCK;
+    numfmt_u32_column(b->tids + first, n, tids);
+    numfmt_fixed2_column(b->amounts + first, n, amounts);
+
+    for (k = 0; k < n; k++) {
+        unsigned int id = b->user_ids[first + k];
+        size_t room = size - (size_t)(p - out);
+        const InternedUser *u;
+        size_t fixed_len;
+        int amount_len = amounts[k].len;
+
+        if (id >= b->user_count) {
+            return -1;
+        }
+        u = &b->users[id];
+        fixed_len = sizeof(TEXT_PREFIX) - 1 + tids[k].len +
+                    sizeof(TEXT_USER) - 1 + u->name_len + sizeof(TEXT_SENT) -
+                    1;
+        if (fixed_len + (size_t)amount_len + 1 > room) {
+            break;
+        }
+        if (amount_len == 0) {
+            /* Too long for a cell; straight into place if it fits. */
+            amount_len = numfmt_fixed2(p + fixed_len, room - fixed_len - 1,
+                                       b->amounts[first + k]);
+            if (amount_len < 0) {
+                break;
+            }
+        } else {
+            memcpy(p + fixed_len, amounts[k].s, (size_t)amount_len);
+        }
+
+        memcpy(p, TEXT_PREFIX, sizeof(TEXT_PREFIX) - 1);
+        p += sizeof(TEXT_PREFIX) - 1;
+        memcpy(p, tids[k].s, tids[k].len);
+        p += tids[k].len;
+        memcpy(p, TEXT_USER, sizeof(TEXT_USER) - 1);
+        p += sizeof(TEXT_USER) - 1;
+        memcpy(p, u->name, u->name_len);
+        p += u->name_len;
+        memcpy(p, TEXT_SENT, sizeof(TEXT_SENT) - 1);
+        p += sizeof(TEXT_SENT) - 1 + (size_t)amount_len;
+        *p++ = '\n';
+        lens[k] = fixed_len + (size_t)amount_len + 1;
+    }
+    return (int)k;
+}
+
+/* "Aggregate: User %s count %u sum %.2f window_ms %u\n" */
+static int text_format_aggregate(const AggregateRecord *a, char *out,
+                                 size_t sz) {
+    char count[NUMFMT_U32_MAX_LEN];
+    char window[NUMFMT_U32_MAX_LEN];
+    size_t count_len;
+    size_t window_len;
+    size_t user_len;
+    size_t fixed_len;
+    char *p = out;
+    int sum_len;
+
+    if (!a || !out || sz == 0 || !a->user) {
         return -1;
     }
 
-    return n;
+    count_len = numfmt_u32(count, a->count);
+    window_len = numfmt_u32(window, a->window_ms);
+    user_len = strlen(a->user);
+    fixed_len = sizeof(TEXT_AGG_PREFIX) - 1 + user_len +
+                sizeof(TEXT_AGG_COUNT) - 1 + count_len + sizeof(TEXT_AGG_SUM) -
+                1 + sizeof(TEXT_AGG_WINDOW) - 1 + window_len;
+    /* Leave room for the trailing newline and NUL besides the sum. */
+    if (fixed_len + 2 >= sz) {
+        return -1;
+    }
+
+    memcpy(p, TEXT_AGG_PREFIX, sizeof(TEXT_AGG_PREFIX) - 1);
+    p += sizeof(TEXT_AGG_PREFIX) - 1;
+    memcpy(p, a->user, user_len);
+    p += user_len;
+    memcpy(p, TEXT_AGG_COUNT, sizeof(TEXT_AGG_COUNT) - 1);
+    p += sizeof(TEXT_AGG_COUNT) - 1;
+    memcpy(p, count, count_len);
+    p += count_len;
+    memcpy(p, TEXT_AGG_SUM, sizeof(TEXT_AGG_SUM) - 1);
+    p += sizeof(TEXT_AGG_SUM) - 1;
+
+    sum_len = numfmt_fixed2(p, sz - fixed_len - 2, a->sum);
+    if (sum_len < 0) {
+        return -1;
+    }
+    p += sum_len;
+    memcpy(p, TEXT_AGG_WINDOW, sizeof(TEXT_AGG_WINDOW) - 1);
+    p += sizeof(TEXT_AGG_WINDOW) - 1;
+    memcpy(p, window, window_len);
+    p += window_len;
+    *p++ = '\n';
+    *p = '\0';
+
+    return (int)(p - out);
 }
-const Formatter TEXT_FORMATTER = { .format = text_format };
+
+const Formatter TEXT_FORMATTER = {
+    .format = text_format,
+    .max_len = text_max_len,
+    .format_batch = text_format_batch,
+    .format_aggregate = text_format_aggregate,
+};
@@ -0,0 +1,35 @@
+#ifndef ASYNC_DEBUG_H
+#define ASYNC_DEBUG_H
+
+#include "debug.h"
+
+typedef struct AsyncDebugOptions {
+    const DebugSink *target;  /* NULL = STDERR_DEBUG_SINK */
+    unsigned int interval_ms; /* 0 = DEBUG_RATE_INTERVAL_MS */
+    unsigned int burst;       /* 0 = DEBUG_RATE_BURST */
+} AsyncDebugOptions;
+
+typedef struct AsyncDebugStats {
+    unsigned long long accepted;   /* messages taken from callers */
+    unsigned long long printed;    /* lines written to the target */
+    unsigned long long suppressed; /* repeats folded into a summary line */
+    unsigned long long dropped;    /* lost to a full table or a busy lock */
+} AsyncDebugStats;
+
+/*
+ * ASYNC_DEBUG_SINK never does I/O on the caller's thread. A message goes
+ * into a small table keyed by level, component and text; a background
+ * thread prints the first occurrence, folds repeats into one
+ * "(repeated N times)" line per interval_ms, and prints at most burst new
+ * messages per interval. Callers only trylock the table, yielding a few
+ * times under contention before counting the message as dropped. Before
+ * start and after stop, messages go straight to the target.
+ */
+int async_debug_start(const AsyncDebugOptions *opts);
+/* Prints what is still pending, including repeat counts, then joins. */
+int async_debug_stop(void);
+void async_debug_stats(AsyncDebugStats *out);
+
+extern const DebugSink ASYNC_DEBUG_SINK;
+
+#endif // ASYNC_DEBUG_H
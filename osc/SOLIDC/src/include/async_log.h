@@ -0,0 +1,136 @@
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include "config.h"
+#include "debug.h"
+#include "interfaces.h"
+#include "logger.h"
+#include "metrics.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+typedef enum AsyncBackpressure {
+    /* Producer waits until the writer frees a slot. */
+    ASYNC_BACKPRESSURE_BLOCK = 0,
+    /* Record being submitted is discarded when the ring is full. */
+    ASYNC_BACKPRESSURE_DROP_NEWEST = 1,
+    /* Oldest queued record is discarded to make room. */
+    ASYNC_BACKPRESSURE_DROP_OLDEST = 2,
+} AsyncBackpressure;
+
+typedef struct AsyncLogOptions {
+    size_t capacity; /* slots per shard, rounded up to a power of two */
+    AsyncBackpressure backpressure;
+    size_t shards; /* 0 or 1 = one ring shared by every producer */
+    size_t batch;  /* records per writer send, 0 or above the cap =
+                      LOG_BATCH_MAX_RECORDS */
+} AsyncLogOptions;
+
+typedef struct AsyncLogStats {
+    unsigned long long submitted;
+    unsigned long long written;
+    unsigned long long dropped_newest;
+    unsigned long long dropped_oldest;
+    unsigned long long dropped_stopped; /* submitted with no writer running */
+    unsigned long long send_failures;
+} AsyncLogStats;
+
+typedef struct AsyncSlot {
+    _Atomic size_t seq;
+    const Sender *sender;
+    const BatchSender *batch_sender;
+    size_t len;
+    char *big; /* heap block holding a record larger than data */
+    char data[MAX_BUFFER_SIZE];
+} AsyncSlot;
+
+/*
+ * One bounded lock-free MPSC ring. Positions and producer-side counters sit
+ * on separate cache lines so producers and the writer do not false-share.
+ */
+typedef struct AsyncShard {
+    _Alignas(64) _Atomic size_t enqueue_pos;
+    _Alignas(64) _Atomic size_t dequeue_pos;
+    _Alignas(64) _Atomic unsigned long long submitted;
+    _Atomic unsigned long long dropped_newest;
+    _Atomic unsigned long long dropped_oldest;
+    _Atomic unsigned long long dropped_stopped;
+    AsyncSlot *slots;
+} AsyncShard;
+
+/*
+ * Sharded ring drained by one writer thread.
+ *
+ * Producers format straight into a claimed slot of their shard and publish
+ * it; the writer visits shards round-robin and hands published slots to the
+ * slot's Sender in ring order, coalescing runs of slots bound for the same
+ * BatchSender into one send_batch call. Transports are therefore only ever
+ * touched by the writer thread while the ring runs.
+ *
+ * Each producer thread is pinned to one shard on first use, so records from
+ * one thread keep their order while different threads rarely contend on the
+ * same enqueue position. There is no ordering between threads.
+ *
+ * Outside async_log_start..async_log_stop nothing drains the ring, so
+ * records are dropped (dropped_stopped) rather than queued, whatever the
+ * backpressure policy; a producer blocked on a full ring gives up too.
+ */
+typedef struct AsyncLog {
+    AsyncShard *shards;
+    size_t shard_count;
+    size_t mask;
+    size_t batch;
+    _Atomic unsigned long long written;
+    _Atomic unsigned long long send_failures;
+    _Atomic int running;
+    AsyncBackpressure backpressure;
+    const DebugSink *debug_sink;
+    SinkMetrics *metrics; /* optional: set after init, before start */
+    pthread_t writer;
+    int started;
+} AsyncLog;
+
+int async_log_init(AsyncLog *q, const AsyncLogOptions *opts,
+                   const DebugSink *debug_sink);
+int async_log_start(AsyncLog *q);
+/*
+ * Formats t on the caller's thread; returns -1 if the record was dropped.
+ * Safe to call from any number of threads concurrently.
+ */
+int async_log_transaction(AsyncLog *q, const Logger *lg, const Transaction *t);
+/*
+ * Formats t with f straight into a slot for sender; records that outgrow
+ * the slot (see Formatter.max_len) move to a heap block the writer frees.
+ */
+int async_log_format(AsyncLog *q, const Formatter *f, const Sender *sender,
+                     const BatchSender *batch_sender, const Transaction *t);
+/*
+ * Copies an already formatted record into the ring for sender. Same
+ * backpressure and threading rules as async_log_transaction.
+ */
+int async_log_submit(AsyncLog *q, const Sender *sender,
+                     const BatchSender *batch_sender, const char *msg,
+                     size_t len);
+typedef struct AsyncReservation {
+    AsyncShard *shard;
+    AsyncSlot *slot;
+    size_t pos;
+} AsyncReservation;
+
+/*
+ * Claims a slot with size writable bytes for the caller to format into:
+ * the slot itself, or a heap block the writer frees once it is sent when
+ * size exceeds MAX_BUFFER_SIZE. Same backpressure and threading rules as
+ * async_log_submit; returns NULL if the record was dropped. Every
+ * successful reserve must be followed by async_log_commit.
+ */
+char *async_log_reserve(AsyncLog *q, size_t size, AsyncReservation *res);
+/* Publishes the first len bytes for sender; len 0 abandons the record. */
+int async_log_commit(AsyncLog *q, AsyncReservation *res, const Sender *sender,
+                     const BatchSender *batch_sender, size_t len);
+/* Drains every published record, then joins the writer thread. */
+int async_log_stop(AsyncLog *q);
+void async_log_destroy(AsyncLog *q);
+void async_log_stats(const AsyncLog *q, AsyncLogStats *out);
+
+#endif // ASYNC_LOG_H
@@ -0,0 +1,166 @@
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Compact binary log record, as written by BINARY_FORMATTER:
+ *
+ *   varint body_len | body
+ *   body = u8 version | varint tid | f64 amount (LE) | varint user_len | user
+ *
+ * or, for one user's aggregate over a window (BINLOG_AGGREGATE_VERSION):
+ *
+ *   body = u8 version | varint count | f64 sum (LE) | varint window_ms |
+ *          varint user_len | user
+ *
+ * Varints are unsigned LEB128. The leading length lets a reader skip records
+ * whose version it does not understand.
+ */
+
+#define BINLOG_VERSION 1
+#define BINLOG_AGGREGATE_VERSION 2
+#define BINLOG_VARINT_MAX_LEN 10
+
+/*
+ * An aggregate has tid 0 and its sum in amount; count and window_ms are 0
+ * for a transaction.
+ */
+typedef struct BinlogRecord {
+    unsigned int version;
+    uint32_t tid;
+    double amount;
+    uint32_t count;
+    uint32_t window_ms;
+    const char *user; /* points into the input, not NUL-terminated */
+    size_t user_len;
+} BinlogRecord;
+
+typedef enum BinlogStatus {
+    BINLOG_OK = 0,
+    BINLOG_INCOMPLETE = 1, /* need more bytes */
+    BINLOG_UNKNOWN_VERSION = 2, /* well framed; *consumed skips it */
+    BINLOG_MALFORMED = -1,
+} BinlogStatus;
+
+static inline size_t binlog_varint_len(uint64_t v) {
+    size_t n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static inline size_t binlog_put_varint(unsigned char *p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+/* Returns bytes read, 0 when truncated, -1 when longer than max_len. */
+static inline int binlog_get_varint(const unsigned char *p, size_t avail,
+                                    size_t max_len, uint64_t *out) {
+    uint64_t v = 0;
+    size_t i;
+
+    for (i = 0; i < avail && i < max_len; i++) {
+        v |= (uint64_t)(p[i] & 0x7f) << (7 * i);
+        if (!(p[i] & 0x80)) {
+            *out = v;
+            return (int)i + 1;
+        }
+    }
+    return i == max_len ? -1 : 0;
+}
+
+static inline void binlog_put_f64(unsigned char *p, double d) {
+    uint64_t bits;
+    int i;
+
+    memcpy(&bits, &d, sizeof(bits));
+    for (i = 0; i < 8; i++) {
+        p[i] = (unsigned char)(bits >> (8 * i));
+    }
+}
+
+static inline double binlog_get_f64(const unsigned char *p) {
+    uint64_t bits = 0;
+    double d;
+    int i;
+
+    for (i = 7; i >= 0; i--) {
+        bits = bits << 8 | p[i];
+    }
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+/* Decodes the record at p; *consumed is set for OK and UNKNOWN_VERSION. */
+static inline BinlogStatus binlog_decode(const unsigned char *p, size_t avail,
+                                         BinlogRecord *out, size_t *consumed) {
+    const unsigned char *body;
+    const unsigned char *end;
+    uint64_t body_len;
+    uint64_t v;
+    int n;
+
+    n = binlog_get_varint(p, avail, BINLOG_VARINT_MAX_LEN, &body_len);
+    if (n <= 0) {
+        return n == 0 ? BINLOG_INCOMPLETE : BINLOG_MALFORMED;
+    }
+    if (body_len == 0 || body_len > avail - (size_t)n) {
+        return body_len == 0 ? BINLOG_MALFORMED : BINLOG_INCOMPLETE;
+    }
+    body = p + n;
+    end = body + body_len;
+    *consumed = (size_t)n + (size_t)body_len;
+
+    out->version = body[0];
+    if (out->version != BINLOG_VERSION &&
+        out->version != BINLOG_AGGREGATE_VERSION) {
+        return BINLOG_UNKNOWN_VERSION;
+    }
+    body++;
+
+    n = binlog_get_varint(body, (size_t)(end - body), 5, &v);
+    if (n <= 0 || v > UINT32_MAX) {
+        return BINLOG_MALFORMED;
+    }
+    out->tid = out->version == BINLOG_VERSION ? (uint32_t)v : 0;
+    out->count = out->version == BINLOG_VERSION ? 0 : (uint32_t)v;
+    body += n;
+
+    if (end - body < 8) {
+        return BINLOG_MALFORMED;
+    }
+    out->amount = binlog_get_f64(body);
+    body += 8;
+
+    out->window_ms = 0;
+    if (out->version == BINLOG_AGGREGATE_VERSION) {
+        n = binlog_get_varint(body, (size_t)(end - body), 5, &v);
+        if (n <= 0 || v > UINT32_MAX) {
+            return BINLOG_MALFORMED;
+        }
+        out->window_ms = (uint32_t)v;
+        body += n;
+    }
+
+    n = binlog_get_varint(body, (size_t)(end - body), BINLOG_VARINT_MAX_LEN,
+                          &v);
+    if (n <= 0 || v != (uint64_t)(end - body - n)) {
+        return BINLOG_MALFORMED;
+    }
+    out->user = (const char *)body + n;
+    out->user_len = (size_t)v;
+    return BINLOG_OK;
+}
+
+#endif // BINLOG_H
@@ -5,16 +5,33 @@
 
 extern const Formatter TEXT_FORMATTER;
 extern const Formatter JSON_FORMATTER;
+extern const Formatter BINARY_FORMATTER;
 
 extern const Sender DISK_SENDER;
 extern const Sender TCP_SENDER;
 extern const Sender UDP_SENDER;
+extern const Sender MMAP_SENDER;
+
+extern const BatchSender DISK_BATCH_SENDER;
+extern const BatchSender TCP_BATCH_SENDER;
+extern const BatchSender UDP_BATCH_SENDER;
+extern const BatchSender MMAP_BATCH_SENDER;
 
 extern const Flushable DISK_FLUSHABLE;
+extern const Connectable DISK_CONNECTABLE;
+extern const Reservable DISK_RESERVABLE;
+extern const Flushable TCP_FLUSHABLE;
 extern const Connectable TCP_CONNECTABLE;
+extern const Flushable MMAP_FLUSHABLE;
+extern const Connectable MMAP_CONNECTABLE;
+extern const Connectable UDP_CONNECTABLE;
 
 extern const Transport DISK_TRANSPORT;
 extern const Transport TCP_TRANSPORT;
 extern const Transport UDP_TRANSPORT;
+extern const Transport MMAP_TRANSPORT;
+extern const Transport URING_DISK_TRANSPORT;
+extern const Transport URING_TCP_TRANSPORT;
+extern const Transport URING_UDP_TRANSPORT;
 
 #endif // COMPONENTS_H
@@ -6,5 +6,50 @@
 #define LOG_FILE "transactions.log"
 #define LOG_PORT 8087
 #define LOG_HOST "127.0.0.1"
+#define ASYNC_QUEUE_CAPACITY 1024
+#define LOG_BATCH_MAX_RECORDS 64
+#define LOG_BATCH_BUFFER_SIZE (16 * 1024)
+#define LOG_MAX_FORMATTERS 8
+#define DISK_BUFFER_SIZE 65536
+#define DISK_FLUSH_INTERVAL_MS 1000
+#define DISK_FDATASYNC_ON_FLUSH 0
+#define DISK_GROUP_COMMIT 0
+#define DISK_COMMIT_INTERVAL_US 2000
+#define DISK_COMMIT_BATCH 256
+#define DISK_ROTATE_BYTES 0
+#define DISK_ROTATE_INTERVAL_S 0
+#define DISK_ROTATE_COMPRESS 1
+#define DISK_ROTATE_QUEUE 16
+#define MMAP_SEGMENT_SIZE (64 * 1024 * 1024)
+#define TCP_NODELAY_ENABLED 1
+#define TCP_CORK_ENABLED 0
+#define TCP_BACKOFF_INITIAL_MS 100
+#define TCP_BACKOFF_MAX_MS 30000
+#define TCP_REPLAY_BUFFER_SIZE (256 * 1024)
+#define TCP_CONNECT_TIMEOUT_MS 1000
+#define TCP_SEND_TIMEOUT_MS 5000
+#define TCP_SPOOL_PATH "transactions.spool"
+#define TCP_SPOOL_MAX_BYTES (1024L * 1024 * 1024)
+#define TCP_SPOOL_CHUNK (256 * 1024)
+#define TCP_SPOOL_DRAIN_BYTES (4 * 1024 * 1024)
+#define UDP_DATAGRAM_SIZE 0
+#define UDP_GSO_ENABLED 1
+#define URING_QUEUE_DEPTH 64
+#define URING_BUFFER_COUNT 8
+#define URING_BUFFER_SIZE (64 * 1024)
+#define URING_MAX_DATAGRAMS 256
+#define DEBUG_RATE_INTERVAL_MS 1000
+#define DEBUG_RATE_BURST 20
+#define DEBUG_TABLE_SIZE 64
+#define POLICY_TABLE_SIZE 1024 /* power of two */
+#define POLICY_MAX_PROBES 8
+#define POLICY_USER_MAX 24
+#define POLICY_SAMPLE_RATE 0.1
+#define POLICY_RATE_PER_SECOND 10.0
+#define POLICY_RATE_BURST 20.0
+#define POLICY_AGGREGATE_INTERVAL_MS 1000
+#ifndef LOG_METRICS_ENABLED
+#define LOG_METRICS_ENABLED 0 /* make METRICS=1 */
+#endif
 
 #endif // CONFIG_H
@@ -1,25 +1,78 @@
 #ifndef CONTROLLER_H
 #define CONTROLLER_H
 
-#include "dto.h"
+#include "async_log.h"
 #include "debug.h"
+#include "dto.h"
 #include "interfaces.h"
 #include "logger.h"
+#include "metrics.h"
+#include <stdio.h>
 
 typedef int (*LogPolicy)(const Transaction *t);
 
+/*
+ * One destination for formatted records. Sinks that share a Formatter share
+ * one formatting of each transaction. A sink with its own AsyncLog is
+ * written by that log's writer thread, so a slow sink does not add latency
+ * to the others; sinks without one are sent to inline, in array order.
+ */
+typedef struct LogSink {
+    const char *name; /* used in diagnostics */
+    const Formatter *formatter;
+    const Transport *transport;
+    LogPolicy policy; /* NULL = every transaction */
+    AsyncLog *async;  /* optional: dedicated writer thread */
+    SinkMetrics *metrics; /* optional; counted only with LOG_METRICS_ENABLED */
+} LogSink;
+
 typedef struct AppContext {
-    Logger local_logger;
-    Logger network_logger;
-    LogPolicy should_log_on_network;
-    const Flushable *local_flushable;
-    const Connectable *network_connectable;
+    const LogSink *sinks;
+    size_t sink_count;
     const DebugSink *debug_sink;
+    /*
+     * Optional: a statically composed pipeline (see pipeline.h) that takes
+     * every record in place of the sinks. The sinks still drive start and
+     * stop, so they must describe the transports it sends to. Bypasses
+     * async sinks and per-sink metrics.
+     */
+    int (*pipeline)(const Transaction *t, const DebugSink *debug_sink);
 } AppContext;
 
+/* Accepts amounts up to the network limit (MAX_TRANSACTION_AMOUNT_TO_LOG). */
 int should_log_on_network(const Transaction *t);
+/* Changes that limit; safe to call while producers run. */
+void set_network_max_amount(double max_amount);
 int app_context_start(const AppContext *ctx);
+/*
+ * Hands t to every sink whose policy accepts it. Every sink is attempted
+ * even when an earlier one fails; returns -1 if any sink failed.
+ *
+ * Thread safety: once app_context_start has returned, this may be called
+ * from any number of threads. Async sinks take records into per-thread ring
+ * shards (size AsyncLogOptions.shards to the producer count) and only their
+ * writer thread touches the transport. Every built-in transport serialises
+ * inline callers internally. Start and stop must not race with producers.
+ */
 int process_transaction_with_ctx(const AppContext *ctx, const Transaction *t);
+/*
+ * process_transaction_with_ctx for every record of b, sink by sink. Sinks
+ * with format_batch format each block of records column by column and send
+ * it in one batch; records a sink's policy drops are left out of its
+ * blocks. Async sinks still take the records one at a time, and a
+ * formatting is not shared between sinks. The pipeline, when set, gets
+ * every record. Returns -1 if b is invalid or any sink failed.
+ */
+int process_batch_with_ctx(const AppContext *ctx, const TransactionBatch *b);
 int app_context_stop(const AppContext *ctx);
 
+/*
+ * Reads sink i's metrics, adding its queue depth and drops when it is async
+ * and reconnects when its transport reports them. Safe to call from any
+ * thread while producers run; -1 if there is no such sink.
+ */
+int app_context_metrics(const AppContext *ctx, size_t i, MetricsSnapshot *out);
+/* Prints every sink that has metrics; not async-signal-safe. */
+void app_context_print_metrics(const AppContext *ctx, FILE *out);
+
 #endif // CONTROLLER_H
@@ -0,0 +1,61 @@
+#ifndef DISK_TRANSPORT_H
+#define DISK_TRANSPORT_H
+
+#include <stddef.h>
+
+typedef struct DiskTransportOptions {
+    const char *path;               /* NULL = LOG_FILE */
+    size_t buffer_size;             /* 0 = DISK_BUFFER_SIZE */
+    /*
+     * Staged bytes reach the file at most flush_interval_ms after they
+     * were sent, written by a background thread if no send comes along
+     * (0 = flush on size or explicitly).
+     */
+    unsigned int flush_interval_ms;
+    int fdatasync_on_flush;
+    /*
+     * Group commit: every send blocks until a background committer has run
+     * an fdatasync covering its records. A commit starts once commit_batch
+     * records are waiting or the oldest has waited commit_interval_us,
+     * whichever comes first (0 disables that trigger; with both 0 the
+     * committer syncs whatever is pending as soon as it is free).
+     */
+    int group_commit;
+    unsigned int commit_interval_us;
+    size_t commit_batch;
+    /*
+     * Rotation: once the file reaches rotate_bytes or has been open for
+     * rotate_interval_s (checked on each send; 0 disables either trigger)
+     * it is renamed to path.NNNNNN and a fresh file takes its place. With
+     * compress set, a background thread turns rotated segments into
+     * path.NNNNNN.lz4. Disconnect seals the current file the same way.
+     */
+    size_t rotate_bytes;
+    unsigned int rotate_interval_s;
+    int compress;
+} DiskTransportOptions;
+
+typedef struct DiskCommitStats {
+    unsigned long long commits;         /* fdatasync calls */
+    unsigned long long records;         /* records made durable */
+    unsigned long long sync_ns_total;   /* time spent in fdatasync */
+    unsigned long long sync_ns_max;
+    unsigned long long wait_ns_total;   /* sender-side wait for durability */
+    unsigned long long wait_ns_max;
+    unsigned long long waits;
+    unsigned long long failures;
+} DiskCommitStats;
+
+typedef struct DiskRotationStats {
+    unsigned long long rotations;       /* segments sealed */
+    unsigned long long compressed;      /* segments turned into .lz4 */
+    unsigned long long compress_failed; /* left uncompressed after an error */
+    unsigned long long compress_skipped; /* queue full, left uncompressed */
+} DiskRotationStats;
+
+/* Must be called while the transport is disconnected. */
+int disk_transport_configure(const DiskTransportOptions *opts);
+void disk_transport_commit_stats(DiskCommitStats *out);
+void disk_transport_rotation_stats(DiskRotationStats *out);
+
+#endif // DISK_TRANSPORT_H
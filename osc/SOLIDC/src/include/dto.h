@@ -1,10 +1,57 @@
 #ifndef DTO_H
 #define DTO_H
 
+#include <stddef.h>
+
 typedef struct {
     unsigned int tid;
     const char *user;
     double amount;
 } Transaction;
 
-#endif // DTO_H
\ No newline at end of file
+/*
+ * One user's totals over an aggregation window (see aggregate_by_user).
+ * Formatters give it a record shape of its own, so downstream it cannot be
+ * mistaken for a transaction.
+ */
+typedef struct AggregateRecord {
+    const char *user;
+    unsigned int count;     /* transactions folded in */
+    double sum;             /* of their amounts */
+    unsigned int window_ms; /* length of the window they fell in */
+} AggregateRecord;
+
+/* One distinct user, with the bytes each formatter emits for it. */
+typedef struct InternedUser {
+    const char *name; /* NUL-terminated; what text and binary records carry */
+    size_t name_len;
+    const char *json; /* quoted and escaped as JSON_FORMATTER writes it */
+    size_t json_len;
+} InternedUser;
+
+/*
+ * count transactions as a struct of arrays: record i is tids[i],
+ * users[user_ids[i]] and amounts[i]. users is usually a UserTable's
+ * entries (see user_table.h).
+ */
+typedef struct TransactionBatch {
+    const unsigned int *tids;
+    const double *amounts;
+    const unsigned int *user_ids;
+    size_t count;
+    const InternedUser *users;
+    size_t user_count;
+} TransactionBatch;
+
+/* Record i of b as a Transaction; user_ids[i] must be below user_count. */
+static inline Transaction transaction_batch_at(const TransactionBatch *b,
+                                               size_t i) {
+    Transaction t;
+
+    t.tid = b->tids[i];
+    t.user = b->users[b->user_ids[i]].name;
+    t.amount = b->amounts[i];
+    return t;
+}
+
+#endif // DTO_H
@@ -3,6 +3,7 @@
 
 #include "dto.h"
 #include <stdlib.h>
+#include <sys/uio.h>
 
 typedef struct Formatter {
     /*
@@ -12,6 +13,27 @@ typedef struct Formatter {
      * - must not write past buf_size
      */
     int (*format)(const Transaction *t, char *buf, size_t buf_size);
+    /*
+     * Optional: an upper bound on format's return value for t. Callers use
+     * it to size space for records that do not fit MAX_BUFFER_SIZE; without
+     * it a record is limited to MAX_BUFFER_SIZE - 1 bytes.
+     */
+    size_t (*max_len)(const Transaction *t);
+    /*
+     * Optional: formats records first, first + 1, ... of b back to back
+     * into buf, each byte-identical to what format writes for it (no NULs),
+     * and stores their lengths in lens. Stops after max records or before
+     * one that does not fit size; returns how many it wrote, which is 0
+     * only when record first alone does not fit, or -1 on an invalid
+     * batch (e.g. a user id past b->user_count).
+     */
+    int (*format_batch)(const TransactionBatch *b, size_t first, size_t max,
+                        char *buf, size_t size, size_t *lens);
+    /*
+     * Optional: formats a as format does a transaction, in a shape readers
+     * can tell apart from one. A sink with the aggregate policy needs it.
+     */
+    int (*format_aggregate)(const AggregateRecord *a, char *buf, size_t size);
 } Formatter;
 
 typedef struct Sender {
@@ -19,21 +41,47 @@ typedef struct Sender {
     int (*send)(const char *msg, size_t len);
 } Sender;
 
+typedef struct BatchSender {
+    /*
+     * Optional capability: send n records in one call.
+     * Contract: return 0 when every record was sent, -1 on error.
+     */
+    int (*send_batch)(const struct iovec *iov, size_t n);
+} BatchSender;
+
 typedef struct Flushable {
     /* Optional capability: flush buffered data if any. */
     int (*flush)(void);
 } Flushable;
 
+typedef struct Reservable {
+    /*
+     * Optional capability: lets the caller format straight into the
+     * transport's own buffer. reserve returns size writable bytes, or NULL
+     * when the transport cannot take that much in one piece (send the record
+     * normally instead). A successful reserve must be followed by exactly
+     * one commit of the first used bytes (used <= size, 0 abandons the
+     * space); the transport may hold a lock in between, so the caller must
+     * not touch the transport otherwise until it commits.
+     */
+    char *(*reserve)(size_t size);
+    int (*commit)(size_t used);
+} Reservable;
+
 typedef struct Connectable {
     /* Optional capability: connect/disconnect lifecycle for transport. */
     int (*connect)(void);
     int (*disconnect)(void);
+    /* Optional: connections re-established after a loss, for metrics. */
+    unsigned long long (*reconnects)(void);
 } Connectable;
 
 typedef struct Transport {
     const Sender *sender;
+    const BatchSender *batch_sender;
     const Flushable *flushable;
     const Connectable *connectable;
+    const Reservable *reservable;
 } Transport;
 
 #endif // INTERFACES_H
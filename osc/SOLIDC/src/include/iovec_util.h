@@ -0,0 +1,32 @@
+#ifndef IOVEC_UTIL_H
+#define IOVEC_UTIL_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+/*
+ * Consumes n written bytes from the front of an iovec array after a short
+ * writev/sendmsg, so the caller can resubmit the remainder.
+ */
+static inline void iov_advance(struct iovec **iov, size_t *cnt, size_t n) {
+    while (*cnt > 0 && n >= (*iov)->iov_len) {
+        n -= (*iov)->iov_len;
+        (*iov)++;
+        (*cnt)--;
+    }
+    if (*cnt > 0 && n > 0) {
+        (*iov)->iov_base = (char *)(*iov)->iov_base + n;
+        (*iov)->iov_len -= n;
+    }
+}
+
+static inline size_t iov_total(const struct iovec *iov, size_t cnt) {
+    size_t total = 0;
+    size_t i;
+    for (i = 0; i < cnt; i++) {
+        total += iov[i].iov_len;
+    }
+    return total;
+}
+
+#endif // IOVEC_UTIL_H
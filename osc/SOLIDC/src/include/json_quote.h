@@ -0,0 +1,16 @@
+#ifndef JSON_QUOTE_H
+#define JSON_QUOTE_H
+
+#include <stddef.h>
+
+/* A control character escapes to six bytes, the worst case per input byte. */
+#define JSON_QUOTE_MAX_LEN(len) (2 + 6 * (len))
+
+/*
+ * Writes s as a quoted JSON string, escaped exactly as JSON_FORMATTER does
+ * (cJSON's rules), without a NUL. Returns the length, or -1 when size is
+ * too small.
+ */
+int json_quote(const char *s, char *out, size_t size);
+
+#endif // JSON_QUOTE_H
@@ -4,13 +4,52 @@
 #include "config.h"
 #include "debug.h"
 #include "interfaces.h"
+#include "metrics.h"
 
 typedef struct Logger {
     const Formatter *formatter;
     const Sender *sender;
+    const BatchSender *batch_sender; /* optional */
+    const Reservable *reservable;    /* optional: format in place */
+    SinkMetrics *metrics;            /* optional */
 } Logger;
 
+/*
+ * With a reservable transport the record is formatted straight into the
+ * transport's buffer; otherwise on the stack, or in the thread's record
+ * arena when it needs more than MAX_BUFFER_SIZE bytes.
+ */
 int log_transaction(const Logger *lg, const Transaction *t,
                     const DebugSink *debug_sink);
+/* Sends one already formatted record, reporting errno on failure. */
+int log_record(const Sender *sender, const char *msg, size_t len,
+               const DebugSink *debug_sink);
+/*
+ * Formats n transactions and submits them through batch_sender, falling back
+ * to one sender->send per record when the logger has no batch capability.
+ * Records that fail to format are skipped; returns -1 if any record failed.
+ */
+int log_transaction_batch(const Logger *lg, const Transaction *ts, size_t n,
+                          const DebugSink *debug_sink);
+/*
+ * Formats b with the formatter's format_batch a block at a time and submits
+ * each block like log_transaction_batch. A record too big for the batch
+ * buffer goes through log_transaction on its own; a formatter without
+ * format_batch falls back to log_transaction_batch.
+ */
+int log_batch(const Logger *lg, const TransactionBatch *b,
+              const DebugSink *debug_sink);
+/* Whether b's arrays are present and every user id is in range. */
+int transaction_batch_valid(const TransactionBatch *b);
+
+/* Space to set aside for formatting t, NUL included. */
+size_t log_record_space(const Formatter *f, const Transaction *t);
+/*
+ * For a record that did not fit MAX_BUFFER_SIZE: formats it into record
+ * arena slot and returns it, or NULL when the formatter cannot say how big
+ * it is or formatting fails anyway.
+ */
+const char *log_format_oversized(const Formatter *f, const Transaction *t,
+                                 size_t slot, size_t *len);
 
 #endif // LOGGER_H
@@ -0,0 +1,157 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "config.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#if LOG_METRICS_ENABLED
+#include <time.h>
+#define METRICS_SHARDS 8
+#else
+#define METRICS_SHARDS 1
+#endif
+
+/* Bucket b counts latencies below 2^b ns; the last one takes the rest. */
+#define METRICS_HIST_BUCKETS 40
+
+typedef enum MetricCounter {
+    METRIC_RECORDS = 0,         /* records formatted for the sink */
+    METRIC_FORMAT_FAILURES = 1,
+    METRIC_BYTES = 2,           /* bytes handed to the transport */
+    METRIC_SEND_FAILURES = 3,   /* records the transport rejected */
+    METRIC_COUNTERS = 4,
+} MetricCounter;
+
+typedef enum MetricHistogram {
+    METRIC_FORMAT_NS = 0, /* one format call */
+    METRIC_SEND_NS = 1,   /* one send or send_batch call */
+    METRIC_HISTOGRAMS = 2,
+} MetricHistogram;
+
+/*
+ * Each thread updates one shard with relaxed atomics, so producers on
+ * different shards never share a cache line. Readers sum the shards; a
+ * snapshot is not atomic across counters.
+ */
+typedef struct MetricsShard {
+    _Alignas(64) _Atomic unsigned long long counters[METRIC_COUNTERS];
+    _Atomic unsigned long long hist[METRIC_HISTOGRAMS][METRICS_HIST_BUCKETS];
+} MetricsShard;
+
+/*
+ * Counters and latency histograms for one sink. Updates compile to nothing
+ * unless LOG_METRICS_ENABLED is set (make METRICS=1); the struct stays so
+ * LogSink layouts do not depend on the flag.
+ */
+typedef struct SinkMetrics {
+    MetricsShard shards[METRICS_SHARDS];
+} SinkMetrics;
+
+typedef struct MetricsSnapshot {
+    unsigned long long counters[METRIC_COUNTERS];
+    unsigned long long hist[METRIC_HISTOGRAMS][METRICS_HIST_BUCKETS];
+    /* Read from the sink's AsyncLog and Connectable when it has them. */
+    unsigned long long queue_depth;
+    unsigned long long dropped;
+    unsigned long long reconnects;
+} MetricsSnapshot;
+
+void metrics_reset(SinkMetrics *m);
+/* Sums the shards of m into out's counters and histograms. */
+void metrics_read(const SinkMetrics *m, MetricsSnapshot *out);
+/* Upper bound in ns of the bucket holding quantile q (0..1); 0 if empty. */
+unsigned long long metrics_quantile_ns(const MetricsSnapshot *s,
+                                       MetricHistogram h, double q);
+void metrics_print(FILE *out, const char *name, const MetricsSnapshot *s);
+
+#if LOG_METRICS_ENABLED
+extern _Thread_local size_t metrics_thread_shard;
+size_t metrics_assign_shard(void);
+
+static inline MetricsShard *metrics_shard(SinkMetrics *m) {
+    size_t k = metrics_thread_shard;
+
+    if (k == 0) {
+        k = metrics_assign_shard();
+    }
+    return &m->shards[k - 1];
+}
+
+static inline long long metrics_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Start of a timed section; no clock read for a sink without metrics. */
+static inline long long metrics_start(const SinkMetrics *m) {
+    return m ? metrics_now_ns() : 0;
+}
+
+static inline void metrics_add(SinkMetrics *m, MetricCounter c,
+                               unsigned long long v) {
+    if (m) {
+        atomic_fetch_add_explicit(&metrics_shard(m)->counters[c], v,
+                                  memory_order_relaxed);
+    }
+}
+
+/* Records the time since start, a metrics_start() reading. */
+static inline void metrics_observe(SinkMetrics *m, MetricHistogram h,
+                                   long long start) {
+    unsigned long long ns;
+    size_t b = 0;
+
+    if (!m) {
+        return;
+    }
+    ns = (unsigned long long)(metrics_now_ns() - start);
+    while (ns > 0 && b < METRICS_HIST_BUCKETS - 1) {
+        ns >>= 1;
+        b++;
+    }
+    atomic_fetch_add_explicit(&metrics_shard(m)->hist[h][b], 1,
+                              memory_order_relaxed);
+}
+#else
+static inline long long metrics_start(const SinkMetrics *m) {
+    (void)m;
+    return 0;
+}
+
+static inline void metrics_add(SinkMetrics *m, MetricCounter c,
+                               unsigned long long v) {
+    (void)m;
+    (void)c;
+    (void)v;
+}
+
+static inline void metrics_observe(SinkMetrics *m, MetricHistogram h,
+                                   long long start) {
+    (void)m;
+    (void)h;
+    (void)start;
+}
+#endif
+
+/* Closes a format timed from start; ok is whether it produced a record. */
+static inline void metrics_formatted(SinkMetrics *m, long long start, int ok) {
+    metrics_observe(m, METRIC_FORMAT_NS, start);
+    metrics_add(m, ok ? METRIC_RECORDS : METRIC_FORMAT_FAILURES, 1);
+}
+
+/* Closes a send of records records (bytes in total) timed from start. */
+static inline void metrics_sent(SinkMetrics *m, long long start, int rc,
+                                size_t records, size_t bytes) {
+    metrics_observe(m, METRIC_SEND_NS, start);
+    if (rc < 0) {
+        metrics_add(m, METRIC_SEND_FAILURES, records);
+    } else {
+        metrics_add(m, METRIC_BYTES, bytes);
+    }
+}
+
+#endif // METRICS_H
@@ -0,0 +1,17 @@
+#ifndef MMAP_TRANSPORT_H
+#define MMAP_TRANSPORT_H
+
+#include <stddef.h>
+
+typedef struct MmapTransportOptions {
+    const char *path;    /* segment prefix, NULL = LOG_FILE */
+    size_t segment_size; /* 0 = MMAP_SEGMENT_SIZE */
+} MmapTransportOptions;
+
+/*
+ * Segments are named "<path>.NNNNNN", numbered on from the highest one
+ * already present. Must be called while the transport is disconnected.
+ */
+int mmap_transport_configure(const MmapTransportOptions *opts);
+
+#endif // MMAP_TRANSPORT_H
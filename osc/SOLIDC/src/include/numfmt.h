@@ -0,0 +1,55 @@
+#ifndef NUMFMT_H
+#define NUMFMT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Locale-free number formatting for the formatters.
+ *
+ * Every function produces exactly the bytes the printf conversion named in
+ * its comment would (in the "C" locale), takes a fast integer-only path for
+ * the values transactions actually carry and falls back to snprintf for the
+ * rest. Outputs are not NUL-terminated; return the length written, or -1
+ * when sz is too small.
+ */
+
+#define NUMFMT_U32_MAX_LEN 10
+#define NUMFMT_I32_MAX_LEN 11
+/* Longest "%.2f" of any double: sign, 309 digits, point, 2 decimals. */
+#define NUMFMT_FIXED2_MAX_LEN 313
+/* Longest numfmt_json output, e.g. "-2.2250738585072014e-308". */
+#define NUMFMT_JSON_MAX_LEN 24
+
+/* "%u"; buf must hold NUMFMT_U32_MAX_LEN bytes. */
+size_t numfmt_u32(char *buf, uint32_t v);
+/* "%d"; buf must hold NUMFMT_I32_MAX_LEN bytes. */
+size_t numfmt_i32(char *buf, int32_t v);
+/* "%.2f" */
+int numfmt_fixed2(char *buf, size_t sz, double v);
+/*
+ * "%1.15g" when that round-trips, otherwise "%1.17g": the non-integer branch
+ * of cJSON's print_number.
+ */
+int numfmt_g15(char *buf, size_t sz, double v);
+/* Full cJSON print_number rules: "null", "%d" for int-valued, else g15. */
+int numfmt_json(char *buf, size_t sz, double v);
+
+/*
+ * Column-at-a-time variants for TransactionBatch formatters: one tight loop
+ * per column of a batch instead of a call per field per record, leaving
+ * record assembly to memcpy. A cell of length 0 holds a value too long for
+ * it (only "%.2f" of magnitudes from 1e20); format that one directly.
+ */
+#define NUMFMT_CELL_SIZE NUMFMT_JSON_MAX_LEN
+
+typedef struct NumfmtCell {
+    unsigned char len;
+    char s[NUMFMT_CELL_SIZE];
+} NumfmtCell;
+
+void numfmt_u32_column(const unsigned int *v, size_t n, NumfmtCell *out);
+void numfmt_fixed2_column(const double *v, size_t n, NumfmtCell *out);
+void numfmt_json_column(const double *v, size_t n, NumfmtCell *out);
+
+#endif // NUMFMT_H
@@ -0,0 +1,59 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "config.h"
+#include "debug.h"
+#include "interfaces.h"
+#include "logger.h"
+
+/*
+ * Statically composed logger pipelines.
+ *
+ * LOG_PIPELINE(name, FORMATTER, SENDER, policy) defines
+ *
+ *   static int name(const Transaction *t, const DebugSink *debug_sink);
+ *
+ * which logs t through the named const Formatter and Sender objects (the
+ * same ones Logger and LogSink point at) when policy(t) accepts it. The
+ * wiring is fixed when the pipeline is compiled: there are no per-record
+ * NULL checks, policy is a direct call, and format and send are loaded
+ * from const objects, so with link-time optimisation (make LTO_FLAGS=-flto)
+ * the compiler can inline all three. A pipeline that names a component
+ * that does not exist fails to link rather than at runtime.
+ *
+ * Records that outgrow MAX_BUFFER_SIZE take the record arena, as in
+ * log_transaction. Returns 0 when t was sent or filtered out.
+ */
+#define LOG_PIPELINE(name, FORMATTER, SENDER, policy)                          \
+    static int name(const Transaction *t, const DebugSink *debug_sink) {       \
+        char buf_[MAX_BUFFER_SIZE];                                            \
+        const char *msg_ = buf_;                                               \
+        size_t len_;                                                           \
+        int n_;                                                                \
+                                                                               \
+        if (!policy(t)) {                                                      \
+            return 0;                                                          \
+        }                                                                      \
+        n_ = (FORMATTER).format(t, buf_, sizeof(buf_));                        \
+        if (n_ >= 0 && n_ < (int)sizeof(buf_)) {                               \
+            len_ = (size_t)n_;                                                 \
+        } else if (!(msg_ = log_format_oversized(&(FORMATTER), t, 0,           \
+                                                 &len_))) {                    \
+            debug_log(debug_sink, DEBUG_LEVEL_ERROR, #name,                    \
+                      "formatter failed or produced invalid length");          \
+            return -1;                                                         \
+        }                                                                      \
+        if ((SENDER).send(msg_, len_) < 0) {                                   \
+            debug_log_errno(debug_sink, #name, "send");                        \
+            return -1;                                                         \
+        }                                                                      \
+        return 0;                                                              \
+    }
+
+/* Policy for a pipeline that takes every transaction. */
+static inline int log_policy_all(const Transaction *t) {
+    (void)t;
+    return 1;
+}
+
+#endif // PIPELINE_H
@@ -0,0 +1,16 @@
+#ifndef PIPELINES_H
+#define PIPELINES_H
+
+#include "debug.h"
+#include "dto.h"
+
+/*
+ * The built-in wiring compiled as one LOG_PIPELINE per sink: every
+ * transaction as text to the disk log, and those should_log_on_network
+ * accepts as JSON to the TCP collector. Set it as AppContext.pipeline on a
+ * context whose sinks are that same wiring, so start and stop still
+ * connect, flush and disconnect both transports.
+ */
+int production_pipeline(const Transaction *t, const DebugSink *debug_sink);
+
+#endif // PIPELINES_H
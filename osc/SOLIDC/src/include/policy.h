@@ -0,0 +1,62 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+#include "debug.h"
+#include "dto.h"
+#include "interfaces.h"
+
+/*
+ * LogPolicy engines for sinks that should not see every transaction. Like
+ * should_log_on_network they keep their settings in file-static state, set
+ * by policy_configure before the context starts.
+ *
+ * Per-user state lives in fixed open-addressing tables of POLICY_TABLE_SIZE
+ * compact entries keyed by a hash of the user. A lookup probes at most
+ * POLICY_MAX_PROBES slots, so every policy call is O(1) whatever the number
+ * of users.
+ */
+typedef struct PolicyOptions {
+    double sample_rate;                 /* fraction of tids kept, 0 to 1 */
+    double rate_per_second;             /* token refill per user */
+    double rate_burst;                  /* bucket size per user */
+    unsigned int aggregate_interval_ms; /* 0 = POLICY_AGGREGATE_INTERVAL_MS */
+} PolicyOptions;
+
+/* Fills in the config.h defaults. */
+void policy_options_defaults(PolicyOptions *opts);
+/* Applies opts and empties the token buckets; -1 if a value is out of range. */
+int policy_configure(const PolicyOptions *opts);
+
+/*
+ * Keeps a tid when a fixed hash of it falls under sample_rate, so a given
+ * tid is always kept or always dropped, on every host and every run.
+ */
+int sample_by_tid(const Transaction *t);
+/*
+ * One token bucket per user: a user may log rate_burst transactions at
+ * once and rate_per_second after that. When the probe window is full the
+ * user that has been idle longest gives up its bucket; it comes back full,
+ * which an idle user's bucket would have been anyway.
+ */
+int rate_limit_by_user(const Transaction *t);
+/*
+ * Folds t into its user's running sum and count and returns 0, so the sink
+ * sends nothing for it. Every aggregate_interval_ms the background thread
+ * sends one AggregateRecord per user through the sink formatter's
+ * format_aggregate, a record shape no transaction has. A transaction whose
+ * user does not fit the table (probe window full, or a name of
+ * POLICY_USER_MAX bytes or more) is passed through to be logged on its
+ * own, as is everything while the aggregator is not running.
+ */
+int aggregate_by_user(const Transaction *t);
+
+/*
+ * Starts the window thread; records go out through f and sender. -1 when
+ * f has no format_aggregate.
+ */
+int policy_aggregate_start(const Formatter *f, const Sender *sender,
+                           const DebugSink *debug_sink);
+/* Sends the partial window, then joins. */
+int policy_aggregate_stop(void);
+
+#endif // POLICY_H
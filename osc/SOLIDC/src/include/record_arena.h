@@ -0,0 +1,17 @@
+#ifndef RECORD_ARENA_H
+#define RECORD_ARENA_H
+
+#include "config.h"
+#include <stddef.h>
+
+#define RECORD_ARENA_SLOTS LOG_MAX_FORMATTERS
+
+/*
+ * Per-thread scratch space for records that do not fit MAX_BUFFER_SIZE.
+ * Each thread has RECORD_ARENA_SLOTS buffers that only ever grow, so a
+ * steady stream of large records allocates once; they are freed when the
+ * thread exits. Returns at least size bytes of slot's buffer, or NULL.
+ */
+char *record_arena_get(size_t slot, size_t size);
+
+#endif // RECORD_ARENA_H
@@ -0,0 +1,46 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "controller.h"
+
+/*
+ * Input formats for non-interactive ingestion.
+ *
+ * TEXT:   one "tid user amount" per line, whitespace separated, the same
+ *         fields the interactive prompt reads.
+ * BINARY: packed little-endian records with no file header:
+ *         u32 tid | f64 amount | u16 user_len | user bytes
+ */
+typedef enum ReplayFormat {
+    REPLAY_FORMAT_TEXT = 0,
+    REPLAY_FORMAT_BINARY = 1,
+} ReplayFormat;
+
+#define REPLAY_BINARY_HEADER_SIZE 14
+#define REPLAY_MAX_USER 255
+
+typedef struct ReplayStats {
+    unsigned long long records;
+    unsigned long long failed;    /* process_transaction_with_ctx < 0 */
+    unsigned long long malformed; /* lines/records that did not parse */
+    unsigned long long bytes;
+    double seconds;
+} ReplayStats;
+
+/*
+ * Called between records, about every REPLAY_POLL_BYTES of input, so the
+ * caller can act on signals (e.g. reload the configuration behind ctx).
+ */
+typedef void (*ReplayPoll)(void *arg);
+
+#define REPLAY_POLL_BYTES (1024 * 1024)
+
+/*
+ * path "-" reads stdin; regular files are mapped with mmap. poll may be
+ * NULL.
+ */
+int replay_run(const AppContext *ctx, const char *path, ReplayFormat format,
+               ReplayPoll poll, void *poll_arg, ReplayStats *stats);
+void replay_print_stats(const ReplayStats *stats);
+
+#endif // REPLAY_H
@@ -0,0 +1,96 @@
+#ifndef RUNTIME_CONFIG_H
+#define RUNTIME_CONFIG_H
+
+#include "async_log.h"
+#include "controller.h"
+#include "disk_transport.h"
+#include "mmap_transport.h"
+#include "policy.h"
+#include "tcp_transport.h"
+#include "udp_transport.h"
+#include "uring_transport.h"
+
+#define CONFIG_MAX_SINKS 8
+#define CONFIG_NAME_MAX 32
+#define CONFIG_PATH_MAX 256
+#define CONFIG_HOST_MAX 64
+
+typedef struct SinkConfig {
+    char name[CONFIG_NAME_MAX];
+    const Formatter *formatter;
+    const Transport *transport;
+    LogPolicy policy;
+    int async;
+    AsyncLogOptions async_opts;
+} SinkConfig;
+
+/*
+ * Everything trlog used to take from config.h, settable at startup. The
+ * option structs point into the path and host arrays, so a RuntimeConfig
+ * must not be copied by value; allocate one per load.
+ *
+ * MAX_BUFFER_SIZE stays a compile-time limit: it sizes stack buffers and
+ * async ring slots. Longer records take the record arena or a heap slot.
+ */
+typedef struct RuntimeConfig {
+    SinkConfig sinks[CONFIG_MAX_SINKS];
+    size_t sink_count;
+    double network_max_amount;
+    PolicyOptions policy; /* for the sample, rate_limit and aggregate sinks */
+    char disk_path[CONFIG_PATH_MAX];
+    char mmap_path[CONFIG_PATH_MAX];
+    char tcp_host[CONFIG_HOST_MAX];
+    char tcp_spool_path[CONFIG_PATH_MAX];
+    char udp_host[CONFIG_HOST_MAX];
+    DiskTransportOptions disk;
+    MmapTransportOptions mmap;
+    TcpTransportOptions tcp;
+    UdpTransportOptions udp;
+    UringTransportOptions uring;
+} RuntimeConfig;
+
+/* The built-in setup: TEXT to disk, JSON to TCP for network amounts. */
+void runtime_config_defaults(RuntimeConfig *cfg);
+/*
+ * Reads a JSON file on top of the defaults; see trlog.example.json. Returns
+ * -1 and a message in err on a parse or validation error.
+ */
+int runtime_config_load(const char *path, RuntimeConfig *cfg, char *err,
+                        size_t err_size);
+
+/* One generation of sinks; a reload builds the next beside the live one. */
+typedef struct RuntimeSinks {
+    LogSink sinks[CONFIG_MAX_SINKS];
+    AsyncLog async[CONFIG_MAX_SINKS];
+    SinkMetrics metrics[CONFIG_MAX_SINKS]; /* reset on every (re)start */
+    size_t count;
+} RuntimeSinks;
+
+/* A running AppContext built from a RuntimeConfig it owns. */
+typedef struct RuntimeApp {
+    RuntimeConfig *config;
+    RuntimeSinks gens[2];
+    unsigned int live; /* the generation ctx.sinks points into */
+    AppContext ctx;
+} RuntimeApp;
+
+/*
+ * Applies cfg to the transports and starts the context; app takes ownership
+ * of cfg (heap allocated) even on failure. Like app_context_start, a sink
+ * that fails to connect does not stop the others; returns -1 if any did.
+ */
+int runtime_app_start(RuntimeApp *app, RuntimeConfig *cfg,
+                      const DebugSink *debug_sink);
+/*
+ * Builds cfg's sinks beside the running ones and starts their async
+ * writers; if that fails, cfg is freed and the old context keeps running.
+ * Otherwise the old writers drain, transports whose options changed are
+ * reconnected with the new ones, ctx switches to the new sinks and
+ * transports only the old sinks used are closed. Transports whose options
+ * did not change stay connected throughout. No accepted record is lost.
+ * Must not race with producers; call it between records.
+ */
+int runtime_app_reload(RuntimeApp *app, RuntimeConfig *cfg);
+int runtime_app_stop(RuntimeApp *app);
+
+#endif // RUNTIME_CONFIG_H
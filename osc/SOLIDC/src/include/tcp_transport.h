@@ -0,0 +1,47 @@
+#ifndef TCP_TRANSPORT_H
+#define TCP_TRANSPORT_H
+
+#include <stddef.h>
+
+typedef struct TcpTransportOptions {
+    const char *host;   /* NULL = LOG_HOST */
+    unsigned short port; /* 0 = LOG_PORT */
+    int nodelay;
+    int cork; /* hold partial frames until TCP_FLUSHABLE.flush */
+    unsigned int backoff_initial_ms;
+    unsigned int backoff_max_ms;
+    size_t replay_buffer_size; /* 0 disables replay */
+    unsigned int connect_timeout_ms; /* 0 = TCP_CONNECT_TIMEOUT_MS */
+    /*
+     * A send the collector has not let through for this long counts as a
+     * lost connection, so a collector that stops reading opens the breaker
+     * instead of stalling every producer (0 = TCP_SEND_TIMEOUT_MS).
+     */
+    unsigned int send_timeout_ms;
+    /*
+     * Records that do not fit the replay buffer while the collector is down
+     * are appended to this file and replayed after it, in order, once a
+     * connection is back. A spool left by an earlier run is replayed too.
+     */
+    const char *spool_path; /* NULL = TCP_SPOOL_PATH */
+    size_t spool_max_bytes; /* 0 disables the spool */
+} TcpTransportOptions;
+
+typedef struct TcpTransportStats {
+    unsigned long long connects;
+    unsigned long long reconnects; /* connects made by a send after a loss */
+    unsigned long long reconnect_failures;
+    unsigned long long short_circuited; /* sends that skipped connecting */
+    unsigned long long replayed;
+    unsigned long long replay_dropped; /* no room in the buffer or spool */
+    unsigned long long spooled;
+    unsigned long long spool_replayed;
+    size_t replay_bytes;
+    size_t spool_bytes; /* written but not yet replayed */
+} TcpTransportStats;
+
+/* Must be called while the transport is disconnected. */
+int tcp_transport_configure(const TcpTransportOptions *opts);
+void tcp_transport_stats(TcpTransportStats *out);
+
+#endif // TCP_TRANSPORT_H
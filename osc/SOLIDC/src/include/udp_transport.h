@@ -0,0 +1,31 @@
+#ifndef UDP_TRANSPORT_H
+#define UDP_TRANSPORT_H
+
+#include <stddef.h>
+
+typedef struct UdpTransportOptions {
+    const char *host;    /* NULL = LOG_HOST */
+    unsigned short port; /* 0 = LOG_PORT */
+    /*
+     * Batches pack consecutive records into datagrams of up to this many
+     * bytes (1472 fits a 1500-byte Ethernet MTU). Records are never split;
+     * 0 keeps one record per datagram.
+     */
+    size_t datagram_size;
+    /* Send runs of equal-sized datagrams as one UDP_SEGMENT (GSO) write. */
+    int gso;
+} UdpTransportOptions;
+
+typedef struct UdpTransportStats {
+    unsigned long long records;
+    unsigned long long datagrams;   /* as seen on the wire */
+    unsigned long long syscalls;    /* send and sendmmsg calls */
+    unsigned long long gso_writes;  /* messages segmented by the kernel */
+    unsigned long long errors;
+} UdpTransportStats;
+
+/* Must be called while the transport is disconnected. */
+int udp_transport_configure(const UdpTransportOptions *opts);
+void udp_transport_stats(UdpTransportStats *out);
+
+#endif // UDP_TRANSPORT_H
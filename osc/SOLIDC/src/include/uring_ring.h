@@ -0,0 +1,58 @@
+#ifndef URING_RING_H
+#define URING_RING_H
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+#define URING_PROBE_OPS 256
+
+/*
+ * Minimal io_uring instance driven through the raw system calls, so the
+ * build needs only the kernel UAPI header and no liburing. One thread at a
+ * time may use a ring; callers provide the locking.
+ */
+typedef struct UringRing {
+    int fd;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned int sq_entries;
+    unsigned int pending; /* SQEs queued but not yet handed to the kernel */
+    void *sq_map;
+    size_t sq_map_len;
+    void *cq_map;
+    size_t cq_map_len;
+    size_t sqes_len;
+} UringRing;
+
+/* Returns -1 with errno set when io_uring is unavailable. */
+int uring_init(UringRing *r, unsigned int entries);
+void uring_close(UringRing *r);
+int uring_register_buffers(UringRing *r, const struct iovec *iov,
+                           unsigned int n);
+int uring_register_files(UringRing *r, const int *fds, unsigned int n);
+/*
+ * Whether the kernel implements every opcode in ops. Kernels before 5.6
+ * have no probe, and lack IORING_OP_WRITE and IORING_OP_SEND as well, so a
+ * failed probe counts as no.
+ */
+int uring_supports(UringRing *r, const unsigned char *ops, size_t n);
+/* Next free SQE, zeroed, or NULL when the submission queue is full. */
+struct io_uring_sqe *uring_get_sqe(UringRing *r);
+/*
+ * Hands every queued SQE to the kernel in one io_uring_enter and optionally
+ * waits for wait_nr completions. Returns SQEs submitted or -1.
+ */
+int uring_submit(UringRing *r, unsigned int wait_nr);
+/* Oldest unseen completion, or NULL; no system call. */
+struct io_uring_cqe *uring_peek_cqe(UringRing *r);
+void uring_cqe_seen(UringRing *r);
+
+#endif // URING_RING_H
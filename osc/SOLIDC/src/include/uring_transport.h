@@ -0,0 +1,31 @@
+#ifndef URING_TRANSPORT_H
+#define URING_TRANSPORT_H
+
+#include "interfaces.h"
+#include <stddef.h>
+
+typedef struct UringTransportOptions {
+    const char *disk_path; /* NULL = LOG_FILE */
+    const char *host;      /* NULL = LOG_HOST */
+    unsigned short port;   /* 0 = LOG_PORT */
+    unsigned int queue_depth; /* 0 = URING_QUEUE_DEPTH */
+} UringTransportOptions;
+
+typedef struct UringTransportStats {
+    unsigned long long enters;      /* io_uring_enter calls */
+    unsigned long long sqes;        /* writes/sends submitted */
+    unsigned long long completions;
+    unsigned long long failures;    /* completions with an error */
+    int using_fallback;             /* io_uring unavailable or given up */
+} UringTransportStats;
+
+/*
+ * Applies to all three io_uring transports. The fallbacks (DISK_, TCP_ and
+ * UDP_TRANSPORT) keep their own settings; configure them to match. Must be
+ * called while the transports are disconnected.
+ */
+int uring_transport_configure(const UringTransportOptions *opts);
+/* tr is one of URING_DISK_TRANSPORT, URING_TCP_TRANSPORT, URING_UDP_... */
+int uring_transport_stats(const Transport *tr, UringTransportStats *out);
+
+#endif // URING_TRANSPORT_H
@@ -0,0 +1,33 @@
+#ifndef USER_TABLE_H
+#define USER_TABLE_H
+
+#include "dto.h"
+
+/*
+ * Interns user strings for TransactionBatch: each distinct name is stored
+ * once with its JSON form precomputed, so batch formatters copy cached
+ * bytes instead of measuring and escaping the name on every record. Ids
+ * are dense and stable until user_table_clear.
+ *
+ * Lookup is an open-addressing index over the entries, kept at most half
+ * full. Not thread-safe: intern from one thread, and finish before
+ * batches that point into the table are handed to other threads.
+ */
+typedef struct UserTable {
+    InternedUser *users;
+    size_t count;
+    size_t cap;
+    unsigned int *index; /* id + 1, 0 = free */
+    size_t index_cap;    /* power of two */
+} UserTable;
+
+int user_table_init(UserTable *t);
+void user_table_destroy(UserTable *t);
+/* Drops every user; ids handed out before are no longer valid. */
+void user_table_clear(UserTable *t);
+/* The id of user, interning it on first sight; -1 when out of memory. */
+long user_table_intern(UserTable *t, const char *user);
+/* Points b->users at the table; call again after interning more users. */
+void user_table_bind(const UserTable *t, TransactionBatch *b);
+
+#endif // USER_TABLE_H
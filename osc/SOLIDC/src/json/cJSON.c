@@ -57,6 +57,7 @@
 #endif
 
 #include "cJSON.h"
+#include "numfmt.h"
 
 /* define our own boolean type */
 #ifdef true
@@ -596,7 +597,6 @@ static cJSON_bool print_number(const cJSON * const item, printbuffer * const out
     size_t i = 0;
     unsigned char number_buffer[26] = {0}; /* temporary buffer to print the number into */
     unsigned char decimal_point = get_decimal_point();
-    double test = 0.0;
 
     if (output_buffer == NULL)
     {
@@ -610,19 +610,12 @@ static cJSON_bool print_number(const cJSON * const item, printbuffer * const out
     }
     else if(d == (double)item->valueint)
     {
-        length = sprintf((char*)number_buffer, "%d", item->valueint);
+        length = (int)numfmt_i32((char*)number_buffer, item->valueint);
     }
     else
     {
-        /* Try 15 decimal places of precision to avoid nonsignificant nonzero digits */
-        length = sprintf((char*)number_buffer, "%1.15g", d);
-
-        /* Check whether the original double can be recovered */
-        if ((sscanf((char*)number_buffer, "%lg", &test) != 1) || !compare_double((double)test, d))
-        {
-            /* If not, print with 17 decimal places of precision */
-            length = sprintf((char*)number_buffer, "%1.17g", d);
-        }
+        /* %1.15g, or %1.17g when 15 digits do not round-trip */
+        length = numfmt_g15((char*)number_buffer, sizeof(number_buffer) - 1, d);
     }
 
     /* sprintf failed or buffer overrun occurred */
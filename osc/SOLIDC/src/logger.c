@@ -1,9 +1,83 @@
 #include "include/logger.h"
+#include "include/iovec_util.h"
+#include "include/record_arena.h"
 #include <errno.h>
+#include <limits.h>
+
+size_t log_record_space(const Formatter *f, const Transaction *t) {
+    return f->max_len ? f->max_len(t) + 1 : MAX_BUFFER_SIZE;
+}
+
+const char *log_format_oversized(const Formatter *f, const Transaction *t,
+                                 size_t slot, size_t *len) {
+    size_t space;
+    char *buf;
+    int n;
+
+    if (!f->max_len) {
+        return NULL;
+    }
+    space = f->max_len(t) + 1;
+    if (space <= MAX_BUFFER_SIZE || space > (size_t)INT_MAX) {
+        return NULL; /* it would have fit: formatting itself failed */
+    }
+    buf = record_arena_get(slot, space);
+    if (!buf) {
+        return NULL;
+    }
+    n = f->format(t, buf, space);
+    if (n < 0 || (size_t)n >= space) {
+        return NULL;
+    }
+    *len = (size_t)n;
+    return buf;
+}
+
+/* Formats into the transport's buffer; -1 with *tried = 0 if it had none. */
+static int log_in_place(const Logger *lg, const Transaction *t, int *tried) {
+    const Reservable *rv = lg->reservable;
+    size_t space = log_record_space(lg->formatter, t);
+    long long t0;
+    char *p;
+    int n;
+    int rc;
+
+    *tried = 0;
+    if (space > (size_t)INT_MAX || !(p = rv->reserve(space))) {
+        return -1;
+    }
+    *tried = 1;
+    t0 = metrics_start(lg->metrics);
+    n = lg->formatter->format(t, p, space);
+    if (n < 0 || (size_t)n >= space) {
+        metrics_formatted(lg->metrics, t0, 0);
+        rv->commit(0);
+        return -1;
+    }
+    metrics_formatted(lg->metrics, t0, 1);
+    t0 = metrics_start(lg->metrics);
+    rc = rv->commit((size_t)n);
+    metrics_sent(lg->metrics, t0, rc, 1, (size_t)n);
+    return rc;
+}
+
+/* log_record, counted against the logger's metrics. */
+static int log_counted(const Logger *lg, const char *msg, size_t len,
+                       const DebugSink *debug_sink) {
+    long long t0 = metrics_start(lg->metrics);
+    int rc = log_record(lg->sender, msg, len, debug_sink);
+
+    metrics_sent(lg->metrics, t0, rc, 1, len);
+    return rc;
+}
 
 int log_transaction(const Logger *lg, const Transaction *t,
                     const DebugSink *debug_sink) {
     char buf[MAX_BUFFER_SIZE];
+    const char *msg = buf;
+    size_t len;
+    long long t0;
+    int tried;
     int n;
 
     if (!lg || !t || !lg->formatter || !lg->formatter->format || !lg->sender ||
@@ -13,15 +87,43 @@ int log_transaction(const Logger *lg, const Transaction *t,
         return -1;
     }
 
+    if (lg->reservable && lg->reservable->reserve && lg->reservable->commit) {
+        errno = 0;
+        if (log_in_place(lg, t, &tried) == 0) {
+            return 0;
+        }
+        if (tried) {
+            debug_log(debug_sink, DEBUG_LEVEL_ERROR, "logger",
+                      "formatting into the transport buffer failed");
+            return -1;
+        }
+    }
+
+    t0 = metrics_start(lg->metrics);
     n = lg->formatter->format(t, buf, MAX_BUFFER_SIZE);
-    if (n < 0 || n >= MAX_BUFFER_SIZE) {
+    if (n >= 0 && n < MAX_BUFFER_SIZE) {
+        len = (size_t)n;
+    } else if (!(msg = log_format_oversized(lg->formatter, t, 0, &len))) {
+        metrics_formatted(lg->metrics, t0, 0);
         debug_log(debug_sink, DEBUG_LEVEL_ERROR, "logger",
                   "formatter failed or produced invalid length");
         return -1;
     }
+    metrics_formatted(lg->metrics, t0, 1);
+
+    return log_counted(lg, msg, len, debug_sink);
+}
+
+int log_record(const Sender *sender, const char *msg, size_t len,
+               const DebugSink *debug_sink) {
+    if (!sender || !sender->send || (!msg && len > 0)) {
+        debug_log(debug_sink, DEBUG_LEVEL_ERROR, "logger",
+                  "invalid sender or record");
+        return -1;
+    }
 
     errno = 0;
-    if (lg->sender->send(buf, (size_t)n) < 0) {
+    if (sender->send(msg, len) < 0) {
         if (errno != 0) {
             debug_log_errno(debug_sink, "logger", "sender->send");
         } else {
@@ -33,3 +135,201 @@ int log_transaction(const Logger *lg, const Transaction *t,
 
     return 0;
 }
+
+static int submit_batch(const Logger *lg, const struct iovec *iov, size_t n,
+                        const DebugSink *debug_sink) {
+    long long t0;
+    size_t i;
+    int rc = 0;
+
+    if (n == 0) {
+        return 0;
+    }
+
+    t0 = metrics_start(lg->metrics);
+    errno = 0;
+    if (lg->batch_sender && lg->batch_sender->send_batch) {
+        rc = lg->batch_sender->send_batch(iov, n);
+    } else {
+        for (i = 0; i < n; i++) {
+            if (lg->sender->send(iov[i].iov_base, iov[i].iov_len) < 0) {
+                rc = -1;
+            }
+        }
+    }
+
+    metrics_sent(lg->metrics, t0, rc, n, iov_total(iov, n));
+    if (rc < 0) {
+        if (errno != 0) {
+            debug_log_errno(debug_sink, "logger", "batch send");
+        } else {
+            debug_log(debug_sink, DEBUG_LEVEL_ERROR, "logger",
+                      "batch send failed");
+        }
+    }
+    return rc;
+}
+
+int log_transaction_batch(const Logger *lg, const Transaction *ts, size_t n,
+                          const DebugSink *debug_sink) {
+    char buf[LOG_BATCH_BUFFER_SIZE];
+    struct iovec iov[LOG_BATCH_MAX_RECORDS];
+    size_t used = 0;
+    size_t cnt = 0;
+    size_t i;
+    int rc = 0;
+
+    if (!lg || (!ts && n > 0) || !lg->formatter || !lg->formatter->format ||
+        !lg->sender || !lg->sender->send) {
+        debug_log(debug_sink, DEBUG_LEVEL_ERROR, "logger",
+                  "invalid logger dependencies");
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        long long t0;
+        int len;
+
+        if (cnt == LOG_BATCH_MAX_RECORDS ||
+            sizeof(buf) - used < MAX_BUFFER_SIZE) {
+            if (submit_batch(lg, iov, cnt, debug_sink) < 0) {
+                rc = -1;
+            }
+            used = 0;
+            cnt = 0;
+        }
+
+        t0 = metrics_start(lg->metrics);
+        len = lg->formatter->format(&ts[i], buf + used, MAX_BUFFER_SIZE);
+        if (len < 0 || len >= MAX_BUFFER_SIZE) {
+            const char *big;
+            size_t big_len;
+
+            /* Oversized records go out on their own, after the batch so far. */
+            big = log_format_oversized(lg->formatter, &ts[i], 0, &big_len);
+            metrics_formatted(lg->metrics, t0, big != NULL);
+            if (!big) {
+                debug_log(debug_sink, DEBUG_LEVEL_ERROR, "logger",
+                          "formatter failed or produced invalid length");
+                rc = -1;
+                continue;
+            }
+            if (submit_batch(lg, iov, cnt, debug_sink) < 0 ||
+                log_counted(lg, big, big_len, debug_sink) < 0) {
+                rc = -1;
+            }
+            used = 0;
+            cnt = 0;
+            continue;
+        }
+        metrics_formatted(lg->metrics, t0, 1);
+        iov[cnt].iov_base = buf + used;
+        iov[cnt].iov_len = (size_t)len;
+        used += (size_t)len;
+        cnt++;
+    }
+
+    if (submit_batch(lg, iov, cnt, debug_sink) < 0) {
+        rc = -1;
+    }
+    return rc;
+}
+
+int transaction_batch_valid(const TransactionBatch *b) {
+    size_t i;
+
+    if (!b) {
+        return 0;
+    }
+    if (b->count == 0) {
+        return 1;
+    }
+    if (!b->tids || !b->amounts || !b->user_ids || !b->users) {
+        return 0;
+    }
+    for (i = 0; i < b->count; i++) {
+        if (b->user_ids[i] >= b->user_count) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int log_batch_unbatched(const Logger *lg, const TransactionBatch *b,
+                               const DebugSink *debug_sink) {
+    Transaction ts[LOG_BATCH_MAX_RECORDS];
+    size_t i = 0;
+    int rc = 0;
+
+    while (i < b->count) {
+        size_t n = b->count - i;
+        size_t k;
+
+        n = n < LOG_BATCH_MAX_RECORDS ? n : LOG_BATCH_MAX_RECORDS;
+        for (k = 0; k < n; k++) {
+            ts[k] = transaction_batch_at(b, i + k);
+        }
+        if (log_transaction_batch(lg, ts, n, debug_sink) < 0) {
+            rc = -1;
+        }
+        i += n;
+    }
+    return rc;
+}
+
+int log_batch(const Logger *lg, const TransactionBatch *b,
+              const DebugSink *debug_sink) {
+    char buf[LOG_BATCH_BUFFER_SIZE];
+    struct iovec iov[LOG_BATCH_MAX_RECORDS];
+    size_t lens[LOG_BATCH_MAX_RECORDS];
+    size_t i = 0;
+    int rc = 0;
+
+    if (!lg || !lg->formatter || !lg->formatter->format || !lg->sender ||
+        !lg->sender->send || !transaction_batch_valid(b)) {
+        debug_log(debug_sink, DEBUG_LEVEL_ERROR, "logger",
+                  "invalid logger dependencies or batch");
+        return -1;
+    }
+    if (!lg->formatter->format_batch) {
+        return log_batch_unbatched(lg, b, debug_sink);
+    }
+
+    while (i < b->count) {
+        long long t0 = metrics_start(lg->metrics);
+        char *p = buf;
+        int n;
+        int k;
+
+        n = lg->formatter->format_batch(b, i, LOG_BATCH_MAX_RECORDS, buf,
+                                        sizeof(buf), lens);
+        if (n < 0) {
+            metrics_formatted(lg->metrics, t0, 0);
+            debug_log(debug_sink, DEBUG_LEVEL_ERROR, "logger",
+                      "batch formatter failed");
+            return -1;
+        }
+        if (n == 0) {
+            Transaction t = transaction_batch_at(b, i);
+
+            if (log_transaction(lg, &t, debug_sink) < 0) {
+                rc = -1;
+            }
+            i++;
+            continue;
+        }
+        metrics_observe(lg->metrics, METRIC_FORMAT_NS, t0);
+        metrics_add(lg->metrics, METRIC_RECORDS, (unsigned long long)n);
+
+        for (k = 0; k < n; k++) {
+            iov[k].iov_base = p;
+            iov[k].iov_len = lens[k];
+            p += lens[k];
+        }
+        if (submit_batch(lg, iov, (size_t)n, debug_sink) < 0) {
+            rc = -1;
+        }
+        i += (size_t)n;
+    }
+    return rc;
+}
@@ -0,0 +1,215 @@
+#include "lz4min.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LZ4MIN_MAGIC 0x184D2204u
+#define LZ4MIN_MIN_MATCH 4
+#define LZ4MIN_LAST_LITERALS 5
+#define LZ4MIN_MF_LIMIT 12
+#define LZ4MIN_HASH_LOG 12
+#define LZ4MIN_MAX_OFFSET 65535
+/* FLG: version 01, independent blocks. BD: 64 KiB maximum block size. */
+#define LZ4MIN_FLG 0x60
+#define LZ4MIN_BD 0x40
+#define LZ4MIN_UNCOMPRESSED_BIT 0x80000000u
+
+static uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void put_le32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ4MIN_HASH_LOG);
+}
+
+/* 255-run length continuation used for both literal and match lengths. */
+static unsigned char *put_length(unsigned char *op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+static unsigned char *put_sequence(unsigned char *op, const unsigned char *lit,
+                                   size_t lit_len, size_t offset,
+                                   size_t match_len) {
+    unsigned char *token = op++;
+    size_t ml = match_len - LZ4MIN_MIN_MATCH;
+
+    *token = (unsigned char)((lit_len >= 15 ? 15 : lit_len) << 4);
+    if (lit_len >= 15) {
+        op = put_length(op, lit_len - 15);
+    }
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (match_len == 0) {
+        return op; /* final literals-only sequence */
+    }
+
+    *op++ = (unsigned char)offset;
+    *op++ = (unsigned char)(offset >> 8);
+    *token |= (unsigned char)(ml >= 15 ? 15 : ml);
+    if (ml >= 15) {
+        op = put_length(op, ml - 15);
+    }
+    return op;
+}
+
+size_t lz4min_compress_block(const unsigned char *src, size_t n,
+                             unsigned char *dst) {
+    uint32_t table[1 << LZ4MIN_HASH_LOG];
+    unsigned char *op = dst;
+    size_t anchor = 0;
+    size_t ip = 0;
+
+    /* The format wants the last match to start 12 bytes before the end. */
+    if (n > LZ4MIN_MF_LIMIT) {
+        size_t match_limit = n - LZ4MIN_LAST_LITERALS;
+        size_t start_limit = n - LZ4MIN_MF_LIMIT;
+
+        memset(table, 0xff, sizeof(table));
+        while (ip < start_limit) {
+            uint32_t seq = read32(src + ip);
+            uint32_t h = hash4(seq);
+            uint32_t ref = table[h];
+            size_t len;
+
+            table[h] = (uint32_t)ip;
+            if (ref == UINT32_MAX || ip - ref > LZ4MIN_MAX_OFFSET ||
+                read32(src + ref) != seq) {
+                ip++;
+                continue;
+            }
+
+            len = LZ4MIN_MIN_MATCH;
+            while (ip + len < match_limit && src[ref + len] == src[ip + len]) {
+                len++;
+            }
+            op = put_sequence(op, src + anchor, ip - anchor, ip - ref, len);
+            ip += len;
+            anchor = ip;
+        }
+    }
+
+    return (size_t)(put_sequence(op, src + anchor, n - anchor, 0, 0) - dst);
+}
+
+/* xxHash32 of a short input; only used for the frame header checksum. */
+static uint32_t xxh32_small(const unsigned char *p, size_t len) {
+    const uint32_t prime1 = 2654435761u;
+    const uint32_t prime2 = 2246822519u;
+    const uint32_t prime3 = 3266489917u;
+    const uint32_t prime5 = 374761393u;
+    uint32_t h = prime5 + (uint32_t)len;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h += p[i] * prime5;
+        h = ((h << 11) | (h >> 21)) * prime1;
+    }
+    h ^= h >> 15;
+    h *= prime2;
+    h ^= h >> 13;
+    h *= prime3;
+    h ^= h >> 16;
+    return h;
+}
+
+static int write_all(int fd, const unsigned char *p, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(fd, p, len);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += w;
+        len -= (size_t)w;
+    }
+    return 0;
+}
+
+/* Fills buf with up to cap bytes; returns bytes read, or -1. */
+static ssize_t read_full(int fd, unsigned char *buf, size_t cap) {
+    size_t got = 0;
+
+    while (got < cap) {
+        ssize_t r = read(fd, buf + got, cap - got);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (r == 0) {
+            break;
+        }
+        got += (size_t)r;
+    }
+    return (ssize_t)got;
+}
+
+int lz4min_compress_fd(int in_fd, int out_fd) {
+    unsigned char header[7];
+    unsigned char *in = malloc(LZ4MIN_BLOCK_SIZE);
+    unsigned char *out = malloc(4 + LZ4MIN_BLOCK_BOUND(LZ4MIN_BLOCK_SIZE));
+    int rc = -1;
+
+    if (!in || !out) {
+        goto done;
+    }
+
+    put_le32(header, LZ4MIN_MAGIC);
+    header[4] = LZ4MIN_FLG;
+    header[5] = LZ4MIN_BD;
+    header[6] = (unsigned char)(xxh32_small(header + 4, 2) >> 8);
+    if (write_all(out_fd, header, sizeof(header)) < 0) {
+        goto done;
+    }
+
+    for (;;) {
+        ssize_t n = read_full(in_fd, in, LZ4MIN_BLOCK_SIZE);
+        size_t clen;
+
+        if (n < 0) {
+            goto done;
+        }
+        if (n == 0) {
+            break;
+        }
+        clen = lz4min_compress_block(in, (size_t)n, out + 4);
+        if (clen >= (size_t)n) {
+            /* Incompressible: store the block as is. */
+            put_le32(out, (uint32_t)n | LZ4MIN_UNCOMPRESSED_BIT);
+            memcpy(out + 4, in, (size_t)n);
+            clen = (size_t)n;
+        } else {
+            put_le32(out, (uint32_t)clen);
+        }
+        if (write_all(out_fd, out, 4 + clen) < 0) {
+            goto done;
+        }
+    }
+
+    put_le32(header, 0); /* end mark */
+    rc = write_all(out_fd, header, 4);
+
+done:
+    free(in);
+    free(out);
+    return rc;
+}
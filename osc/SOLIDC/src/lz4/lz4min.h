@@ -0,0 +1,28 @@
+#ifndef LZ4MIN_H
+#define LZ4MIN_H
+
+#include <stddef.h>
+
+/*
+ * Minimal LZ4 frame writer, enough to compress rotated logs without an
+ * external dependency. Output is a standard LZ4 frame (readable by `lz4 -d`
+ * and liblz4) made of independent 64 KiB blocks, without content or block
+ * checksums. Compression is the plain greedy LZ4 block algorithm.
+ */
+
+#define LZ4MIN_BLOCK_SIZE (64 * 1024)
+
+/* Worst-case compressed size of an n-byte block. */
+#define LZ4MIN_BLOCK_BOUND(n) ((n) + (n) / 255 + 16)
+
+/*
+ * Compresses one block of at most LZ4MIN_BLOCK_SIZE bytes into dst, which
+ * must hold LZ4MIN_BLOCK_BOUND(n) bytes. Returns the compressed length.
+ */
+size_t lz4min_compress_block(const unsigned char *src, size_t n,
+                             unsigned char *dst);
+
+/* Reads in_fd to EOF and writes one LZ4 frame to out_fd; 0 or -1. */
+int lz4min_compress_fd(int in_fd, int out_fd);
+
+#endif // LZ4MIN_H
@@ -1,61 +1,286 @@
 #include "controller.h"
+#include "include/async_debug.h"
 #include "include/components.h"
+#include "include/pipelines.h"
+#include "include/replay.h"
+#include "include/runtime_config.h"
+#include <errno.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-int main() {
-    AppContext ctx = {
-        .local_logger =
-            {
-                .formatter = &TEXT_FORMATTER,
-                .sender = DISK_TRANSPORT.sender,
-            },
-        .network_logger =
-            {
-                .formatter = &JSON_FORMATTER,
-                .sender = TCP_TRANSPORT.sender,
-            },
-        .should_log_on_network = should_log_on_network,
-        .local_flushable = DISK_TRANSPORT.flushable,
-        .network_connectable = TCP_TRANSPORT.connectable,
-        .debug_sink = &STDERR_DEBUG_SINK,
-    };
+typedef struct MainOptions {
+    const char *config_path;
+    int use_async;
+    int binary_log;
+    int mmap_log;
+    int uring;
+    int static_pipeline;
+} MainOptions;
 
+typedef struct MainState {
+    RuntimeApp app;
+    const MainOptions *opts;
+} MainState;
+
+static volatile sig_atomic_t reload_requested;
+static volatile sig_atomic_t metrics_requested;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [--replay FILE|-] [--binary] [--config FILE]\n"
+            "          [--async] [--binary-log] [--mmap-log] [--uring]\n"
+            "          [--static-pipeline]\n"
+            "  without --replay, transactions are read interactively\n"
+            "  --config loads sinks and transport options from a JSON file\n"
+            "    and reloads it on SIGHUP; the flags below only adjust the\n"
+            "    built-in setup and cannot be combined with it\n"
+            "  --async gives every sink its own writer thread\n"
+            "  --binary-log writes the disk log with BINARY_FORMATTER\n"
+            "  --mmap-log writes the disk log as mmap'ed LOG_FILE.NNNNNN "
+            "segments\n"
+            "  --uring submits disk and TCP writes through io_uring\n"
+            "  --static-pipeline logs through the compiled-in text-to-disk\n"
+            "    and JSON-to-TCP pipeline; cannot be combined with the\n"
+            "    other sink options\n"
+            "  SIGUSR1 prints per-sink metrics to stderr (build with "
+            "METRICS=1)\n",
+            prog);
+}
+
+static void on_sighup(int sig) {
+    (void)sig;
+    reload_requested = 1;
+}
+
+static void on_sigusr1(int sig) {
+    (void)sig;
+    metrics_requested = 1;
+}
+
+static void install_handler(int sig, void (*handler)(int), int flags) {
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handler;
+    sa.sa_flags = flags;
+    sigemptyset(&sa.sa_mask);
+    sigaction(sig, &sa, NULL);
+}
+
+static RuntimeConfig *load_config(const MainOptions *opts,
+                                  const DebugSink *debug_sink) {
+    RuntimeConfig *cfg = malloc(sizeof(*cfg));
+    char err[256];
+    size_t k;
+
+    if (!cfg) {
+        debug_log(debug_sink, DEBUG_LEVEL_ERROR, "main", "out of memory");
+        return NULL;
+    }
+    if (opts->config_path) {
+        if (runtime_config_load(opts->config_path, cfg, err, sizeof(err)) <
+            0) {
+            debug_log(debug_sink, DEBUG_LEVEL_ERROR, "config", err);
+            free(cfg);
+            return NULL;
+        }
+        return cfg;
+    }
+
+    runtime_config_defaults(cfg);
+    if (opts->binary_log) {
+        cfg->sinks[0].formatter = &BINARY_FORMATTER;
+    }
+    if (opts->mmap_log) {
+        cfg->sinks[0].transport = &MMAP_TRANSPORT;
+    }
+    if (opts->uring) {
+        cfg->sinks[0].transport = &URING_DISK_TRANSPORT;
+        cfg->sinks[1].transport = &URING_TCP_TRANSPORT;
+    }
+    /* One writer per sink so a stalled collector never holds up the disk. */
+    for (k = 0; opts->use_async && k < cfg->sink_count; k++) {
+        cfg->sinks[k].async = 1;
+    }
+    return cfg;
+}
+
+/*
+ * Runs between records: prints metrics after SIGUSR1 and swaps in a freshly
+ * loaded config after SIGHUP.
+ */
+static void poll_signals(void *arg) {
+    MainState *st = arg;
+    RuntimeConfig *cfg;
+
+    if (metrics_requested) {
+        metrics_requested = 0;
+        app_context_print_metrics(&st->app.ctx, stderr);
+    }
+    if (!reload_requested) {
+        return;
+    }
+    reload_requested = 0;
+
+    cfg = load_config(st->opts, st->app.ctx.debug_sink);
+    if (!cfg) {
+        debug_log(st->app.ctx.debug_sink, DEBUG_LEVEL_WARN, "main",
+                  "reload failed; keeping the running configuration");
+        return;
+    }
+    if (runtime_app_reload(&st->app, cfg) < 0) {
+        debug_log(st->app.ctx.debug_sink, DEBUG_LEVEL_WARN, "main",
+                  "reloaded context start failed; continuing");
+    }
+}
+
+/*
+ * scanf for one field. SIGUSR1 interrupts a wait for input (it is installed
+ * without SA_RESTART), so the metrics dump is not held until the next line.
+ */
+static int read_field(MainState *st, const char *fmt, void *out) {
+    for (;;) {
+        int r;
+
+        errno = 0;
+        r = scanf(fmt, out);
+        if (r == 1) {
+            return 0;
+        }
+        if (r != EOF || !ferror(stdin) || errno != EINTR) {
+            return -1;
+        }
+        clearerr(stdin);
+        poll_signals(st);
+    }
+}
+
+static int run_interactive(MainState *st) {
+    const AppContext *ctx = &st->app.ctx;
     int stop = 0;
     unsigned int tid = 0;
     char user[20];
     double amount = 0.0;
 
-    if (app_context_start(&ctx) < 0) {
-        debug_log(ctx.debug_sink, DEBUG_LEVEL_WARN, "main",
-                  "application context start failed; continuing");
-    }
-
     while (!stop) {
         printf("Enter transaction (tid user amount): ");
-        if (scanf("%u %19s %lf", &tid, user, &amount) != 3) {
+        if (read_field(st, "%u", &tid) < 0 ||
+            read_field(st, "%19s", user) < 0 ||
+            read_field(st, "%lf", &amount) < 0) {
             fprintf(stderr, "invalid input\n");
-            return EXIT_FAILURE;
+            return -1;
         }
 
         Transaction t = {tid, user, amount};
-        if (process_transaction_with_ctx(&ctx, &t) < 0) {
-            debug_log(ctx.debug_sink, DEBUG_LEVEL_ERROR, "main",
+        if (process_transaction_with_ctx(ctx, &t) < 0) {
+            debug_log(ctx->debug_sink, DEBUG_LEVEL_ERROR, "main",
                       "failed to process transaction");
         }
 
+        poll_signals(st);
+
         printf("Stop? (0/1): ");
-        if (scanf("%d", &stop) != 1) {
+        if (read_field(st, "%d", &stop) < 0) {
             fprintf(stderr, "invalid stop value\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int run_replay(MainState *st, const char *path, ReplayFormat format) {
+    ReplayStats stats;
+    int rc = replay_run(&st->app.ctx, path, format, poll_signals, st, &stats);
+
+    replay_print_stats(&stats);
+    return rc;
+}
+
+int main(int argc, char **argv) {
+    static MainState st;
+    MainOptions opts = {0};
+    RuntimeConfig *cfg;
+    const char *replay_path = NULL;
+    ReplayFormat replay_format = REPLAY_FORMAT_TEXT;
+    int rc;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--binary") == 0) {
+            replay_format = REPLAY_FORMAT_BINARY;
+        } else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            opts.config_path = argv[++i];
+        } else if (strcmp(argv[i], "--async") == 0) {
+            opts.use_async = 1;
+        } else if (strcmp(argv[i], "--binary-log") == 0) {
+            opts.binary_log = 1;
+        } else if (strcmp(argv[i], "--mmap-log") == 0) {
+            opts.mmap_log = 1;
+        } else if (strcmp(argv[i], "--uring") == 0) {
+            opts.uring = 1;
+        } else if (strcmp(argv[i], "--static-pipeline") == 0) {
+            opts.static_pipeline = 1;
+        } else {
+            usage(argv[0]);
             return EXIT_FAILURE;
         }
     }
+    if (opts.config_path && (opts.use_async || opts.binary_log ||
+                             opts.mmap_log || opts.uring)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (opts.static_pipeline &&
+        (opts.config_path || opts.use_async || opts.binary_log ||
+         opts.mmap_log || opts.uring)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    st.opts = &opts;
 
-    if (app_context_stop(&ctx) < 0) {
-        debug_log(ctx.debug_sink, DEBUG_LEVEL_ERROR, "main",
-                  "failed to finalize application context");
+    /*
+     * With the collector down every transaction reports a failure; fold the
+     * repeats on a background thread instead of writing each one inline.
+     */
+    if (async_debug_start(NULL) < 0) {
+        fprintf(stderr, "failed to start the debug log writer\n");
+    }
+
+    cfg = load_config(&opts, &ASYNC_DEBUG_SINK);
+    if (!cfg) {
+        async_debug_stop();
         return EXIT_FAILURE;
     }
+    if (opts.config_path) {
+        install_handler(SIGHUP, on_sighup, SA_RESTART);
+    }
+    install_handler(SIGUSR1, on_sigusr1, 0);
+
+    if (runtime_app_start(&st.app, cfg, &ASYNC_DEBUG_SINK) < 0) {
+        debug_log(st.app.ctx.debug_sink, DEBUG_LEVEL_WARN, "main",
+                  "application context start failed; continuing");
+    }
+    if (opts.static_pipeline) {
+        /* The default sinks are this wiring; they still connect and flush. */
+        st.app.ctx.pipeline = production_pipeline;
+    }
+
+    if (replay_path) {
+        rc = run_replay(&st, replay_path, replay_format);
+    } else {
+        rc = run_interactive(&st);
+    }
+
+    if (runtime_app_stop(&st.app) < 0) {
+        debug_log(st.app.ctx.debug_sink, DEBUG_LEVEL_ERROR, "main",
+                  "failed to finalize application context");
+        rc = -1;
+    }
+    async_debug_stop();
 
-    return EXIT_SUCCESS;
+    return rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -0,0 +1,128 @@
+#include "include/metrics.h"
+#include <string.h>
+
+#if LOG_METRICS_ENABLED
+/* 1-based shard of this thread; 0 until its first update. */
+_Thread_local size_t metrics_thread_shard;
+static _Atomic size_t next_shard;
+
+size_t metrics_assign_shard(void) {
+    metrics_thread_shard =
+        atomic_fetch_add_explicit(&next_shard, 1, memory_order_relaxed) %
+            METRICS_SHARDS +
+        1;
+    return metrics_thread_shard;
+}
+#endif
+
+void metrics_reset(SinkMetrics *m) {
+    size_t i;
+    size_t c;
+    size_t h;
+    size_t b;
+
+    if (!m) {
+        return;
+    }
+    for (i = 0; i < METRICS_SHARDS; i++) {
+        MetricsShard *s = &m->shards[i];
+
+        for (c = 0; c < METRIC_COUNTERS; c++) {
+            atomic_store_explicit(&s->counters[c], 0, memory_order_relaxed);
+        }
+        for (h = 0; h < METRIC_HISTOGRAMS; h++) {
+            for (b = 0; b < METRICS_HIST_BUCKETS; b++) {
+                atomic_store_explicit(&s->hist[h][b], 0, memory_order_relaxed);
+            }
+        }
+    }
+}
+
+void metrics_read(const SinkMetrics *m, MetricsSnapshot *out) {
+    size_t i;
+    size_t c;
+    size_t h;
+    size_t b;
+
+    if (!out) {
+        return;
+    }
+    memset(out, 0, sizeof(*out));
+    if (!m) {
+        return;
+    }
+    for (i = 0; i < METRICS_SHARDS; i++) {
+        const MetricsShard *s = &m->shards[i];
+
+        for (c = 0; c < METRIC_COUNTERS; c++) {
+            out->counters[c] +=
+                atomic_load_explicit(&s->counters[c], memory_order_relaxed);
+        }
+        for (h = 0; h < METRIC_HISTOGRAMS; h++) {
+            for (b = 0; b < METRICS_HIST_BUCKETS; b++) {
+                out->hist[h][b] +=
+                    atomic_load_explicit(&s->hist[h][b], memory_order_relaxed);
+            }
+        }
+    }
+}
+
+unsigned long long metrics_quantile_ns(const MetricsSnapshot *s,
+                                       MetricHistogram h, double q) {
+    unsigned long long total = 0;
+    unsigned long long seen = 0;
+    unsigned long long rank;
+    size_t b;
+
+    for (b = 0; b < METRICS_HIST_BUCKETS; b++) {
+        total += s->hist[h][b];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    rank = (unsigned long long)(q * (double)total);
+    if (rank >= total) {
+        rank = total - 1;
+    }
+    for (b = 0; b < METRICS_HIST_BUCKETS; b++) {
+        seen += s->hist[h][b];
+        if (seen > rank) {
+            break;
+        }
+    }
+    return b >= METRICS_HIST_BUCKETS - 1 ? ~0ULL : 1ULL << b;
+}
+
+static void print_histogram(FILE *out, const char *label,
+                            const MetricsSnapshot *s, MetricHistogram h) {
+    unsigned long long n = 0;
+    size_t b;
+
+    for (b = 0; b < METRICS_HIST_BUCKETS; b++) {
+        n += s->hist[h][b];
+    }
+    if (n == 0) {
+        fprintf(out, "  %-9s n=0\n", label);
+        return;
+    }
+    fprintf(out, "  %-9s n=%llu p50<%llu p90<%llu p99<%llu p999<%llu\n",
+            label, n, metrics_quantile_ns(s, h, 0.5),
+            metrics_quantile_ns(s, h, 0.9), metrics_quantile_ns(s, h, 0.99),
+            metrics_quantile_ns(s, h, 0.999));
+}
+
+void metrics_print(FILE *out, const char *name, const MetricsSnapshot *s) {
+    if (!out || !s) {
+        return;
+    }
+    fprintf(out,
+            "sink %s: records=%llu format_failures=%llu bytes=%llu "
+            "send_failures=%llu reconnects=%llu queue_depth=%llu "
+            "dropped=%llu\n",
+            name ? name : "?", s->counters[METRIC_RECORDS],
+            s->counters[METRIC_FORMAT_FAILURES], s->counters[METRIC_BYTES],
+            s->counters[METRIC_SEND_FAILURES], s->reconnects, s->queue_depth,
+            s->dropped);
+    print_histogram(out, "format_ns", s, METRIC_FORMAT_NS);
+    print_histogram(out, "send_ns", s, METRIC_SEND_NS);
+}
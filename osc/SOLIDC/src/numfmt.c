@@ -0,0 +1,285 @@
+#include "include/numfmt.h"
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUMFMT_SLOW_BUF 512
+
+static const char digit_pairs[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const double pow10_dbl[19] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,
+    1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+};
+
+static const uint64_t pow10_u64[19] = {
+    1ULL,
+    10ULL,
+    100ULL,
+    1000ULL,
+    10000ULL,
+    100000ULL,
+    1000000ULL,
+    10000000ULL,
+    100000000ULL,
+    1000000000ULL,
+    10000000000ULL,
+    100000000000ULL,
+    1000000000000ULL,
+    10000000000000ULL,
+    100000000000000ULL,
+    1000000000000000ULL,
+    10000000000000000ULL,
+    100000000000000000ULL,
+    1000000000000000000ULL,
+};
+
+/* Two digits per division, written right to left. */
+static size_t fmt_u64(char *out, uint64_t v) {
+    char tmp[20];
+    char *p = tmp + sizeof(tmp);
+    size_t n;
+
+    while (v >= 100) {
+        unsigned int i = (unsigned int)(v % 100) * 2;
+        v /= 100;
+        p -= 2;
+        memcpy(p, digit_pairs + i, 2);
+    }
+    if (v >= 10) {
+        p -= 2;
+        memcpy(p, digit_pairs + v * 2, 2);
+    } else {
+        *--p = (char)('0' + v);
+    }
+
+    n = (size_t)(tmp + sizeof(tmp) - p);
+    memcpy(out, p, n);
+    return n;
+}
+
+/* Writes v as exactly width digits, zero-padded on the left. */
+static void fmt_u64_padded(char *out, uint64_t v, size_t width) {
+    while (width >= 2) {
+        width -= 2;
+        memcpy(out + width, digit_pairs + (v % 100) * 2, 2);
+        v /= 100;
+    }
+    if (width == 1) {
+        out[0] = (char)('0' + v % 10);
+    }
+}
+
+static int copy_out(char *buf, size_t sz, const char *src, int n) {
+    if (n < 0 || (size_t)n > sz) {
+        return -1;
+    }
+    memcpy(buf, src, (size_t)n);
+    return n;
+}
+
+size_t numfmt_u32(char *buf, uint32_t v) {
+    return fmt_u64(buf, v);
+}
+
+size_t numfmt_i32(char *buf, int32_t v) {
+    if (v < 0) {
+        buf[0] = '-';
+        return 1 + fmt_u64(buf + 1, (uint64_t)(-(int64_t)v));
+    }
+    return fmt_u64(buf, (uint64_t)v);
+}
+
+int numfmt_fixed2(char *buf, size_t sz, double v) {
+    char tmp[24];
+    char *p = tmp;
+    uint64_t bits;
+    uint64_t mant;
+    uint64_t whole;
+    uint64_t cents = 0;
+    int biased;
+    int exp2;
+
+    memcpy(&bits, &v, sizeof(bits));
+    biased = (int)((bits >> 52) & 0x7ff);
+    mant = bits & ((1ULL << 52) - 1);
+    if (biased == 0x7ff) {
+        goto slow;
+    }
+    if (biased == 0) {
+        exp2 = -1074;
+    } else {
+        mant |= 1ULL << 52;
+        exp2 = biased - 1075;
+    }
+
+    /*
+     * v == mant * 2^exp2 exactly, so rounding mant * 100 / 2^-exp2 to
+     * nearest-even reproduces printf's correctly rounded "%.2f".
+     */
+    if (exp2 >= 0) {
+        if (exp2 > 10) {
+            goto slow;
+        }
+        whole = mant << exp2;
+    } else {
+        int shift = -exp2;
+
+        if (shift < 64) {
+            uint64_t scaled = mant * 100;
+            uint64_t rem = scaled & ((1ULL << shift) - 1);
+            uint64_t half = 1ULL << (shift - 1);
+
+            cents = scaled >> shift;
+            if (rem > half || (rem == half && (cents & 1))) {
+                cents++;
+            }
+        }
+        /* shift >= 64: mant * 100 < 2^60, so the value rounds to 0.00. */
+        whole = cents / 100;
+        cents %= 100;
+    }
+
+    if (bits >> 63) {
+        *p++ = '-';
+    }
+    p += fmt_u64(p, whole);
+    *p++ = '.';
+    memcpy(p, digit_pairs + cents * 2, 2);
+    p += 2;
+    return copy_out(buf, sz, tmp, (int)(p - tmp));
+
+slow: {
+    char slow_buf[NUMFMT_SLOW_BUF];
+    return copy_out(buf, sz, slow_buf,
+                    snprintf(slow_buf, sizeof(slow_buf), "%.2f", v));
+}
+}
+
+/*
+ * Shortest-digits search: the first scale 10^k whose nearest integer c maps
+ * back onto v is the shortest decimal that round-trips. c / 10^k is computed
+ * with exact operands, so it is the correctly rounded value strtod would
+ * return. A round-tripping decimal with at most 15 significant digits is
+ * necessarily what "%1.15g" prints, so the slow path only runs for values
+ * that need 16-17 digits or exponent notation.
+ */
+int numfmt_g15(char *buf, size_t sz, double v) {
+    char tmp[26];
+    double a = fabs(v);
+    int k;
+
+    if (a >= 1e-4 && a < 1e15) {
+        for (k = 0; k <= 18; k++) {
+            double scaled = a * pow10_dbl[k];
+            uint64_t c0;
+            uint64_t c;
+
+            if (scaled >= 1e15) {
+                break;
+            }
+            c0 = (uint64_t)(scaled + 0.5);
+            for (c = c0 ? c0 - 1 : 0; c <= c0 + 1; c++) {
+                char *p = tmp;
+                int digits = 1;
+
+                if (c == 0 || c >= 1000000000000000ULL ||
+                    (double)c / pow10_dbl[k] != a) {
+                    continue;
+                }
+
+                if (signbit(v)) {
+                    *p++ = '-';
+                }
+                if (k == 0) {
+                    p += fmt_u64(p, c);
+                    return copy_out(buf, sz, tmp, (int)(p - tmp));
+                }
+
+                while (digits < 19 && c >= pow10_u64[digits]) {
+                    digits++;
+                }
+                /* %g switches to exponent form below 1e-4. */
+                if (digits - 1 - k < -4) {
+                    goto slow;
+                }
+                p += fmt_u64(p, c / pow10_u64[k]);
+                *p++ = '.';
+                fmt_u64_padded(p, c % pow10_u64[k], (size_t)k);
+                p += k;
+                return copy_out(buf, sz, tmp, (int)(p - tmp));
+            }
+        }
+    }
+
+slow: {
+    char slow_buf[NUMFMT_SLOW_BUF];
+    double test;
+    double max_val;
+    int n = snprintf(slow_buf, sizeof(slow_buf), "%1.15g", v);
+
+    test = strtod(slow_buf, NULL);
+    max_val = fabs(test) > fabs(v) ? fabs(test) : fabs(v);
+    if (!(fabs(test - v) <= max_val * DBL_EPSILON)) {
+        n = snprintf(slow_buf, sizeof(slow_buf), "%1.17g", v);
+    }
+    return copy_out(buf, sz, slow_buf, n);
+}
+}
+
+int numfmt_json(char *buf, size_t sz, double v) {
+    char tmp[NUMFMT_I32_MAX_LEN];
+    int valueint;
+
+    if (isnan(v) || isinf(v)) {
+        return copy_out(buf, sz, "null", 4);
+    }
+
+    /* Same clamping as cJSON_SetNumberHelper. */
+    if (v >= INT_MAX) {
+        valueint = INT_MAX;
+    } else if (v <= (double)INT_MIN) {
+        valueint = INT_MIN;
+    } else {
+        valueint = (int)v;
+    }
+
+    if (v == (double)valueint) {
+        return copy_out(buf, sz, tmp, (int)numfmt_i32(tmp, valueint));
+    }
+    return numfmt_g15(buf, sz, v);
+}
+
+void numfmt_u32_column(const unsigned int *v, size_t n, NumfmtCell *out) {
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        out[i].len = (unsigned char)fmt_u64(out[i].s, v[i]);
+    }
+}
+
+void numfmt_fixed2_column(const double *v, size_t n, NumfmtCell *out) {
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        int len = numfmt_fixed2(out[i].s, sizeof(out[i].s), v[i]);
+        out[i].len = (unsigned char)(len < 0 ? 0 : len);
+    }
+}
+
+void numfmt_json_column(const double *v, size_t n, NumfmtCell *out) {
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        int len = numfmt_json(out[i].s, sizeof(out[i].s), v[i]);
+        out[i].len = (unsigned char)(len < 0 ? 0 : len);
+    }
+}
@@ -0,0 +1,18 @@
+#include "include/pipelines.h"
+#include "include/components.h"
+#include "include/controller.h"
+#include "include/pipeline.h"
+
+LOG_PIPELINE(disk_text_pipeline, TEXT_FORMATTER, DISK_SENDER, log_policy_all)
+LOG_PIPELINE(tcp_json_pipeline, JSON_FORMATTER, TCP_SENDER,
+             should_log_on_network)
+
+int production_pipeline(const Transaction *t, const DebugSink *debug_sink) {
+    /* Like the sinks it replaces: try both, fail if either did. */
+    int rc = disk_text_pipeline(t, debug_sink);
+
+    if (tcp_json_pipeline(t, debug_sink) < 0) {
+        rc = -1;
+    }
+    return rc;
+}
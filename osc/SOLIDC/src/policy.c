@@ -0,0 +1,323 @@
+#include "include/policy.h"
+#include "include/config.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#if (POLICY_TABLE_SIZE & (POLICY_TABLE_SIZE - 1)) != 0
+#error "POLICY_TABLE_SIZE must be a power of two"
+#endif
+
+#define POLICY_MASK (POLICY_TABLE_SIZE - 1)
+
+/* 16 bytes: four buckets to a cache line. key 0 marks a free slot. */
+typedef struct BucketEntry {
+    uint64_t key;
+    float tokens;
+    uint32_t stamp_ms; /* last refill; wraps after ~49 days */
+} BucketEntry;
+
+typedef struct AggregateEntry {
+    uint64_t key;
+    unsigned int count;
+    double sum;
+    char user[POLICY_USER_MAX];
+} AggregateEntry;
+
+static uint64_t sample_threshold;
+static int sample_all;
+static float bucket_per_ms;
+static float bucket_burst;
+static unsigned int aggregate_interval_ms = POLICY_AGGREGATE_INTERVAL_MS;
+
+static BucketEntry buckets[POLICY_TABLE_SIZE];
+static pthread_mutex_t bucket_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Producers fold into agg.active; the window thread swaps in the other
+ * table under the lock and sends the full one without holding it.
+ */
+static struct {
+    AggregateEntry tables[2][POLICY_TABLE_SIZE];
+    AggregateEntry *active;
+    const Formatter *formatter;
+    const Sender *sender;
+    const DebugSink *debug_sink;
+    int running;
+    int stop;
+    pthread_t thread;
+} agg;
+
+static pthread_mutex_t agg_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t agg_wake = PTHREAD_COND_INITIALIZER;
+
+/* splitmix64's finaliser: consecutive tids land far apart. */
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/* FNV-1a over the name, never 0 so 0 can mean a free slot. */
+static uint64_t user_key(const char *user, size_t *len) {
+    uint64_t h = 1469598103934665603ULL;
+    const char *p;
+
+    for (p = user; *p; p++) {
+        h = (h ^ (unsigned char)*p) * 1099511628211ULL;
+    }
+    *len = (size_t)(p - user);
+    return h ? h : 1;
+}
+
+static uint32_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000u +
+                      (uint64_t)ts.tv_nsec / 1000000u);
+}
+
+void policy_options_defaults(PolicyOptions *opts) {
+    opts->sample_rate = POLICY_SAMPLE_RATE;
+    opts->rate_per_second = POLICY_RATE_PER_SECOND;
+    opts->rate_burst = POLICY_RATE_BURST;
+    opts->aggregate_interval_ms = POLICY_AGGREGATE_INTERVAL_MS;
+}
+
+int policy_configure(const PolicyOptions *opts) {
+    if (!opts || !(opts->sample_rate >= 0.0) || !(opts->sample_rate <= 1.0) ||
+        !(opts->rate_per_second >= 0.0) || !(opts->rate_burst >= 1.0)) {
+        return -1;
+    }
+    sample_all = opts->sample_rate >= 1.0;
+    /* 2^64 * rate; rate < 1 keeps this below UINT64_MAX. */
+    sample_threshold = (uint64_t)(opts->sample_rate * 18446744073709551616.0);
+    bucket_per_ms = (float)(opts->rate_per_second / 1000.0);
+    bucket_burst = (float)opts->rate_burst;
+    aggregate_interval_ms = opts->aggregate_interval_ms
+                                ? opts->aggregate_interval_ms
+                                : POLICY_AGGREGATE_INTERVAL_MS;
+
+    pthread_mutex_lock(&bucket_lock);
+    memset(buckets, 0, sizeof(buckets));
+    pthread_mutex_unlock(&bucket_lock);
+    return 0;
+}
+
+int sample_by_tid(const Transaction *t) {
+    if (!t) {
+        return 0;
+    }
+    return sample_all || mix64(t->tid) < sample_threshold;
+}
+
+/* Caller holds bucket_lock. */
+static BucketEntry *bucket_for(uint64_t key, uint32_t now) {
+    BucketEntry *oldest = NULL;
+    size_t i;
+
+    for (i = 0; i < POLICY_MAX_PROBES; i++) {
+        BucketEntry *b = &buckets[(key + i) & POLICY_MASK];
+
+        if (b->key == key) {
+            return b;
+        }
+        if (b->key == 0 ||
+            !oldest || (uint32_t)(now - b->stamp_ms) >
+                           (uint32_t)(now - oldest->stamp_ms)) {
+            oldest = b;
+        }
+        if (b->key == 0) {
+            break;
+        }
+    }
+    oldest->key = key;
+    oldest->tokens = bucket_burst;
+    oldest->stamp_ms = now;
+    return oldest;
+}
+
+int rate_limit_by_user(const Transaction *t) {
+    uint32_t now;
+    BucketEntry *b;
+    size_t len;
+    uint64_t key;
+    int ok;
+
+    if (!t || !t->user) {
+        return 0;
+    }
+    key = user_key(t->user, &len);
+    now = monotonic_ms();
+
+    pthread_mutex_lock(&bucket_lock);
+    b = bucket_for(key, now);
+    b->tokens += (float)(uint32_t)(now - b->stamp_ms) * bucket_per_ms;
+    if (b->tokens > bucket_burst) {
+        b->tokens = bucket_burst;
+    }
+    b->stamp_ms = now;
+    ok = b->tokens >= 1.0f;
+    if (ok) {
+        b->tokens -= 1.0f;
+    }
+    pthread_mutex_unlock(&bucket_lock);
+    return ok;
+}
+
+int aggregate_by_user(const Transaction *t) {
+    AggregateEntry *e = NULL;
+    size_t len;
+    uint64_t key;
+    size_t i;
+
+    if (!t || !t->user) {
+        return 0;
+    }
+    key = user_key(t->user, &len);
+    if (len >= POLICY_USER_MAX) {
+        return 1;
+    }
+
+    pthread_mutex_lock(&agg_lock);
+    if (!agg.running) {
+        pthread_mutex_unlock(&agg_lock);
+        return 1;
+    }
+    for (i = 0; i < POLICY_MAX_PROBES; i++) {
+        AggregateEntry *slot = &agg.active[(key + i) & POLICY_MASK];
+
+        if (slot->key == 0) {
+            slot->key = key;
+            memcpy(slot->user, t->user, len + 1);
+            e = slot;
+            break;
+        }
+        if (slot->key == key && strcmp(slot->user, t->user) == 0) {
+            e = slot;
+            break;
+        }
+    }
+    if (e) {
+        e->count++;
+        e->sum += t->amount;
+    }
+    pthread_mutex_unlock(&agg_lock);
+    return e == NULL;
+}
+
+static void send_window(AggregateEntry *table, unsigned int window_ms) {
+    char buf[MAX_BUFFER_SIZE];
+    size_t i;
+
+    for (i = 0; i < POLICY_TABLE_SIZE; i++) {
+        AggregateEntry *e = &table[i];
+        AggregateRecord a;
+        int n;
+
+        if (e->key == 0) {
+            continue;
+        }
+        a.user = e->user;
+        a.count = e->count;
+        a.sum = e->sum;
+        a.window_ms = window_ms;
+        n = agg.formatter->format_aggregate(&a, buf, sizeof(buf));
+        if (n < 0 || n >= (int)sizeof(buf)) {
+            debug_log(agg.debug_sink, DEBUG_LEVEL_ERROR, "policy",
+                      "aggregate record did not format");
+        } else if (agg.sender->send(buf, (size_t)n) < 0) {
+            debug_log_errno(agg.debug_sink, "policy", "aggregate send");
+        }
+    }
+    memset(table, 0, sizeof(agg.tables[0]));
+}
+
+/* Waits on agg_wake for at most ms; the condvar uses CLOCK_REALTIME. */
+static void wait_for(unsigned int ms) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&agg_wake, &agg_lock, &ts);
+}
+
+static void *window_main(void *arg) {
+    uint32_t window_start = monotonic_ms();
+    uint32_t window_end = window_start + aggregate_interval_ms;
+
+    (void)arg;
+    pthread_mutex_lock(&agg_lock);
+    for (;;) {
+        uint32_t now = monotonic_ms();
+        AggregateEntry *full;
+        unsigned int window_ms;
+        int stop;
+
+        if (!agg.stop && (int32_t)(window_end - now) > 0) {
+            wait_for(window_end - now);
+            continue;
+        }
+        stop = agg.stop;
+        /* The last window is cut short by the stop. */
+        window_ms = now - window_start;
+        window_start = now;
+        window_end = now + aggregate_interval_ms;
+        full = agg.active;
+        agg.active = full == agg.tables[0] ? agg.tables[1] : agg.tables[0];
+        if (stop) {
+            agg.running = 0;
+        }
+        pthread_mutex_unlock(&agg_lock);
+        send_window(full, window_ms);
+        if (stop) {
+            return NULL;
+        }
+        pthread_mutex_lock(&agg_lock);
+    }
+}
+
+int policy_aggregate_start(const Formatter *f, const Sender *sender,
+                           const DebugSink *debug_sink) {
+    if (!f || !f->format_aggregate || !sender || !sender->send) {
+        return -1;
+    }
+    pthread_mutex_lock(&agg_lock);
+    if (agg.running) {
+        pthread_mutex_unlock(&agg_lock);
+        return -1;
+    }
+    memset(agg.tables, 0, sizeof(agg.tables));
+    agg.active = agg.tables[0];
+    agg.formatter = f;
+    agg.sender = sender;
+    agg.debug_sink = debug_sink;
+    agg.stop = 0;
+    if (pthread_create(&agg.thread, NULL, window_main, NULL) != 0) {
+        pthread_mutex_unlock(&agg_lock);
+        return -1;
+    }
+    agg.running = 1;
+    pthread_mutex_unlock(&agg_lock);
+    return 0;
+}
+
+int policy_aggregate_stop(void) {
+    pthread_mutex_lock(&agg_lock);
+    if (!agg.running || agg.stop) {
+        pthread_mutex_unlock(&agg_lock);
+        return -1;
+    }
+    agg.stop = 1;
+    pthread_cond_signal(&agg_wake);
+    pthread_mutex_unlock(&agg_lock);
+    return pthread_join(agg.thread, NULL) == 0 ? 0 : -1;
+}
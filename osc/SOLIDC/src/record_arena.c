@@ -0,0 +1,62 @@
+#include "include/record_arena.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+typedef struct RecordArena {
+    char *buf[RECORD_ARENA_SLOTS];
+    size_t cap[RECORD_ARENA_SLOTS];
+} RecordArena;
+
+static pthread_key_t arena_key;
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+static int arena_key_ok;
+
+static void arena_free(void *p) {
+    RecordArena *a = p;
+    size_t i;
+
+    for (i = 0; i < RECORD_ARENA_SLOTS; i++) {
+        free(a->buf[i]);
+    }
+    free(a);
+}
+
+static void arena_init_key(void) {
+    arena_key_ok = pthread_key_create(&arena_key, arena_free) == 0;
+}
+
+char *record_arena_get(size_t slot, size_t size) {
+    RecordArena *a;
+
+    if (slot >= RECORD_ARENA_SLOTS) {
+        return NULL;
+    }
+    pthread_once(&arena_once, arena_init_key);
+    if (!arena_key_ok) {
+        return NULL;
+    }
+
+    a = pthread_getspecific(arena_key);
+    if (!a) {
+        a = calloc(1, sizeof(*a));
+        if (!a || pthread_setspecific(arena_key, a) != 0) {
+            free(a);
+            return NULL;
+        }
+    }
+    if (a->cap[slot] < size) {
+        size_t cap = a->cap[slot] ? a->cap[slot] : MAX_BUFFER_SIZE;
+        char *p;
+
+        while (cap < size) {
+            cap = cap > (size_t)-1 / 2 ? size : cap * 2;
+        }
+        p = realloc(a->buf[slot], cap);
+        if (!p) {
+            return NULL;
+        }
+        a->buf[slot] = p;
+        a->cap[slot] = cap;
+    }
+    return a->buf[slot];
+}
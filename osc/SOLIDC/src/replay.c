@@ -0,0 +1,370 @@
+#include "include/replay.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REPLAY_READ_BUFFER (1024 * 1024)
+#define REPLAY_MAX_LINE 1024
+#define REPLAY_FAST_DIGITS 15
+
+static const double exact_pow10[23] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char *skip_spaces(const char *p, const char *end) {
+    while (p < end && is_space(*p)) {
+        p++;
+    }
+    return p;
+}
+
+static int parse_tid(const char **pp, const char *end, unsigned int *out) {
+    const char *p = *pp;
+    uint64_t v = 0;
+
+    if (p == end || *p < '0' || *p > '9') {
+        return -1;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+        v = v * 10 + (uint64_t)(*p - '0');
+        if (v > 0xffffffffULL) {
+            return -1;
+        }
+        p++;
+    }
+    *pp = p;
+    *out = (unsigned int)v;
+    return 0;
+}
+
+/*
+ * Decimal mantissa and power-of-ten scale are both exact doubles on the fast
+ * path, so one IEEE division gives the same correctly rounded result as
+ * strtod. Anything longer or with an exponent goes to strtod.
+ */
+static int parse_amount(const char **pp, const char *end, double *out) {
+    const char *p = *pp;
+    const char *start = p;
+    uint64_t mant = 0;
+    int seen = 0;
+    int digits = 0;
+    int frac = 0;
+    int neg = 0;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = *p == '-';
+        p++;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+        mant = mant * 10 + (uint64_t)(*p - '0');
+        digits += mant != 0;
+        seen = 1;
+        p++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            mant = mant * 10 + (uint64_t)(*p - '0');
+            digits += mant != 0;
+            seen = 1;
+            frac++;
+            p++;
+        }
+    }
+    if (!seen) {
+        return -1;
+    }
+
+    if (digits <= REPLAY_FAST_DIGITS && frac <= 22 &&
+        (p == end || is_space(*p) || *p == '\n')) {
+        double v = (double)mant / exact_pow10[frac];
+        *out = neg ? -v : v;
+        *pp = p;
+        return 0;
+    }
+
+    {
+        char tmp[64];
+        char *stop;
+        size_t n;
+
+        while (p < end && !is_space(*p) && *p != '\n') {
+            p++;
+        }
+        n = (size_t)(p - start);
+        if (n >= sizeof(tmp)) {
+            return -1;
+        }
+        memcpy(tmp, start, n);
+        tmp[n] = '\0';
+        *out = strtod(tmp, &stop);
+        if (stop != tmp + n) {
+            return -1;
+        }
+    }
+    *pp = p;
+    return 0;
+}
+
+static void replay_one(const AppContext *ctx, const Transaction *t,
+                       ReplayStats *stats) {
+    stats->records++;
+    if (process_transaction_with_ctx(ctx, t) < 0) {
+        stats->failed++;
+    }
+}
+
+static void parse_text_line(const AppContext *ctx, const char *p,
+                            const char *end, ReplayStats *stats) {
+    char user[REPLAY_MAX_USER + 1];
+    const char *user_start;
+    Transaction t;
+    size_t user_len;
+
+    p = skip_spaces(p, end);
+    if (p == end) {
+        return; /* blank line */
+    }
+    if (parse_tid(&p, end, &t.tid) < 0 || p == end || !is_space(*p)) {
+        stats->malformed++;
+        return;
+    }
+
+    p = skip_spaces(p, end);
+    user_start = p;
+    while (p < end && !is_space(*p)) {
+        p++;
+    }
+    user_len = (size_t)(p - user_start);
+    if (user_len == 0 || user_len > REPLAY_MAX_USER) {
+        stats->malformed++;
+        return;
+    }
+    memcpy(user, user_start, user_len);
+    user[user_len] = '\0';
+    t.user = user;
+
+    p = skip_spaces(p, end);
+    if (parse_amount(&p, end, &t.amount) < 0 ||
+        skip_spaces(p, end) != end) {
+        stats->malformed++;
+        return;
+    }
+
+    replay_one(ctx, &t, stats);
+}
+
+static size_t parse_text(const AppContext *ctx, const char *buf, size_t len,
+                         int eof, ReplayStats *stats) {
+    const char *p = buf;
+    const char *end = buf + len;
+
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        if (!nl) {
+            if (!eof && end - p < REPLAY_MAX_LINE) {
+                break;
+            }
+            nl = end;
+        }
+        parse_text_line(ctx, p, nl, stats);
+        p = nl < end ? nl + 1 : end;
+    }
+    return (size_t)(p - buf);
+}
+
+static size_t parse_binary(const AppContext *ctx, const char *buf,
+                           size_t len, int eof, ReplayStats *stats) {
+    const unsigned char *p = (const unsigned char *)buf;
+    const unsigned char *end = p + len;
+    char user[REPLAY_MAX_USER + 1];
+
+    while ((size_t)(end - p) >= REPLAY_BINARY_HEADER_SIZE) {
+        Transaction t;
+        uint64_t bits = 0;
+        size_t user_len;
+        int i;
+
+        user_len = (size_t)p[12] | (size_t)p[13] << 8;
+        if ((size_t)(end - p) < REPLAY_BINARY_HEADER_SIZE + user_len) {
+            break;
+        }
+
+        t.tid = (unsigned int)p[0] | (unsigned int)p[1] << 8 |
+                (unsigned int)p[2] << 16 | (unsigned int)p[3] << 24;
+        for (i = 7; i >= 0; i--) {
+            bits = bits << 8 | p[4 + i];
+        }
+        memcpy(&t.amount, &bits, sizeof(t.amount));
+        p += REPLAY_BINARY_HEADER_SIZE;
+
+        if (user_len == 0 || user_len > REPLAY_MAX_USER) {
+            stats->malformed++;
+            p += user_len;
+            continue;
+        }
+        memcpy(user, p, user_len);
+        user[user_len] = '\0';
+        t.user = user;
+        p += user_len;
+
+        replay_one(ctx, &t, stats);
+    }
+
+    if (eof && p < end) {
+        stats->malformed++; /* truncated trailing record */
+        p = end;
+    }
+    return (size_t)(p - (const unsigned char *)buf);
+}
+
+static size_t parse_chunk(const AppContext *ctx, ReplayFormat format,
+                          const char *buf, size_t len, int eof,
+                          ReplayStats *stats) {
+    if (format == REPLAY_FORMAT_BINARY) {
+        return parse_binary(ctx, buf, len, eof, stats);
+    }
+    return parse_text(ctx, buf, len, eof, stats);
+}
+
+static int replay_mapped(const AppContext *ctx, int fd, size_t size,
+                         ReplayFormat format, ReplayPoll poll, void *poll_arg,
+                         ReplayStats *stats) {
+    const char *map;
+    size_t off = 0;
+
+    if (size == 0) {
+        return 0;
+    }
+    map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    madvise((void *)map, size, MADV_SEQUENTIAL);
+
+    /* Parsed in windows so poll runs while a large file is replayed. */
+    while (off < size) {
+        size_t win = size - off < REPLAY_POLL_BYTES ? size - off
+                                                    : REPLAY_POLL_BYTES;
+        size_t used = parse_chunk(ctx, format, map + off, win,
+                                  off + win == size, stats);
+        if (used == 0) {
+            used = parse_chunk(ctx, format, map + off, size - off, 1, stats);
+        }
+        off += used;
+        if (poll) {
+            poll(poll_arg);
+        }
+    }
+    stats->bytes += size;
+    munmap((void *)map, size);
+    return 0;
+}
+
+static int replay_stream(const AppContext *ctx, int fd, ReplayFormat format,
+                         ReplayPoll poll, void *poll_arg, ReplayStats *stats) {
+    char *buf = malloc(REPLAY_READ_BUFFER);
+    size_t have = 0;
+    int rc = 0;
+
+    if (!buf) {
+        return -1;
+    }
+
+    for (;;) {
+        ssize_t r = read(fd, buf + have, REPLAY_READ_BUFFER - have);
+        size_t used;
+
+        if (r < 0) {
+            if (errno == EINTR) {
+                if (poll) {
+                    poll(poll_arg);
+                }
+                continue;
+            }
+            rc = -1;
+            break;
+        }
+        have += (size_t)r;
+        stats->bytes += (size_t)r;
+
+        used = parse_chunk(ctx, format, buf, have, r == 0, stats);
+        memmove(buf, buf + used, have - used);
+        have -= used;
+        if (r == 0) {
+            break;
+        }
+        if (poll) {
+            poll(poll_arg);
+        }
+    }
+
+    free(buf);
+    return rc;
+}
+
+int replay_run(const AppContext *ctx, const char *path, ReplayFormat format,
+               ReplayPoll poll, void *poll_arg, ReplayStats *stats) {
+    struct timespec t0;
+    struct timespec t1;
+    struct stat st;
+    int fd;
+    int rc;
+
+    if (!ctx || !path || !stats) {
+        return -1;
+    }
+    memset(stats, 0, sizeof(*stats));
+
+    if (strcmp(path, "-") == 0) {
+        fd = STDIN_FILENO;
+    } else {
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            debug_log_errno(ctx->debug_sink, "replay", "open");
+            return -1;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        rc = replay_mapped(ctx, fd, (size_t)st.st_size, format, poll,
+                           poll_arg, stats);
+    } else {
+        rc = replay_stream(ctx, fd, format, poll, poll_arg, stats);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    stats->seconds = (double)(t1.tv_sec - t0.tv_sec) +
+                     (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    if (rc < 0) {
+        debug_log_errno(ctx->debug_sink, "replay", "read");
+    }
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    return rc;
+}
+
+void replay_print_stats(const ReplayStats *stats) {
+    double secs = stats->seconds > 0 ? stats->seconds : 1e-9;
+
+    fprintf(stderr,
+            "replayed %llu records (%llu failed, %llu malformed) in %.3f s: "
+            "%.0f records/s, %.1f MB/s\n",
+            stats->records, stats->failed, stats->malformed, stats->seconds,
+            (double)stats->records / secs,
+            (double)stats->bytes / secs / (1024.0 * 1024.0));
+}
@@ -0,0 +1,1001 @@
+#include "include/runtime_config.h"
+#include "include/components.h"
+#include "include/config.h"
+#include "cJSON.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define CONFIG_MAX_FILE_SIZE (1024 * 1024)
+
+typedef struct NamedFormatter {
+    const char *name;
+    const Formatter *formatter;
+} NamedFormatter;
+
+/* The option structs a transport is configured from. */
+enum {
+    OPTS_DISK = 1 << 0,
+    OPTS_MMAP = 1 << 1,
+    OPTS_TCP = 1 << 2,
+    OPTS_UDP = 1 << 3,
+    OPTS_URING = 1 << 4,
+    OPTS_POLICY = 1 << 5,
+    OPTS_ALL = (1 << 6) - 1,
+};
+
+typedef struct NamedTransport {
+    const char *name;
+    const Transport *transport;
+    unsigned int options;
+} NamedTransport;
+
+static const NamedFormatter formatters[] = {
+    {"text", &TEXT_FORMATTER},
+    {"json", &JSON_FORMATTER},
+    {"binary", &BINARY_FORMATTER},
+};
+
+typedef struct NamedPolicy {
+    const char *name;
+    LogPolicy policy;
+} NamedPolicy;
+
+static const NamedPolicy policies[] = {
+    {"all", NULL},
+    {"network", should_log_on_network},
+    {"sample", sample_by_tid},
+    {"rate_limit", rate_limit_by_user},
+    {"aggregate", aggregate_by_user},
+};
+
+/* io_uring targets hand over to the plain transports, with their options. */
+static const NamedTransport transports[] = {
+    {"disk", &DISK_TRANSPORT, OPTS_DISK},
+    {"tcp", &TCP_TRANSPORT, OPTS_TCP},
+    {"udp", &UDP_TRANSPORT, OPTS_UDP},
+    {"mmap", &MMAP_TRANSPORT, OPTS_MMAP},
+    {"uring_disk", &URING_DISK_TRANSPORT, OPTS_URING | OPTS_DISK},
+    {"uring_tcp", &URING_TCP_TRANSPORT, OPTS_URING | OPTS_TCP},
+    {"uring_udp", &URING_UDP_TRANSPORT, OPTS_URING | OPTS_UDP},
+};
+
+static void add_sink(RuntimeConfig *cfg, const char *name,
+                     const Formatter *formatter, const Transport *transport,
+                     LogPolicy policy) {
+    SinkConfig *s = &cfg->sinks[cfg->sink_count++];
+
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    s->formatter = formatter;
+    s->transport = transport;
+    s->policy = policy;
+}
+
+void runtime_config_defaults(RuntimeConfig *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->network_max_amount = MAX_TRANSACTION_AMOUNT_TO_LOG;
+    policy_options_defaults(&cfg->policy);
+    strcpy(cfg->disk_path, LOG_FILE);
+    strcpy(cfg->mmap_path, LOG_FILE);
+    strcpy(cfg->tcp_host, LOG_HOST);
+    strcpy(cfg->tcp_spool_path, TCP_SPOOL_PATH);
+    strcpy(cfg->udp_host, LOG_HOST);
+
+    cfg->disk.path = cfg->disk_path;
+    cfg->disk.buffer_size = DISK_BUFFER_SIZE;
+    cfg->disk.flush_interval_ms = DISK_FLUSH_INTERVAL_MS;
+    cfg->disk.fdatasync_on_flush = DISK_FDATASYNC_ON_FLUSH;
+    cfg->disk.group_commit = DISK_GROUP_COMMIT;
+    cfg->disk.commit_interval_us = DISK_COMMIT_INTERVAL_US;
+    cfg->disk.commit_batch = DISK_COMMIT_BATCH;
+    cfg->disk.rotate_bytes = DISK_ROTATE_BYTES;
+    cfg->disk.rotate_interval_s = DISK_ROTATE_INTERVAL_S;
+    cfg->disk.compress = DISK_ROTATE_COMPRESS;
+
+    cfg->mmap.path = cfg->mmap_path;
+    cfg->mmap.segment_size = MMAP_SEGMENT_SIZE;
+
+    cfg->tcp.host = cfg->tcp_host;
+    cfg->tcp.port = LOG_PORT;
+    cfg->tcp.nodelay = TCP_NODELAY_ENABLED;
+    cfg->tcp.cork = TCP_CORK_ENABLED;
+    cfg->tcp.backoff_initial_ms = TCP_BACKOFF_INITIAL_MS;
+    cfg->tcp.backoff_max_ms = TCP_BACKOFF_MAX_MS;
+    cfg->tcp.replay_buffer_size = TCP_REPLAY_BUFFER_SIZE;
+    cfg->tcp.connect_timeout_ms = TCP_CONNECT_TIMEOUT_MS;
+    cfg->tcp.send_timeout_ms = TCP_SEND_TIMEOUT_MS;
+    cfg->tcp.spool_path = cfg->tcp_spool_path;
+    cfg->tcp.spool_max_bytes = TCP_SPOOL_MAX_BYTES;
+
+    cfg->udp.host = cfg->udp_host;
+    cfg->udp.port = LOG_PORT;
+    cfg->udp.datagram_size = UDP_DATAGRAM_SIZE;
+    cfg->udp.gso = UDP_GSO_ENABLED;
+
+    /* io_uring targets follow the disk path and the TCP collector. */
+    cfg->uring.disk_path = cfg->disk_path;
+    cfg->uring.host = cfg->tcp_host;
+    cfg->uring.port = LOG_PORT;
+    cfg->uring.queue_depth = URING_QUEUE_DEPTH;
+
+    add_sink(cfg, "disk", &TEXT_FORMATTER, &DISK_TRANSPORT, NULL);
+    add_sink(cfg, "tcp", &JSON_FORMATTER, &TCP_TRANSPORT,
+             should_log_on_network);
+}
+
+/* ---- JSON helpers; each returns -1 with err filled in ---- */
+
+typedef struct ConfigError {
+    char *buf;
+    size_t size;
+} ConfigError;
+
+static int fail(ConfigError *e, const char *where, const char *what) {
+    snprintf(e->buf, e->size, "%s: %s", where, what);
+    return -1;
+}
+
+/* Rejects keys outside allowed so typos do not silently keep a default. */
+static int check_keys(const cJSON *obj, const char *const *allowed,
+                      const char *where, ConfigError *e) {
+    const cJSON *item;
+
+    if (!cJSON_IsObject(obj)) {
+        return fail(e, where, "expected an object");
+    }
+    cJSON_ArrayForEach(item, obj) {
+        const char *const *k;
+
+        for (k = allowed; *k; k++) {
+            if (strcmp(*k, item->string) == 0) {
+                break;
+            }
+        }
+        if (!*k) {
+            char msg[96];
+            snprintf(msg, sizeof(msg), "unknown key \"%s\"", item->string);
+            return fail(e, where, msg);
+        }
+    }
+    return 0;
+}
+
+static int get_size(const cJSON *obj, const char *key, size_t max,
+                    size_t *out, const char *where, ConfigError *e) {
+    const cJSON *v = cJSON_GetObjectItemCaseSensitive(obj, key);
+
+    if (!v) {
+        return 0;
+    }
+    if (!cJSON_IsNumber(v) || v->valuedouble < 0 ||
+        v->valuedouble > (double)max ||
+        v->valuedouble != (double)(size_t)v->valuedouble) {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "\"%s\" must be an integer in [0, %zu]",
+                 key, max);
+        return fail(e, where, msg);
+    }
+    *out = (size_t)v->valuedouble;
+    return 0;
+}
+
+static int get_uint(const cJSON *obj, const char *key, unsigned int *out,
+                    const char *where, ConfigError *e) {
+    size_t v = *out;
+
+    if (get_size(obj, key, 0xffffffffu, &v, where, e) < 0) {
+        return -1;
+    }
+    *out = (unsigned int)v;
+    return 0;
+}
+
+static int get_number(const cJSON *obj, const char *key, double min,
+                      double max, double *out, const char *where,
+                      ConfigError *e) {
+    const cJSON *v = cJSON_GetObjectItemCaseSensitive(obj, key);
+
+    if (!v) {
+        return 0;
+    }
+    if (!cJSON_IsNumber(v) || !(v->valuedouble >= min) ||
+        !(v->valuedouble <= max)) {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "\"%s\" must be a number in [%g, %g]",
+                 key, min, max);
+        return fail(e, where, msg);
+    }
+    *out = v->valuedouble;
+    return 0;
+}
+
+static int get_port(const cJSON *obj, unsigned short *out, const char *where,
+                    ConfigError *e) {
+    size_t v = *out;
+
+    if (get_size(obj, "port", 65535, &v, where, e) < 0) {
+        return -1;
+    }
+    *out = (unsigned short)v;
+    return 0;
+}
+
+static int get_bool(const cJSON *obj, const char *key, int *out,
+                    const char *where, ConfigError *e) {
+    const cJSON *v = cJSON_GetObjectItemCaseSensitive(obj, key);
+
+    if (!v) {
+        return 0;
+    }
+    if (!cJSON_IsBool(v)) {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "\"%s\" must be true or false", key);
+        return fail(e, where, msg);
+    }
+    *out = cJSON_IsTrue(v);
+    return 0;
+}
+
+static int get_string(const cJSON *obj, const char *key, char *out,
+                      size_t size, const char *where, ConfigError *e) {
+    const cJSON *v = cJSON_GetObjectItemCaseSensitive(obj, key);
+
+    if (!v) {
+        return 0;
+    }
+    if (!cJSON_IsString(v) || v->valuestring[0] == '\0' ||
+        strlen(v->valuestring) >= size) {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "\"%s\" must be a string of 1-%zu chars",
+                 key, size - 1);
+        return fail(e, where, msg);
+    }
+    strcpy(out, v->valuestring);
+    return 0;
+}
+
+/* ---- sections ---- */
+
+static int parse_disk(const cJSON *o, RuntimeConfig *cfg, ConfigError *e) {
+    static const char *const keys[] = {
+        "path", "buffer_size", "flush_interval_ms", "fdatasync",
+        "group_commit", "commit_interval_us", "commit_batch", "rotate_bytes",
+        "rotate_interval_s", "compress", NULL,
+    };
+    DiskTransportOptions *d = &cfg->disk;
+
+    if (check_keys(o, keys, "disk", e) < 0 ||
+        get_string(o, "path", cfg->disk_path, sizeof(cfg->disk_path), "disk",
+                   e) < 0 ||
+        get_size(o, "buffer_size", 1 << 30, &d->buffer_size, "disk", e) < 0 ||
+        get_uint(o, "flush_interval_ms", &d->flush_interval_ms, "disk", e) <
+            0 ||
+        get_bool(o, "fdatasync", &d->fdatasync_on_flush, "disk", e) < 0 ||
+        get_bool(o, "group_commit", &d->group_commit, "disk", e) < 0 ||
+        get_uint(o, "commit_interval_us", &d->commit_interval_us, "disk", e) <
+            0 ||
+        get_size(o, "commit_batch", 1 << 20, &d->commit_batch, "disk", e) <
+            0 ||
+        get_size(o, "rotate_bytes", (size_t)1 << 40, &d->rotate_bytes, "disk",
+                 e) < 0 ||
+        get_uint(o, "rotate_interval_s", &d->rotate_interval_s, "disk", e) <
+            0 ||
+        get_bool(o, "compress", &d->compress, "disk", e) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_mmap(const cJSON *o, RuntimeConfig *cfg, ConfigError *e) {
+    static const char *const keys[] = {"path", "segment_size", NULL};
+
+    if (check_keys(o, keys, "mmap", e) < 0 ||
+        get_string(o, "path", cfg->mmap_path, sizeof(cfg->mmap_path), "mmap",
+                   e) < 0 ||
+        get_size(o, "segment_size", (size_t)1 << 40, &cfg->mmap.segment_size,
+                 "mmap", e) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_tcp(const cJSON *o, RuntimeConfig *cfg, ConfigError *e) {
+    static const char *const keys[] = {
+        "host", "port", "nodelay", "cork", "backoff_initial_ms",
+        "backoff_max_ms", "replay_buffer_size", "connect_timeout_ms",
+        "send_timeout_ms", "spool_path", "spool_max_bytes", NULL,
+    };
+    TcpTransportOptions *t = &cfg->tcp;
+
+    if (check_keys(o, keys, "tcp", e) < 0 ||
+        get_string(o, "host", cfg->tcp_host, sizeof(cfg->tcp_host), "tcp",
+                   e) < 0 ||
+        get_port(o, &t->port, "tcp", e) < 0 ||
+        get_bool(o, "nodelay", &t->nodelay, "tcp", e) < 0 ||
+        get_bool(o, "cork", &t->cork, "tcp", e) < 0 ||
+        get_uint(o, "backoff_initial_ms", &t->backoff_initial_ms, "tcp", e) <
+            0 ||
+        get_uint(o, "backoff_max_ms", &t->backoff_max_ms, "tcp", e) < 0 ||
+        get_size(o, "replay_buffer_size", 1 << 30, &t->replay_buffer_size,
+                 "tcp", e) < 0 ||
+        get_uint(o, "connect_timeout_ms", &t->connect_timeout_ms, "tcp", e) <
+            0 ||
+        get_uint(o, "send_timeout_ms", &t->send_timeout_ms, "tcp", e) < 0 ||
+        get_string(o, "spool_path", cfg->tcp_spool_path,
+                   sizeof(cfg->tcp_spool_path), "tcp", e) < 0 ||
+        get_size(o, "spool_max_bytes", (size_t)1 << 40, &t->spool_max_bytes,
+                 "tcp", e) < 0) {
+        return -1;
+    }
+    cfg->uring.port = t->port;
+    return 0;
+}
+
+static int parse_udp(const cJSON *o, RuntimeConfig *cfg, ConfigError *e) {
+    static const char *const keys[] = {
+        "host", "port", "datagram_size", "gso", NULL,
+    };
+    UdpTransportOptions *u = &cfg->udp;
+
+    if (check_keys(o, keys, "udp", e) < 0 ||
+        get_string(o, "host", cfg->udp_host, sizeof(cfg->udp_host), "udp",
+                   e) < 0 ||
+        get_port(o, &u->port, "udp", e) < 0 ||
+        get_size(o, "datagram_size", 65507, &u->datagram_size, "udp", e) <
+            0 ||
+        get_bool(o, "gso", &u->gso, "udp", e) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_uring(const cJSON *o, RuntimeConfig *cfg, ConfigError *e) {
+    static const char *const keys[] = {"queue_depth", NULL};
+
+    if (check_keys(o, keys, "uring", e) < 0 ||
+        get_uint(o, "queue_depth", &cfg->uring.queue_depth, "uring", e) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_policy(const cJSON *o, RuntimeConfig *cfg, ConfigError *e) {
+    static const char *const keys[] = {
+        "sample_rate", "rate_per_second", "rate_burst",
+        "aggregate_interval_ms", NULL,
+    };
+    PolicyOptions *p = &cfg->policy;
+
+    if (check_keys(o, keys, "policy", e) < 0 ||
+        get_number(o, "sample_rate", 0.0, 1.0, &p->sample_rate, "policy", e) <
+            0 ||
+        get_number(o, "rate_per_second", 0.0, 1e9, &p->rate_per_second,
+                   "policy", e) < 0 ||
+        get_number(o, "rate_burst", 1.0, 1e9, &p->rate_burst, "policy", e) <
+            0 ||
+        get_uint(o, "aggregate_interval_ms", &p->aggregate_interval_ms,
+                 "policy", e) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_async(const cJSON *o, SinkConfig *s, const char *where,
+                       ConfigError *e) {
+    static const char *const keys[] = {
+        "capacity", "shards", "batch", "backpressure", NULL,
+    };
+    const cJSON *bp;
+
+    if (cJSON_IsBool(o)) {
+        s->async = cJSON_IsTrue(o);
+        return 0;
+    }
+    if (check_keys(o, keys, where, e) < 0 ||
+        get_size(o, "capacity", 1 << 24, &s->async_opts.capacity, where, e) <
+            0 ||
+        get_size(o, "shards", 256, &s->async_opts.shards, where, e) < 0 ||
+        get_size(o, "batch", LOG_BATCH_MAX_RECORDS, &s->async_opts.batch,
+                 where, e) < 0) {
+        return -1;
+    }
+    bp = cJSON_GetObjectItemCaseSensitive(o, "backpressure");
+    if (bp) {
+        const char *v = cJSON_GetStringValue(bp);
+
+        if (v && strcmp(v, "block") == 0) {
+            s->async_opts.backpressure = ASYNC_BACKPRESSURE_BLOCK;
+        } else if (v && strcmp(v, "drop_newest") == 0) {
+            s->async_opts.backpressure = ASYNC_BACKPRESSURE_DROP_NEWEST;
+        } else if (v && strcmp(v, "drop_oldest") == 0) {
+            s->async_opts.backpressure = ASYNC_BACKPRESSURE_DROP_OLDEST;
+        } else {
+            return fail(e, where,
+                        "\"backpressure\" must be block, drop_newest or "
+                        "drop_oldest");
+        }
+    }
+    s->async = 1;
+    return 0;
+}
+
+static int parse_sink(const cJSON *o, SinkConfig *s, size_t idx,
+                      ConfigError *e) {
+    static const char *const keys[] = {
+        "name", "format", "transport", "policy", "async", NULL,
+    };
+    char where[CONFIG_NAME_MAX + 16];
+    const char *format;
+    const char *transport;
+    const char *policy;
+    const cJSON *async;
+    size_t k;
+
+    snprintf(where, sizeof(where), "sinks[%zu]", idx);
+    memset(s, 0, sizeof(*s));
+    snprintf(s->name, sizeof(s->name), "sink%zu", idx);
+    if (check_keys(o, keys, where, e) < 0 ||
+        get_string(o, "name", s->name, sizeof(s->name), where, e) < 0) {
+        return -1;
+    }
+    snprintf(where, sizeof(where), "sink %s", s->name);
+
+    format = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(o, "format"));
+    for (k = 0; format && k < sizeof(formatters) / sizeof(formatters[0]);
+         k++) {
+        if (strcmp(format, formatters[k].name) == 0) {
+            s->formatter = formatters[k].formatter;
+        }
+    }
+    if (!s->formatter) {
+        return fail(e, where, "\"format\" must be text, json or binary");
+    }
+
+    transport = cJSON_GetStringValue(
+        cJSON_GetObjectItemCaseSensitive(o, "transport"));
+    for (k = 0; transport && k < sizeof(transports) / sizeof(transports[0]);
+         k++) {
+        if (strcmp(transport, transports[k].name) == 0) {
+            s->transport = transports[k].transport;
+        }
+    }
+    if (!s->transport) {
+        return fail(e, where,
+                    "\"transport\" must be disk, tcp, udp, mmap, uring_disk, "
+                    "uring_tcp or uring_udp");
+    }
+
+    policy = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(o, "policy"));
+    for (k = 0; policy && k < sizeof(policies) / sizeof(policies[0]); k++) {
+        if (strcmp(policy, policies[k].name) == 0) {
+            s->policy = policies[k].policy;
+            break;
+        }
+    }
+    if (cJSON_GetObjectItemCaseSensitive(o, "policy") &&
+        (!policy || k == sizeof(policies) / sizeof(policies[0]))) {
+        return fail(e, where,
+                    "\"policy\" must be all, network, sample, rate_limit or "
+                    "aggregate");
+    }
+
+    async = cJSON_GetObjectItemCaseSensitive(o, "async");
+    if (async && parse_async(async, s, where, e) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_root(const cJSON *root, RuntimeConfig *cfg, ConfigError *e) {
+    static const char *const keys[] = {
+        "network_max_amount", "policy", "disk", "mmap", "tcp", "udp", "uring",
+        "sinks", NULL,
+    };
+    const cJSON *v;
+    const cJSON *sink;
+    size_t aggregating = 0;
+    size_t i = 0;
+
+    if (check_keys(root, keys, "config", e) < 0) {
+        return -1;
+    }
+
+    v = cJSON_GetObjectItemCaseSensitive(root, "network_max_amount");
+    if (v) {
+        if (!cJSON_IsNumber(v)) {
+            return fail(e, "config", "\"network_max_amount\" must be a number");
+        }
+        cfg->network_max_amount = v->valuedouble;
+    }
+
+    if (((v = cJSON_GetObjectItemCaseSensitive(root, "policy")) &&
+         parse_policy(v, cfg, e) < 0) ||
+        ((v = cJSON_GetObjectItemCaseSensitive(root, "disk")) &&
+         parse_disk(v, cfg, e) < 0) ||
+        ((v = cJSON_GetObjectItemCaseSensitive(root, "mmap")) &&
+         parse_mmap(v, cfg, e) < 0) ||
+        ((v = cJSON_GetObjectItemCaseSensitive(root, "tcp")) &&
+         parse_tcp(v, cfg, e) < 0) ||
+        ((v = cJSON_GetObjectItemCaseSensitive(root, "udp")) &&
+         parse_udp(v, cfg, e) < 0) ||
+        ((v = cJSON_GetObjectItemCaseSensitive(root, "uring")) &&
+         parse_uring(v, cfg, e) < 0)) {
+        return -1;
+    }
+
+    v = cJSON_GetObjectItemCaseSensitive(root, "sinks");
+    if (!v) {
+        return 0; /* keep the default sinks */
+    }
+    if (!cJSON_IsArray(v) || cJSON_GetArraySize(v) < 1 ||
+        cJSON_GetArraySize(v) > CONFIG_MAX_SINKS) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "expected an array of 1-%d sinks",
+                 CONFIG_MAX_SINKS);
+        return fail(e, "sinks", msg);
+    }
+    cJSON_ArrayForEach(sink, v) {
+        if (parse_sink(sink, &cfg->sinks[i], i, e) < 0) {
+            return -1;
+        }
+        aggregating += cfg->sinks[i].policy == aggregate_by_user;
+        i++;
+    }
+    if (aggregating > 1) {
+        /* The per-user sums are process-wide, like the policy settings. */
+        return fail(e, "sinks", "only one sink may use the aggregate policy");
+    }
+    cfg->sink_count = i;
+    return 0;
+}
+
+static char *read_file(const char *path, ConfigError *e) {
+    struct stat st;
+    char *buf;
+    size_t got = 0;
+    FILE *f = fopen(path, "rb");
+
+    if (!f) {
+        fail(e, path, strerror(errno));
+        return NULL;
+    }
+    if (fstat(fileno(f), &st) < 0 || st.st_size > CONFIG_MAX_FILE_SIZE) {
+        fclose(f);
+        fail(e, path, "unreadable or larger than 1 MiB");
+        return NULL;
+    }
+    buf = malloc((size_t)st.st_size + 1);
+    if (buf) {
+        got = fread(buf, 1, (size_t)st.st_size, f);
+        buf[got] = '\0';
+    } else {
+        fail(e, path, "out of memory");
+    }
+    fclose(f);
+    return buf;
+}
+
+int runtime_config_load(const char *path, RuntimeConfig *cfg, char *err,
+                        size_t err_size) {
+    ConfigError e = {err, err_size};
+    char *text;
+    cJSON *root;
+    int rc;
+
+    if (!path || !cfg || !err || err_size == 0) {
+        return -1;
+    }
+    runtime_config_defaults(cfg);
+
+    text = read_file(path, &e);
+    if (!text) {
+        return -1;
+    }
+    root = cJSON_Parse(text);
+    if (!root) {
+        char msg[64];
+        const char *at = cJSON_GetErrorPtr();
+        snprintf(msg, sizeof(msg), "invalid JSON near \"%.24s\"",
+                 at ? at : "");
+        free(text);
+        return fail(&e, path, msg);
+    }
+    rc = parse_root(root, cfg, &e);
+    cJSON_Delete(root);
+    free(text);
+    return rc;
+}
+
+/* ---- applying a config ---- */
+
+static void app_error(const RuntimeApp *app, const char *what) {
+    debug_log(app->ctx.debug_sink, DEBUG_LEVEL_ERROR, "config", what);
+}
+
+static void sink_error(const RuntimeApp *app, const LogSink *sink,
+                       const char *what) {
+    char msg[128];
+
+    snprintf(msg, sizeof(msg), "sink %s: %s", sink->name, what);
+    app_error(app, msg);
+}
+
+static int same_string(const char *a, const char *b) {
+    return strcmp(a ? a : "", b ? b : "") == 0;
+}
+
+static int same_disk(const DiskTransportOptions *a,
+                     const DiskTransportOptions *b) {
+    return same_string(a->path, b->path) && a->buffer_size == b->buffer_size &&
+           a->flush_interval_ms == b->flush_interval_ms &&
+           a->fdatasync_on_flush == b->fdatasync_on_flush &&
+           a->group_commit == b->group_commit &&
+           a->commit_interval_us == b->commit_interval_us &&
+           a->commit_batch == b->commit_batch &&
+           a->rotate_bytes == b->rotate_bytes &&
+           a->rotate_interval_s == b->rotate_interval_s &&
+           a->compress == b->compress;
+}
+
+static int same_mmap(const MmapTransportOptions *a,
+                     const MmapTransportOptions *b) {
+    return same_string(a->path, b->path) &&
+           a->segment_size == b->segment_size;
+}
+
+static int same_tcp(const TcpTransportOptions *a,
+                    const TcpTransportOptions *b) {
+    return same_string(a->host, b->host) && a->port == b->port &&
+           a->nodelay == b->nodelay && a->cork == b->cork &&
+           a->backoff_initial_ms == b->backoff_initial_ms &&
+           a->backoff_max_ms == b->backoff_max_ms &&
+           a->replay_buffer_size == b->replay_buffer_size &&
+           a->connect_timeout_ms == b->connect_timeout_ms &&
+           a->send_timeout_ms == b->send_timeout_ms &&
+           same_string(a->spool_path, b->spool_path) &&
+           a->spool_max_bytes == b->spool_max_bytes;
+}
+
+static int same_udp(const UdpTransportOptions *a,
+                    const UdpTransportOptions *b) {
+    return same_string(a->host, b->host) && a->port == b->port &&
+           a->datagram_size == b->datagram_size && a->gso == b->gso;
+}
+
+static int same_uring(const UringTransportOptions *a,
+                      const UringTransportOptions *b) {
+    return same_string(a->disk_path, b->disk_path) &&
+           same_string(a->host, b->host) && a->port == b->port &&
+           a->queue_depth == b->queue_depth;
+}
+
+static int same_policy(const PolicyOptions *a, const PolicyOptions *b) {
+    return a->sample_rate == b->sample_rate &&
+           a->rate_per_second == b->rate_per_second &&
+           a->rate_burst == b->rate_burst &&
+           a->aggregate_interval_ms == b->aggregate_interval_ms;
+}
+
+/* OPTS_ bits for every option struct that differs between a and b. */
+static unsigned int changed_options(const RuntimeConfig *a,
+                                    const RuntimeConfig *b) {
+    return (same_disk(&a->disk, &b->disk) ? 0 : OPTS_DISK) |
+           (same_mmap(&a->mmap, &b->mmap) ? 0 : OPTS_MMAP) |
+           (same_tcp(&a->tcp, &b->tcp) ? 0 : OPTS_TCP) |
+           (same_udp(&a->udp, &b->udp) ? 0 : OPTS_UDP) |
+           (same_uring(&a->uring, &b->uring) ? 0 : OPTS_URING) |
+           (same_policy(&a->policy, &b->policy) ? 0 : OPTS_POLICY);
+}
+
+static unsigned int transport_options(const Transport *tr) {
+    size_t k;
+
+    for (k = 0; k < sizeof(transports) / sizeof(transports[0]); k++) {
+        if (transports[k].transport == tr) {
+            return transports[k].options;
+        }
+    }
+    return OPTS_ALL;
+}
+
+/*
+ * Configures the option structs named in which. Their transports must be
+ * disconnected here; a refusal keeps the old settings.
+ */
+static int apply_options(const RuntimeApp *app, const RuntimeConfig *cfg,
+                         unsigned int which) {
+    int rc = 0;
+
+    set_network_max_amount(cfg->network_max_amount);
+    if ((which & OPTS_POLICY) && policy_configure(&cfg->policy) < 0) {
+        app_error(app, "policy options rejected; keeping the previous ones");
+        rc = -1;
+    }
+    if ((which & OPTS_DISK) && disk_transport_configure(&cfg->disk) < 0) {
+        app_error(app, "disk options rejected; keeping the previous ones");
+        rc = -1;
+    }
+    if ((which & OPTS_MMAP) && mmap_transport_configure(&cfg->mmap) < 0) {
+        app_error(app, "mmap options rejected; keeping the previous ones");
+        rc = -1;
+    }
+    if ((which & OPTS_TCP) && tcp_transport_configure(&cfg->tcp) < 0) {
+        app_error(app, "tcp options rejected (records still parked for "
+                       "replay?); keeping the previous ones");
+        rc = -1;
+    }
+    if ((which & OPTS_UDP) && udp_transport_configure(&cfg->udp) < 0) {
+        app_error(app, "udp options rejected; keeping the previous ones");
+        rc = -1;
+    }
+    if ((which & OPTS_URING) && uring_transport_configure(&cfg->uring) < 0) {
+        app_error(app, "uring options rejected; keeping the previous ones");
+        rc = -1;
+    }
+    return rc;
+}
+
+static void destroy_sinks(RuntimeSinks *g) {
+    size_t i;
+
+    for (i = 0; i < g->count; i++) {
+        if (g->sinks[i].async) {
+            async_log_destroy(g->sinks[i].async);
+            g->sinks[i].async = NULL;
+        }
+    }
+    g->count = 0;
+}
+
+static int build_sinks(const RuntimeApp *app, RuntimeSinks *g,
+                       const RuntimeConfig *cfg) {
+    size_t i;
+
+    for (i = 0; i < cfg->sink_count; i++) {
+        const SinkConfig *s = &cfg->sinks[i];
+        LogSink *sink = &g->sinks[i];
+
+        sink->name = s->name;
+        sink->formatter = s->formatter;
+        sink->transport = s->transport;
+        sink->policy = s->policy;
+        sink->async = NULL;
+        sink->metrics = &g->metrics[i];
+        metrics_reset(sink->metrics);
+        if (s->async) {
+            if (async_log_init(&g->async[i], &s->async_opts,
+                               app->ctx.debug_sink) < 0) {
+                app_error(app, "failed to allocate async ring");
+                g->count = i;
+                destroy_sinks(g);
+                return -1;
+            }
+            sink->async = &g->async[i];
+        }
+    }
+    g->count = cfg->sink_count;
+    return 0;
+}
+
+static const LogSink *aggregate_sink(const RuntimeSinks *g) {
+    size_t i;
+
+    for (i = 0; i < g->count; i++) {
+        if (g->sinks[i].policy == aggregate_by_user) {
+            return &g->sinks[i];
+        }
+    }
+    return NULL;
+}
+
+/* Sends straight to the transport, which serialises its callers. */
+static int start_aggregate(const RuntimeApp *app, const RuntimeSinks *g) {
+    const LogSink *agg = aggregate_sink(g);
+
+    if (agg && policy_aggregate_start(agg->formatter, agg->transport->sender,
+                                      app->ctx.debug_sink) < 0) {
+        app_error(app, "failed to start the aggregation window; its "
+                       "transactions are logged one by one");
+        return -1;
+    }
+    return 0;
+}
+
+static const Connectable *connectable_of(const LogSink *sink) {
+    return sink->transport->connectable;
+}
+
+static int uses_connectable(const RuntimeSinks *g, size_t n,
+                            const Connectable *c) {
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        if (connectable_of(&g->sinks[i]) == c) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Flushes and closes sink's transport. */
+static int close_transport(const RuntimeApp *app, const LogSink *sink) {
+    const Flushable *f = sink->transport->flushable;
+    const Connectable *c = connectable_of(sink);
+    int rc = 0;
+
+    if (f && f->flush && f->flush() < 0) {
+        sink_error(app, sink, "flush capability failed");
+        rc = -1;
+    }
+    if (c && c->disconnect && c->disconnect() < 0) {
+        sink_error(app, sink, "disconnect capability failed");
+        rc = -1;
+    }
+    return rc;
+}
+
+/*
+ * Starts g's async writers; on failure the ones already started are
+ * stopped again and g is left as built.
+ */
+static int start_writers(const RuntimeApp *app, RuntimeSinks *g) {
+    size_t i;
+
+    for (i = 0; i < g->count; i++) {
+        LogSink *sink = &g->sinks[i];
+
+        if (!sink->async) {
+            continue;
+        }
+        sink->async->metrics = sink->metrics;
+        if (async_log_start(sink->async) < 0) {
+            sink_error(app, sink, "async writer start failed");
+            while (i-- > 0) {
+                if (g->sinks[i].async) {
+                    async_log_stop(g->sinks[i].async);
+                }
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int runtime_app_start(RuntimeApp *app, RuntimeConfig *cfg,
+                      const DebugSink *debug_sink) {
+    RuntimeSinks *g;
+    int rc;
+
+    if (!app || !cfg) {
+        free(cfg);
+        return -1;
+    }
+    memset(app, 0, sizeof(*app));
+    app->ctx.debug_sink = debug_sink;
+    app->config = cfg;
+    g = &app->gens[0];
+
+    rc = apply_options(app, cfg, OPTS_ALL);
+    if (build_sinks(app, g, cfg) < 0) {
+        return -1;
+    }
+    app->ctx.sinks = g->sinks;
+    app->ctx.sink_count = g->count;
+    if (app_context_start(&app->ctx) < 0) {
+        rc = -1;
+    }
+    if (start_aggregate(app, g) < 0) {
+        rc = -1;
+    }
+    return rc;
+}
+
+int runtime_app_stop(RuntimeApp *app) {
+    int rc;
+
+    if (!app || !app->config) {
+        return -1;
+    }
+    /* The last partial window goes out before the transports disconnect. */
+    if (aggregate_sink(&app->gens[app->live])) {
+        policy_aggregate_stop();
+    }
+    rc = app_context_stop(&app->ctx);
+    destroy_sinks(&app->gens[app->live]);
+    app->ctx.sink_count = 0;
+    free(app->config);
+    app->config = NULL;
+    return rc;
+}
+
+int runtime_app_reload(RuntimeApp *app, RuntimeConfig *cfg) {
+    RuntimeSinks *old;
+    RuntimeSinks *next;
+    unsigned int changed;
+    size_t i;
+    int rc = 0;
+
+    if (!app || !cfg) {
+        free(cfg);
+        return -1;
+    }
+    if (!app->config) {
+        return runtime_app_start(app, cfg, app->ctx.debug_sink);
+    }
+    old = &app->gens[app->live];
+    next = &app->gens[!app->live];
+
+    /* Until the new writers run, nothing has touched the old context. */
+    if (build_sinks(app, next, cfg) < 0 || start_writers(app, next) < 0) {
+        destroy_sinks(next);
+        free(cfg);
+        app_error(app, "new configuration could not start; keeping the "
+                       "running one");
+        return -1;
+    }
+
+    /* The old window and rings drain through the old settings. */
+    if (aggregate_sink(old)) {
+        policy_aggregate_stop();
+    }
+    for (i = 0; i < old->count; i++) {
+        if (old->sinks[i].async && old->sinks[i].async->started &&
+            async_log_stop(old->sinks[i].async) < 0) {
+            sink_error(app, &old->sinks[i], "async writer drain failed");
+            rc = -1;
+        }
+    }
+
+    /* Only transports whose options changed are closed to reconfigure. */
+    changed = changed_options(app->config, cfg);
+    for (i = 0; i < old->count; i++) {
+        const LogSink *sink = &old->sinks[i];
+
+        if ((transport_options(sink->transport) & changed) &&
+            !uses_connectable(old, i, connectable_of(sink)) &&
+            close_transport(app, sink) < 0) {
+            rc = -1;
+        }
+    }
+    if (apply_options(app, cfg, changed) < 0) {
+        rc = -1;
+    }
+    for (i = 0; i < next->count; i++) {
+        const LogSink *sink = &next->sinks[i];
+        const Connectable *c = connectable_of(sink);
+
+        if (c && c->connect && !uses_connectable(next, i, c) &&
+            c->connect() < 0) {
+            sink_error(app, sink, "connect capability failed");
+            rc = -1;
+        }
+    }
+    if (start_aggregate(app, next) < 0) {
+        rc = -1;
+    }
+
+    app->ctx.sinks = next->sinks;
+    app->ctx.sink_count = next->count;
+    app->live = !app->live;
+
+    /* Whatever only the old sinks wrote to is closed now. */
+    for (i = 0; i < old->count; i++) {
+        const LogSink *sink = &old->sinks[i];
+        const Connectable *c = connectable_of(sink);
+
+        if (!(transport_options(sink->transport) & changed) &&
+            !uses_connectable(old, i, c) &&
+            !uses_connectable(next, next->count, c) &&
+            close_transport(app, sink) < 0) {
+            rc = -1;
+        }
+    }
+    destroy_sinks(old);
+    free(app->config);
+    app->config = cfg;
+    debug_log(app->ctx.debug_sink, DEBUG_LEVEL_INFO, "config",
+              "configuration reloaded");
+    return rc;
+}
@@ -1,36 +1,936 @@
 #include "interfaces.h"
 #include "config.h"
-#include "stdio.h"
+#include "disk_transport.h"
+#include "iovec_util.h"
+#include "lz4min.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
-static int disk_send(const char *msg, size_t len) {
-    int rc = -1;
-    FILE *fp = fopen(LOG_FILE, "a");
-    size_t w;
+#define DISK_PATH_MAX 256
+#define DISK_SEGMENT_NAME_MAX (DISK_PATH_MAX + 16)
+#define DISK_IOV_CHUNK 64
+
+/*
+ * The log file stays open between connect and disconnect and records are
+ * staged in a user-space buffer, so a send is normally just a memcpy. All
+ * entry points serialise on disk_lock, which is only held for that memcpy
+ * or the occasional write, so concurrent producers never queue on the
+ * kernel's per-file lock. DISK_RESERVABLE hands out the buffer itself, so a
+ * caller can format into it under the lock and skip even the memcpy.
+ *
+ * With flush_interval_ms set, a flusher thread sleeps on flush_wake and
+ * writes the buffer out once it has held bytes for that long, so the tail
+ * of a burst reaches the file while the process is idle. Group commit
+ * writes the buffer out with every group and needs no flusher.
+ *
+ * In group-commit mode every record gets a sequence number and its sender
+ * sleeps on commit_done until durable_seq covers it. The committer thread
+ * writes out the buffer under disk_lock, then runs fdatasync without it so
+ * producers keep staging the next group meanwhile. After a failed
+ * fdatasync the file's state is unknown, so every later wait fails too
+ * until the transport is reconnected.
+ *
+ * Rotation renames the live file to path.NNNNNN and opens a fresh one under
+ * disk_lock; that is two metadata syscalls, never a sync or a copy. The old
+ * descriptor is synced and closed outside the lock (by the committer in
+ * group-commit mode, so senders only raise rotate_due) and the sealed name
+ * goes onto a bounded queue for the compressor thread. A full queue leaves
+ * the segment uncompressed rather than making anyone wait.
+ */
+static struct {
+    int fd;
+    char *buf;
+    size_t used;
+    long long last_flush_ms;
+    char path[DISK_PATH_MAX];
+    size_t buffer_size;
+    unsigned int flush_interval_ms;
+    int fdatasync_on_flush;
+    pthread_t flusher;
+    int flusher_running;
+    int flusher_stop;
+    int group_commit;
+    unsigned int commit_interval_us;
+    size_t commit_batch;
+    pthread_t committer;
+    int committer_running;
+    int committer_stop;
+    unsigned long long appended_seq;   /* records handed to the buffer */
+    unsigned long long committing_seq; /* covered by the commit in flight */
+    unsigned long long durable_seq;    /* covered by a finished fdatasync */
+    long long pending_since_ns;        /* oldest uncommitted record */
+    int commit_errno;
+    DiskCommitStats commit_stats;
+    size_t rotate_bytes;
+    unsigned int rotate_interval_s;
+    int compress;
+    size_t file_bytes;       /* size of the live file */
+    long long opened_ms;     /* when the live file was started */
+    unsigned int rotate_seq; /* next segment number; 0 = not scanned yet */
+    int rotate_due;          /* group commit: committer rotates next round */
+} disk = {
+    .fd = -1,
+    .path = LOG_FILE,
+    .buffer_size = DISK_BUFFER_SIZE,
+    .flush_interval_ms = DISK_FLUSH_INTERVAL_MS,
+    .fdatasync_on_flush = DISK_FDATASYNC_ON_FLUSH,
+    .group_commit = DISK_GROUP_COMMIT,
+    .commit_interval_us = DISK_COMMIT_INTERVAL_US,
+    .commit_batch = DISK_COMMIT_BATCH,
+    .rotate_bytes = DISK_ROTATE_BYTES,
+    .rotate_interval_s = DISK_ROTATE_INTERVAL_S,
+    .compress = DISK_ROTATE_COMPRESS,
+};
+
+/* Compressor state has its own lock so a slow compression never holds
+ * up disk_lock. */
+static struct {
+    pthread_t thread;
+    int running;
+    int stop;
+    char queue[DISK_ROTATE_QUEUE][DISK_SEGMENT_NAME_MAX];
+    unsigned int head;
+    unsigned int count;
+    DiskRotationStats stats;
+} rot;
+
+static pthread_mutex_t disk_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flush_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t commit_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t commit_done = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t rot_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rot_wake = PTHREAD_COND_INITIALIZER;
+
+static long long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* The condvars use CLOCK_REALTIME; turns a wait of ns into a deadline. */
+static void realtime_after(struct timespec *ts, long long ns) {
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += ns / 1000000000LL;
+    ts->tv_nsec += ns % 1000000000LL;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static int write_all(int fd, const char *p, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(fd, p, len);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += w;
+        len -= (size_t)w;
+    }
+    return 0;
+}
+
+static int writev_all(int fd, struct iovec *iov, size_t cnt) {
+    while (cnt > 0) {
+        ssize_t w = writev(fd, iov, (int)cnt);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        iov_advance(&iov, &cnt, (size_t)w);
+    }
+    return 0;
+}
+
+static int disk_write_buffer_locked(void) {
+    if (disk.used > 0) {
+        if (write_all(disk.fd, disk.buf, disk.used) < 0) {
+            return -1;
+        }
+        disk.used = 0;
+    }
+    disk.last_flush_ms = monotonic_ms();
+    return 0;
+}
+
+/* ---- rotation ---- */
+
+static int rotation_enabled(void) {
+    return disk.rotate_bytes > 0 || disk.rotate_interval_s > 0;
+}
+
+static int rotation_due_locked(void) {
+    return (disk.rotate_bytes > 0 && disk.file_bytes >= disk.rotate_bytes) ||
+           (disk.rotate_interval_s > 0 &&
+            monotonic_ms() - disk.opened_ms >=
+                (long long)disk.rotate_interval_s * 1000);
+}
+
+/* One past the highest path.NNNNNN[.lz4] already on disk. */
+static unsigned int rotation_next_seq(void) {
+    const char *slash = strrchr(disk.path, '/');
+    const char *base = slash ? slash + 1 : disk.path;
+    size_t base_len = strlen(base);
+    char dir[DISK_PATH_MAX];
+    unsigned long max = 0;
+    struct dirent *e;
+    DIR *d;
+
+    if (!slash) {
+        strcpy(dir, ".");
+    } else if (slash == disk.path) {
+        strcpy(dir, "/");
+    } else {
+        memcpy(dir, disk.path, (size_t)(slash - disk.path));
+        dir[slash - disk.path] = '\0';
+    }
+
+    d = opendir(dir);
+    if (!d) {
+        return 1;
+    }
+    while ((e = readdir(d)) != NULL) {
+        const char *p = e->d_name;
+        char *end;
+        unsigned long v;
+
+        if (strncmp(p, base, base_len) != 0 || p[base_len] != '.' ||
+            p[base_len + 1] < '0' || p[base_len + 1] > '9') {
+            continue;
+        }
+        v = strtoul(p + base_len + 1, &end, 10);
+        if ((*end == '\0' || strcmp(end, ".lz4") == 0) && v > max &&
+            v < UINT_MAX) {
+            max = v;
+        }
+    }
+    closedir(d);
+    return (unsigned int)max + 1;
+}
+
+static int segment_name(char *out, size_t size, unsigned int seq) {
+    int n = snprintf(out, size, "%s.%06u", disk.path, seq);
+    return n < 0 || (size_t)n >= size ? -1 : 0;
+}
+
+/*
+ * Writes out the buffer, renames the live file to the next segment name
+ * and opens a fresh one in its place. Returns the old descriptor for the
+ * caller to sync and close outside disk_lock, or -1 if the file could not
+ * be rotated; it then stays in use and the next attempt waits another
+ * full period.
+ */
+static int disk_swap_file_locked(char *sealed, size_t size) {
+    int old = disk.fd;
+    int fd;
+
+    if (disk_write_buffer_locked() < 0 ||
+        segment_name(sealed, size, disk.rotate_seq) < 0 ||
+        rename(disk.path, sealed) < 0) {
+        goto defer;
+    }
+    fd = open(disk.path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        rename(sealed, disk.path);
+        goto defer;
+    }
+    disk.fd = fd;
+    disk.file_bytes = 0;
+    disk.opened_ms = monotonic_ms();
+    disk.rotate_seq++;
+    return old;
+
+defer:
+    disk.file_bytes = 0;
+    disk.opened_ms = monotonic_ms();
+    return -1;
+}
+
+/* Compresses name into name.lz4 via a temporary file, then removes it. */
+static int compress_segment(const char *name) {
+    char tmp[DISK_SEGMENT_NAME_MAX + 8];
+    char out[DISK_SEGMENT_NAME_MAX + 8];
+    int in_fd;
+    int out_fd;
+    int rc;
+
+    snprintf(out, sizeof(out), "%s.lz4", name);
+    snprintf(tmp, sizeof(tmp), "%s.lz4.tmp", name);
+    in_fd = open(name, O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) {
+        return -1;
+    }
+    out_fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (out_fd < 0) {
+        close(in_fd);
+        return -1;
+    }
+    posix_fadvise(in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    /* The .lz4 must be durable before the plain segment goes away. */
+    rc = lz4min_compress_fd(in_fd, out_fd);
+    if (rc == 0 && fdatasync(out_fd) < 0) {
+        rc = -1;
+    }
+    if (close(out_fd) < 0) {
+        rc = -1;
+    }
+    close(in_fd);
+
+    if (rc == 0 && rename(tmp, out) == 0) {
+        unlink(name);
+        return 0;
+    }
+    unlink(tmp);
+    return -1;
+}
+
+static void *compressor_main(void *arg) {
+    char name[DISK_SEGMENT_NAME_MAX];
+    (void)arg;
+
+    pthread_mutex_lock(&rot_lock);
+    for (;;) {
+        int rc;
+
+        while (rot.count == 0 && !rot.stop) {
+            pthread_cond_wait(&rot_wake, &rot_lock);
+        }
+        if (rot.count == 0) {
+            break; /* stopping with the queue drained */
+        }
+        strcpy(name, rot.queue[rot.head]);
+        rot.head = (rot.head + 1) % DISK_ROTATE_QUEUE;
+        rot.count--;
+        pthread_mutex_unlock(&rot_lock);
+
+        rc = compress_segment(name);
+
+        pthread_mutex_lock(&rot_lock);
+        if (rc == 0) {
+            rot.stats.compressed++;
+        } else {
+            rot.stats.compress_failed++;
+        }
+    }
+    pthread_mutex_unlock(&rot_lock);
+    return NULL;
+}
+
+static void compressor_start(void) {
+    pthread_mutex_lock(&rot_lock);
+    if (!rot.running) {
+        rot.stop = 0;
+        rot.running =
+            pthread_create(&rot.thread, NULL, compressor_main, NULL) == 0;
+    }
+    pthread_mutex_unlock(&rot_lock);
+}
+
+/* Lets the compressor finish what is queued, then joins it. */
+static void compressor_stop(void) {
+    pthread_mutex_lock(&rot_lock);
+    if (!rot.running) {
+        pthread_mutex_unlock(&rot_lock);
+        return;
+    }
+    rot.stop = 1;
+    pthread_cond_signal(&rot_wake);
+    pthread_mutex_unlock(&rot_lock);
+
+    pthread_join(rot.thread, NULL);
+
+    pthread_mutex_lock(&rot_lock);
+    rot.running = 0;
+    pthread_mutex_unlock(&rot_lock);
+}
+
+/* Records a sealed segment and queues it for compression if possible. */
+static void rotation_sealed(const char *name) {
+    pthread_mutex_lock(&rot_lock);
+    rot.stats.rotations++;
+    if (rot.running) {
+        if (rot.count < DISK_ROTATE_QUEUE) {
+            unsigned int tail = (rot.head + rot.count) % DISK_ROTATE_QUEUE;
+            strcpy(rot.queue[tail], name);
+            rot.count++;
+            pthread_cond_signal(&rot_wake);
+        } else {
+            rot.stats.compress_skipped++;
+        }
+    }
+    pthread_mutex_unlock(&rot_lock);
+}
+
+/* Finishes a descriptor returned by disk_swap_file_locked, unlocked. */
+static void disk_retire_segment(int fd, const char *name, int sync) {
+    if (sync) {
+        fdatasync(fd);
+    }
+    close(fd);
+    rotation_sealed(name);
+}
+
+/*
+ * Called after a send staged its bytes. Returns an old descriptor to
+ * retire once disk_lock is dropped, or -1. In group-commit mode the
+ * committer owns the swap and this only flags it.
+ */
+static int disk_check_rotation_locked(char *sealed, size_t size) {
+    if (!rotation_enabled() || !rotation_due_locked()) {
+        return -1;
+    }
+    if (disk.committer_running) {
+        disk.rotate_due = 1;
+        return -1;
+    }
+    return disk_swap_file_locked(sealed, size);
+}
+
+/* ---- group commit ---- */
+
+static void max_into(unsigned long long *max, unsigned long long v) {
+    if (v > *max) {
+        *max = v;
+    }
+}
+
+/* Sleeps until a group is due: batch reached, interval passed, or stop. */
+static void committer_wait_for_group(void) {
+    while (!disk.committer_stop && disk.appended_seq == disk.durable_seq) {
+        pthread_cond_wait(&commit_wake, &disk_lock);
+    }
+    while (!disk.committer_stop && disk.commit_interval_us > 0 &&
+           (disk.commit_batch == 0 ||
+            disk.appended_seq - disk.durable_seq < disk.commit_batch)) {
+        long long deadline = disk.pending_since_ns +
+                             (long long)disk.commit_interval_us * 1000;
+        struct timespec ts;
+
+        if (monotonic_ns() >= deadline) {
+            break;
+        }
+        realtime_after(&ts, deadline - monotonic_ns());
+        pthread_cond_timedwait(&commit_wake, &disk_lock, &ts);
+    }
+}
+
+static void *committer_main(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&disk_lock);
+    for (;;) {
+        char sealed[DISK_SEGMENT_NAME_MAX];
+        unsigned long long target;
+        long long t0;
+        long long spent;
+        int old = -1;
+        int fd;
+        int rc;
+        int err = 0;
+
+        committer_wait_for_group();
+        if (disk.appended_seq == disk.durable_seq) {
+            break; /* stopping with nothing left to commit */
+        }
+
+        target = disk.appended_seq;
+        disk.committing_seq = target;
+        if (disk.rotate_due) {
+            /* The group's bytes land in the old file; sync that one. */
+            disk.rotate_due = 0;
+            old = disk_swap_file_locked(sealed, sizeof(sealed));
+        }
+        rc = old >= 0 ? 0 : disk_write_buffer_locked();
+        err = errno;
+        fd = old >= 0 ? old : disk.fd;
+        pthread_mutex_unlock(&disk_lock);
+
+        t0 = monotonic_ns();
+        if (rc == 0) {
+            rc = fdatasync(fd);
+            err = errno;
+        }
+        spent = monotonic_ns() - t0;
+        if (old >= 0) {
+            disk_retire_segment(old, sealed, 0);
+        }
+
+        pthread_mutex_lock(&disk_lock);
+        if (rc == 0 && disk.commit_errno == 0) {
+            disk.commit_stats.records += target - disk.durable_seq;
+        } else {
+            disk.commit_stats.failures++;
+            if (disk.commit_errno == 0) {
+                disk.commit_errno = err ? err : EIO;
+            }
+        }
+        disk.durable_seq = target;
+        disk.commit_stats.commits++;
+        disk.commit_stats.sync_ns_total += (unsigned long long)spent;
+        max_into(&disk.commit_stats.sync_ns_max, (unsigned long long)spent);
+        pthread_cond_broadcast(&commit_done);
+    }
+    pthread_mutex_unlock(&disk_lock);
+    return NULL;
+}
+
+/*
+ * Called after n records were staged: hands them to the committer and
+ * sleeps until an fdatasync covers them.
+ */
+static int disk_wait_durable_locked(size_t n) {
+    unsigned long long ticket;
+    long long t0 = monotonic_ns();
+    long long waited;
+
+    if (disk.appended_seq == disk.committing_seq) {
+        disk.pending_since_ns = t0;
+        pthread_cond_signal(&commit_wake);
+    }
+    disk.appended_seq += n;
+    ticket = disk.appended_seq;
+    if (disk.commit_batch > 0 &&
+        disk.appended_seq - disk.durable_seq >= disk.commit_batch) {
+        pthread_cond_signal(&commit_wake);
+    }
+
+    while (disk.durable_seq < ticket && disk.committer_running) {
+        pthread_cond_wait(&commit_done, &disk_lock);
+    }
+
+    waited = monotonic_ns() - t0;
+    disk.commit_stats.waits++;
+    disk.commit_stats.wait_ns_total += (unsigned long long)waited;
+    max_into(&disk.commit_stats.wait_ns_max, (unsigned long long)waited);
+
+    if (disk.commit_errno != 0 || disk.durable_seq < ticket) {
+        errno = disk.commit_errno ? disk.commit_errno : EIO;
+        return -1;
+    }
+    return 0;
+}
+
+static int disk_start_committer(void) {
+    disk.committer_stop = 0;
+    disk.commit_errno = 0;
+    disk.appended_seq = 0;
+    disk.committing_seq = 0;
+    disk.durable_seq = 0;
+    if (pthread_create(&disk.committer, NULL, committer_main, NULL) != 0) {
+        return -1;
+    }
+    disk.committer_running = 1;
+    return 0;
+}
+
+/* ---- interval flush ---- */
+
+static int disk_flush_locked(void);
+
+/*
+ * Sleeps until the buffer has held bytes for flush_interval_ms, then writes
+ * it out. A failed write leaves the bytes staged; the next send or flush
+ * retries and reports it.
+ */
+static void *flusher_main(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&disk_lock);
+    while (!disk.flusher_stop) {
+        long long wait_ms = disk.flush_interval_ms;
+        struct timespec ts;
+
+        if (disk.used > 0) {
+            long long left = disk.last_flush_ms + disk.flush_interval_ms -
+                             monotonic_ms();
+
+            if (left <= 0) {
+                (void)disk_flush_locked();
+            } else {
+                wait_ms = left;
+            }
+        }
+        realtime_after(&ts, wait_ms * 1000000LL);
+        pthread_cond_timedwait(&flush_wake, &disk_lock, &ts);
+    }
+    pthread_mutex_unlock(&disk_lock);
+    return NULL;
+}
+
+static int disk_start_flusher(void) {
+    disk.flusher_stop = 0;
+    if (pthread_create(&disk.flusher, NULL, flusher_main, NULL) != 0) {
+        return -1;
+    }
+    disk.flusher_running = 1;
+    return 0;
+}
+
+/* Called with disk_lock held; drops it while the flusher exits. */
+static void disk_stop_flusher_locked(void) {
+    if (!disk.flusher_running) {
+        return;
+    }
+    disk.flusher_stop = 1;
+    pthread_cond_signal(&flush_wake);
+    pthread_mutex_unlock(&disk_lock);
+    pthread_join(disk.flusher, NULL);
+    pthread_mutex_lock(&disk_lock);
+    disk.flusher_running = 0;
+}
+
+static int disk_open(void) {
+    struct stat st;
+
+    if (disk.fd >= 0) {
+        return 0;
+    }
+
+    if (!disk.buf) {
+        disk.buf = malloc(disk.buffer_size);
+        if (!disk.buf) {
+            return -1;
+        }
+    }
+    disk.fd = open(disk.path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    if (disk.fd < 0) {
+        return -1;
+    }
+    disk.used = 0;
+    disk.last_flush_ms = monotonic_ms();
+    disk.opened_ms = disk.last_flush_ms;
+    disk.file_bytes = fstat(disk.fd, &st) == 0 ? (size_t)st.st_size : 0;
+    disk.rotate_due = 0;
+    if (disk.group_commit && disk_start_committer() < 0) {
+        close(disk.fd);
+        disk.fd = -1;
+        return -1;
+    }
+    if (!disk.group_commit && disk.flush_interval_ms > 0 &&
+        disk_start_flusher() < 0) {
+        close(disk.fd);
+        disk.fd = -1;
+        return -1;
+    }
+    if (rotation_enabled()) {
+        if (disk.rotate_seq == 0) {
+            disk.rotate_seq = rotation_next_seq();
+        }
+        if (disk.compress) {
+            compressor_start(); /* without it segments stay plain */
+        }
+    }
+    return 0;
+}
+
+static int disk_flush_locked(void) {
+    if (disk.fd < 0) {
+        return 0;
+    }
 
+    if (disk_write_buffer_locked() < 0) {
+        return -1;
+    }
+    if (disk.fdatasync_on_flush && fdatasync(disk.fd) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Writes the buffer out once flush_interval_ms has passed since the last. */
+static int disk_flush_if_due_locked(void) {
+    if (disk.flush_interval_ms > 0 &&
+        monotonic_ms() - disk.last_flush_ms >=
+            (long long)disk.flush_interval_ms) {
+        return disk_flush_locked();
+    }
+    return 0;
+}
+
+static int disk_send_locked(const char *msg, size_t len) {
     if (!msg) {
         return -1;
     }
-    if (!fp) {
+    if (disk_open() < 0) {
+        return -1;
+    }
+
+    if (disk.used + len > disk.buffer_size) {
+        if (disk_flush_locked() < 0) {
+            return -1;
+        }
+        if (len > disk.buffer_size) {
+            disk.file_bytes += len;
+            return write_all(disk.fd, msg, len);
+        }
+    }
+
+    memcpy(disk.buf + disk.used, msg, len);
+    disk.used += len;
+    disk.file_bytes += len;
+    return disk_flush_if_due_locked();
+}
+
+static int disk_send_batch_locked(const struct iovec *iov, size_t n) {
+    size_t total;
+    size_t i;
+
+    if (!iov) {
+        return -1;
+    }
+    if (disk_open() < 0) {
         return -1;
     }
 
-    w = fwrite(msg, 1, len, fp);
-    if (w == len) {
-        rc = 0;
+    total = iov_total(iov, n);
+    disk.file_bytes += total;
+    if (disk.used + total <= disk.buffer_size) {
+        for (i = 0; i < n; i++) {
+            memcpy(disk.buf + disk.used, iov[i].iov_base, iov[i].iov_len);
+            disk.used += iov[i].iov_len;
+        }
+        return disk_flush_if_due_locked();
+    }
+
+    /* Too big to stage: write pending bytes and the batch in one writev. */
+    while (n > 0) {
+        struct iovec chunk[DISK_IOV_CHUNK];
+        size_t cnt = 0;
+
+        if (disk.used > 0) {
+            chunk[cnt].iov_base = disk.buf;
+            chunk[cnt].iov_len = disk.used;
+            cnt++;
+        }
+        while (cnt < DISK_IOV_CHUNK && n > 0) {
+            chunk[cnt++] = *iov++;
+            n--;
+        }
+        if (writev_all(disk.fd, chunk, cnt) < 0) {
+            return -1;
+        }
+        disk.used = 0;
+    }
+    disk.last_flush_ms = monotonic_ms();
+    return 0;
+}
+
+static int disk_connect_locked(void) {
+    return disk_open();
+}
+
+/* With rotation on, the live file is sealed as a segment; *sealed says so. */
+static int disk_disconnect_locked(char *sealed, size_t size, int *sealed_ok) {
+    int rc;
+
+    *sealed_ok = 0;
+    if (disk.fd < 0) {
+        return 0;
     }
 
-    fclose(fp);
+    rc = disk_flush_locked();
+    if (rc == 0 && rotation_enabled() && disk.file_bytes > 0 &&
+        segment_name(sealed, size, disk.rotate_seq) == 0 &&
+        rename(disk.path, sealed) == 0) {
+        disk.rotate_seq++;
+        *sealed_ok = 1;
+    }
+    if (close(disk.fd) < 0) {
+        rc = -1;
+    }
+    disk.fd = -1;
+    free(disk.buf);
+    disk.buf = NULL;
     return rc;
 }
 
+/*
+ * Common tail of every staging entry point, called with disk_lock held
+ * after n records were staged: rotates if due, waits for group commit and
+ * drops the lock.
+ */
+static int disk_staged_unlock(int rc, size_t n) {
+    char sealed[DISK_SEGMENT_NAME_MAX];
+    int old = -1;
+
+    if (rc == 0) {
+        old = disk_check_rotation_locked(sealed, sizeof(sealed));
+    }
+    if (rc == 0 && n > 0 && disk.committer_running) {
+        rc = disk_wait_durable_locked(n);
+    }
+    pthread_mutex_unlock(&disk_lock);
+    if (old >= 0) {
+        disk_retire_segment(old, sealed, disk.fdatasync_on_flush);
+    }
+    return rc;
+}
+
+static int disk_send(const char *msg, size_t len) {
+    pthread_mutex_lock(&disk_lock);
+    return disk_staged_unlock(disk_send_locked(msg, len), 1);
+}
+
+static int disk_send_batch(const struct iovec *iov, size_t n) {
+    pthread_mutex_lock(&disk_lock);
+    return disk_staged_unlock(disk_send_batch_locked(iov, n), n);
+}
+
+/* Holds disk_lock until the matching disk_commit. */
+static char *disk_reserve(size_t size) {
+    pthread_mutex_lock(&disk_lock);
+    if (disk_open() < 0 ||
+        (disk.used + size > disk.buffer_size && disk_flush_locked() < 0) ||
+        size > disk.buffer_size) {
+        pthread_mutex_unlock(&disk_lock);
+        return NULL;
+    }
+    return disk.buf + disk.used;
+}
+
+static int disk_commit(size_t used) {
+    int rc = 0;
+
+    disk.used += used;
+    disk.file_bytes += used;
+    if (used > 0) {
+        rc = disk_flush_if_due_locked();
+    }
+    return disk_staged_unlock(rc, used > 0);
+}
+
 static int disk_flush(void) {
+    int rc;
+    pthread_mutex_lock(&disk_lock);
+    rc = disk_flush_locked();
+    pthread_mutex_unlock(&disk_lock);
+    return rc;
+}
+
+static int disk_connect(void) {
+    int rc;
+    pthread_mutex_lock(&disk_lock);
+    rc = disk_connect_locked();
+    pthread_mutex_unlock(&disk_lock);
+    return rc;
+}
+
+static int disk_disconnect(void) {
+    char sealed[DISK_SEGMENT_NAME_MAX];
+    int sealed_ok;
+    int rc;
+
+    pthread_mutex_lock(&disk_lock);
+    if (disk.committer_running) {
+        /* The committer needs disk_lock to finish its last group. */
+        disk.committer_stop = 1;
+        pthread_cond_signal(&commit_wake);
+        pthread_mutex_unlock(&disk_lock);
+        pthread_join(disk.committer, NULL);
+        pthread_mutex_lock(&disk_lock);
+        disk.committer_running = 0;
+        pthread_cond_broadcast(&commit_done);
+    }
+    disk_stop_flusher_locked();
+    rc = disk_disconnect_locked(sealed, sizeof(sealed), &sealed_ok);
+    pthread_mutex_unlock(&disk_lock);
+    if (sealed_ok) {
+        rotation_sealed(sealed);
+    }
+    compressor_stop();
+    return rc;
+}
+
+static int disk_configure_locked(const DiskTransportOptions *opts) {
+    const char *path;
+
+    if (!opts || disk.fd >= 0) {
+        return -1;
+    }
+
+    path = opts->path ? opts->path : LOG_FILE;
+    if (strlen(path) >= sizeof(disk.path)) {
+        return -1;
+    }
+
+    free(disk.buf);
+    disk.buf = NULL;
+    strcpy(disk.path, path);
+    disk.buffer_size = opts->buffer_size ? opts->buffer_size : DISK_BUFFER_SIZE;
+    disk.flush_interval_ms = opts->flush_interval_ms;
+    disk.fdatasync_on_flush = opts->fdatasync_on_flush;
+    disk.group_commit = opts->group_commit;
+    disk.commit_interval_us = opts->commit_interval_us;
+    disk.commit_batch = opts->commit_batch;
+    disk.rotate_bytes = opts->rotate_bytes;
+    disk.rotate_interval_s = opts->rotate_interval_s;
+    disk.compress = opts->compress;
+    disk.rotate_seq = 0;
     return 0;
 }
 
+int disk_transport_configure(const DiskTransportOptions *opts) {
+    int rc;
+    pthread_mutex_lock(&disk_lock);
+    rc = disk_configure_locked(opts);
+    pthread_mutex_unlock(&disk_lock);
+    return rc;
+}
+
+void disk_transport_commit_stats(DiskCommitStats *out) {
+    if (!out) {
+        return;
+    }
+    pthread_mutex_lock(&disk_lock);
+    *out = disk.commit_stats;
+    pthread_mutex_unlock(&disk_lock);
+}
+
+void disk_transport_rotation_stats(DiskRotationStats *out) {
+    if (!out) {
+        return;
+    }
+    pthread_mutex_lock(&rot_lock);
+    *out = rot.stats;
+    pthread_mutex_unlock(&rot_lock);
+}
+
 const Sender DISK_SENDER = { .send = disk_send };
+const BatchSender DISK_BATCH_SENDER = { .send_batch = disk_send_batch };
 const Flushable DISK_FLUSHABLE = { .flush = disk_flush };
+const Reservable DISK_RESERVABLE = {
+    .reserve = disk_reserve,
+    .commit = disk_commit,
+};
+const Connectable DISK_CONNECTABLE = {
+    .connect = disk_connect,
+    .disconnect = disk_disconnect,
+};
 const Transport DISK_TRANSPORT = {
     .sender = &DISK_SENDER,
+    .batch_sender = &DISK_BATCH_SENDER,
     .flushable = &DISK_FLUSHABLE,
-    .connectable = NULL,
+    .connectable = &DISK_CONNECTABLE,
+    .reservable = &DISK_RESERVABLE,
 };
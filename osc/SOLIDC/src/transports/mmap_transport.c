@@ -0,0 +1,382 @@
+#include "interfaces.h"
+#include "config.h"
+#include "iovec_util.h"
+#include "mmap_transport.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MMAP_PATH_MAX 256
+#define MMAP_SEQ_MAX 999999u
+
+/*
+ * Append-only log made of preallocated, memory-mapped segment files.
+ *
+ * A send reserves its range with one atomic add on the segment tail and
+ * copies the record in, so the hot path makes no system calls and takes no
+ * lock. The writer whose reservation runs past the end rolls to the next
+ * segment under mmap_lock: it maps the new file, publishes it, waits for
+ * writers still copying into the old one, then truncates the old file to
+ * the bytes actually written and unmaps it.
+ *
+ * Writers pin a segment (writers count) before re-checking that it is still
+ * current, so the roller's wait covers every copy in flight. The two
+ * segment slots alternate; a stale writer that pins a retired slot sees it
+ * is not current and lets go without touching it.
+ */
+typedef struct MmapSegment {
+    _Atomic size_t tail;    /* next reservation offset; may pass size */
+    _Atomic size_t end;     /* lowest overflowing reservation = bytes used */
+    _Atomic size_t committed; /* bytes fully copied in */
+    _Atomic unsigned int writers;
+    char *base;
+    size_t size;
+    int fd;
+} MmapSegment;
+
+static struct {
+    MmapSegment slots[2];
+    MmapSegment *_Atomic current;
+    size_t synced; /* bytes of current already msync'ed */
+    unsigned int seq;
+    char path[MMAP_PATH_MAX];
+    size_t segment_size;
+} mm = {
+    .path = LOG_FILE,
+    .segment_size = MMAP_SEGMENT_SIZE,
+};
+
+static pthread_mutex_t mmap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int segment_name(char *out, size_t sz, unsigned int seq) {
+    int n = snprintf(out, sz, "%s.%06u", mm.path, seq);
+    return n < 0 || (size_t)n >= sz ? -1 : 0;
+}
+
+/* Continues numbering after the last segment left by a previous run. */
+static unsigned int next_free_seq(void) {
+    char name[MMAP_PATH_MAX + 16];
+    struct stat st;
+    unsigned int seq = 1;
+
+    while (seq < MMAP_SEQ_MAX && segment_name(name, sizeof(name), seq) == 0 &&
+           stat(name, &st) == 0) {
+        seq++;
+    }
+    return seq;
+}
+
+static int segment_open(MmapSegment *s) {
+    char name[MMAP_PATH_MAX + 16];
+    int err;
+    int fd;
+
+    if (mm.seq > MMAP_SEQ_MAX || segment_name(name, sizeof(name), mm.seq) < 0) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    fd = open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        return -1;
+    }
+    err = posix_fallocate(fd, 0, (off_t)mm.segment_size);
+    if (err != 0) {
+        close(fd);
+        unlink(name);
+        errno = err;
+        return -1;
+    }
+    s->base = mmap(NULL, mm.segment_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+    if (s->base == MAP_FAILED) {
+        s->base = NULL;
+        close(fd);
+        unlink(name);
+        return -1;
+    }
+
+    s->fd = fd;
+    s->size = mm.segment_size;
+    atomic_store(&s->end, mm.segment_size);
+    atomic_store(&s->committed, 0);
+    atomic_store(&s->tail, 0);
+    mm.seq++;
+    return 0;
+}
+
+/*
+ * Syncs what the flushes have not covered yet (synced bytes already are),
+ * trims the preallocated tail and releases a segment nobody writes to, so
+ * a flush after a roll still covers every record sent before it.
+ */
+static int segment_seal(MmapSegment *s, size_t synced) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t used = atomic_load(&s->end);
+    size_t tail = atomic_load(&s->tail);
+    size_t from;
+    int rc = 0;
+
+    if (tail < used) {
+        used = tail;
+    }
+    from = synced & ~(page - 1);
+    if (used > from && msync(s->base + from, used - from, MS_SYNC) < 0) {
+        rc = -1;
+    }
+    if (munmap(s->base, s->size) < 0) {
+        rc = -1;
+    }
+    if (ftruncate(s->fd, (off_t)used) < 0) {
+        rc = -1;
+    }
+    if (close(s->fd) < 0) {
+        rc = -1;
+    }
+    s->base = NULL;
+    s->fd = -1;
+    return rc;
+}
+
+static void wait_for_writers(MmapSegment *s) {
+    while (atomic_load(&s->writers) != 0) {
+        sched_yield();
+    }
+}
+
+static int mmap_connect_locked(void) {
+    MmapSegment *s;
+
+    if (atomic_load(&mm.current)) {
+        return 0;
+    }
+    mm.seq = next_free_seq();
+    s = &mm.slots[0];
+    if (segment_open(s) < 0) {
+        return -1;
+    }
+    mm.synced = 0;
+    atomic_store(&mm.current, s);
+    return 0;
+}
+
+/* Called by a writer whose reservation overflowed `full`. */
+static int mmap_roll(MmapSegment *full) {
+    MmapSegment *next;
+    int rc = 0;
+
+    pthread_mutex_lock(&mmap_lock);
+    if (atomic_load(&mm.current) != full) {
+        pthread_mutex_unlock(&mmap_lock); /* someone else already rolled */
+        return 0;
+    }
+
+    next = full == &mm.slots[0] ? &mm.slots[1] : &mm.slots[0];
+    if (segment_open(next) < 0) {
+        pthread_mutex_unlock(&mmap_lock);
+        return -1;
+    }
+    atomic_store(&mm.current, next);
+
+    wait_for_writers(full);
+    if (segment_seal(full, mm.synced) < 0) {
+        rc = -1;
+    }
+    mm.synced = 0;
+    pthread_mutex_unlock(&mmap_lock);
+    return rc;
+}
+
+/* Lowers s->end to off if off is the first reservation that overflowed. */
+static void mark_end(MmapSegment *s, size_t off) {
+    size_t end = atomic_load_explicit(&s->end, memory_order_relaxed);
+
+    while (off < end && !atomic_compare_exchange_weak_explicit(
+                            &s->end, &end, off, memory_order_relaxed,
+                            memory_order_relaxed)) {
+    }
+}
+
+/*
+ * Reserves len bytes in the current segment and returns the pinned segment
+ * with *off set; the caller copies and then drops the pin.
+ */
+static MmapSegment *mmap_reserve(size_t len, size_t *off) {
+    for (;;) {
+        MmapSegment *s = atomic_load(&mm.current);
+
+        if (!s) {
+            int rc;
+            pthread_mutex_lock(&mmap_lock);
+            rc = mmap_connect_locked();
+            pthread_mutex_unlock(&mmap_lock);
+            if (rc < 0) {
+                return NULL;
+            }
+            continue;
+        }
+        if (len > s->size) {
+            errno = EMSGSIZE;
+            return NULL;
+        }
+
+        atomic_fetch_add(&s->writers, 1);
+        if (s != atomic_load(&mm.current)) {
+            atomic_fetch_sub(&s->writers, 1);
+            continue;
+        }
+
+        *off = atomic_fetch_add_explicit(&s->tail, len, memory_order_relaxed);
+        if (*off + len <= s->size) {
+            return s;
+        }
+
+        mark_end(s, *off);
+        atomic_fetch_sub(&s->writers, 1);
+        if (mmap_roll(s) < 0) {
+            return NULL;
+        }
+    }
+}
+
+static void mmap_release(MmapSegment *s, size_t len) {
+    atomic_fetch_add_explicit(&s->committed, len, memory_order_release);
+    atomic_fetch_sub_explicit(&s->writers, 1, memory_order_release);
+}
+
+static int mmap_send(const char *msg, size_t len) {
+    MmapSegment *s;
+    size_t off;
+
+    if (!msg) {
+        return -1;
+    }
+    s = mmap_reserve(len, &off);
+    if (!s) {
+        return -1;
+    }
+    memcpy(s->base + off, msg, len);
+    mmap_release(s, len);
+    return 0;
+}
+
+/* The whole batch lands contiguously in one segment. */
+static int mmap_send_batch(const struct iovec *iov, size_t n) {
+    size_t total = iov_total(iov, n);
+    MmapSegment *s;
+    size_t off;
+    size_t i;
+
+    if (!iov && n > 0) {
+        return -1;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    s = mmap_reserve(total, &off);
+    if (!s) {
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        memcpy(s->base + off, iov[i].iov_base, iov[i].iov_len);
+        off += iov[i].iov_len;
+    }
+    mmap_release(s, total);
+    return 0;
+}
+
+/*
+ * msync()s the range written since the last flush of this segment. The
+ * starting point only moves on when no copy was in flight, so a record
+ * still being copied during one flush is covered by the next.
+ */
+static int mmap_flush(void) {
+    MmapSegment *s;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t upto;
+    size_t end;
+    size_t from;
+    int quiescent;
+    int rc = 0;
+
+    pthread_mutex_lock(&mmap_lock);
+    s = atomic_load(&mm.current);
+    if (s) {
+        upto = atomic_load(&s->tail);
+        end = atomic_load(&s->end);
+        if (upto > end) {
+            upto = end;
+        }
+        quiescent = atomic_load_explicit(&s->committed,
+                                         memory_order_acquire) == upto;
+        from = mm.synced & ~(page - 1);
+        if (upto > from) {
+            rc = msync(s->base + from, upto - from, MS_SYNC);
+            if (rc == 0 && quiescent) {
+                mm.synced = upto;
+            }
+        }
+    }
+    pthread_mutex_unlock(&mmap_lock);
+    return rc;
+}
+
+static int mmap_connect(void) {
+    int rc;
+    pthread_mutex_lock(&mmap_lock);
+    rc = mmap_connect_locked();
+    pthread_mutex_unlock(&mmap_lock);
+    return rc;
+}
+
+static int mmap_disconnect(void) {
+    MmapSegment *s;
+    int rc = 0;
+
+    pthread_mutex_lock(&mmap_lock);
+    s = atomic_load(&mm.current);
+    if (s) {
+        atomic_store(&mm.current, NULL);
+        wait_for_writers(s);
+        rc = segment_seal(s, mm.synced);
+    }
+    pthread_mutex_unlock(&mmap_lock);
+    return rc;
+}
+
+int mmap_transport_configure(const MmapTransportOptions *opts) {
+    const char *path;
+    int rc = -1;
+
+    pthread_mutex_lock(&mmap_lock);
+    path = opts && opts->path ? opts->path : LOG_FILE;
+    if (opts && !atomic_load(&mm.current) && strlen(path) < sizeof(mm.path)) {
+        strcpy(mm.path, path);
+        mm.segment_size =
+            opts->segment_size ? opts->segment_size : MMAP_SEGMENT_SIZE;
+        rc = 0;
+    }
+    pthread_mutex_unlock(&mmap_lock);
+    return rc;
+}
+
+const Sender MMAP_SENDER = { .send = mmap_send };
+const BatchSender MMAP_BATCH_SENDER = { .send_batch = mmap_send_batch };
+const Flushable MMAP_FLUSHABLE = { .flush = mmap_flush };
+const Connectable MMAP_CONNECTABLE = {
+    .connect = mmap_connect,
+    .disconnect = mmap_disconnect,
+};
+const Transport MMAP_TRANSPORT = {
+    .sender = &MMAP_SENDER,
+    .batch_sender = &MMAP_BATCH_SENDER,
+    .flushable = &MMAP_FLUSHABLE,
+    .connectable = &MMAP_CONNECTABLE,
+};
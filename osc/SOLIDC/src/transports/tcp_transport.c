@@ -1,13 +1,130 @@
 #include "interfaces.h"
 #include "config.h"
+#include "tcp_transport.h"
+#include "iovec_util.h"
 #include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 
+#define TCP_HOST_MAX 64
+#define TCP_PATH_MAX 256
+#define TCP_IOV_CHUNK 64
+#define TCP_SPOOL_IOV 256
+
+/*
+ * One long-lived connection shared by every send, behind a circuit breaker.
+ * A failed send or connect opens the breaker: until the backoff (doubling
+ * up to backoff_max_ms) runs out, sends park their records without touching
+ * the network. The next send after that is the half-open probe, a connect
+ * bounded by connect_timeout_ms; success closes the breaker. A send that
+ * makes no progress for send_timeout_ms (a collector that stopped reading
+ * but kept the connection) fails like any other.
+ *
+ * Parked records go to a bounded in-memory replay buffer and, once that is
+ * full, to an append-only spool file of native-endian [u32 len][record]
+ * frames. On reconnect the buffer is replayed first, then the spool in file
+ * order, TCP_SPOOL_CHUNK per read; a send replays at most
+ * TCP_SPOOL_DRAIN_BYTES of spool and parks its own record behind the rest,
+ * so order holds without one caller paying for the whole backlog. Delivery
+ * is at-least-once: a chunk that fails mid-send is resent whole. The one
+ * exception is a collector that goes away between peeks (see
+ * tcp_peer_closed): the send that meets its RST loses what it wrote.
+ *
+ * Entry points serialise on tcp_lock so concurrent callers share the one
+ * stream.
+ */
+static struct {
+    int fd;
+    char host[TCP_HOST_MAX];
+    unsigned short port;
+    int nodelay;
+    int cork;
+    unsigned int backoff_initial_ms;
+    unsigned int backoff_max_ms;
+    unsigned int backoff_ms;
+    long long next_attempt_ms;
+    long long next_peek_ms;
+    char *replay;
+    size_t replay_cap;
+    size_t replay_len;
+    size_t replay_records;
+    unsigned int connect_timeout_ms;
+    unsigned int send_timeout_ms;
+    char spool_path[TCP_PATH_MAX];
+    size_t spool_max;
+    int spool_fd; /* opened on first spill, or at connect to replay */
+    off_t spool_read;
+    off_t spool_end;
+    char *spool_buf;
+    size_t spool_buf_cap;
+    TcpTransportStats stats;
+} tcp = {
+    .fd = -1,
+    .host = LOG_HOST,
+    .port = LOG_PORT,
+    .nodelay = TCP_NODELAY_ENABLED,
+    .cork = TCP_CORK_ENABLED,
+    .backoff_initial_ms = TCP_BACKOFF_INITIAL_MS,
+    .backoff_max_ms = TCP_BACKOFF_MAX_MS,
+    .replay_cap = TCP_REPLAY_BUFFER_SIZE,
+    .connect_timeout_ms = TCP_CONNECT_TIMEOUT_MS,
+    .send_timeout_ms = TCP_SEND_TIMEOUT_MS,
+    .spool_path = TCP_SPOOL_PATH,
+    .spool_max = TCP_SPOOL_MAX_BYTES,
+    .spool_fd = -1,
+};
+
+static long long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* The half-open probe waits at most connect_timeout_ms for the handshake. */
+static int tcp_wait_connected(int sockfd) {
+    struct pollfd pfd = {.fd = sockfd, .events = POLLOUT};
+    socklen_t len = sizeof(int);
+    int err = 0;
+    int r;
+
+    do {
+        r = poll(&pfd, 1, (int)tcp.connect_timeout_ms);
+    } while (r < 0 && errno == EINTR);
+    if (r == 0) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    if (r < 0 || getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) {
+        return -1;
+    }
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
 static int tcp_open_socket(void) {
-    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    struct timeval sndtimeo = {
+        .tv_sec = tcp.send_timeout_ms / 1000,
+        .tv_usec = (tcp.send_timeout_ms % 1000) * 1000,
+    };
+    int one = 1;
+    int sockfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
     if (sockfd < 0) {
         return -1;
     }
@@ -15,13 +132,30 @@ static int tcp_open_socket(void) {
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
-    addr.sin_port = htons(LOG_PORT);
-    if (inet_pton(AF_INET, LOG_HOST, &addr.sin_addr) <= 0) {
+    addr.sin_port = htons(tcp.port);
+    if (inet_pton(AF_INET, tcp.host, &addr.sin_addr) <= 0) {
         close(sockfd);
         return -1;
     }
 
-    if (connect(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    if ((connect(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 &&
+         (errno != EINPROGRESS || tcp_wait_connected(sockfd) < 0)) ||
+        fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL) & ~O_NONBLOCK) < 0 ||
+        setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &sndtimeo,
+                   sizeof(sndtimeo)) < 0) {
+        int err = errno;
+        close(sockfd);
+        errno = err;
+        return -1;
+    }
+
+    if (tcp.nodelay &&
+        setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0) {
+        close(sockfd);
+        return -1;
+    }
+    if (tcp.cork &&
+        setsockopt(sockfd, IPPROTO_TCP, TCP_CORK, &one, sizeof(one)) < 0) {
         close(sockfd);
         return -1;
     }
@@ -29,56 +163,623 @@ static int tcp_open_socket(void) {
     return sockfd;
 }
 
-static int tcp_send(const char *msg, size_t len) {
-    int sockfd;
-    size_t sent_total = 0;
+static void tcp_mark_down(void) {
+    if (tcp.fd >= 0) {
+        close(tcp.fd);
+        tcp.fd = -1;
+    }
+    if (tcp.backoff_ms == 0) {
+        tcp.backoff_ms = tcp.backoff_initial_ms;
+    } else if (tcp.backoff_ms < tcp.backoff_max_ms / 2) {
+        tcp.backoff_ms *= 2;
+    } else {
+        tcp.backoff_ms = tcp.backoff_max_ms;
+    }
+    tcp.next_attempt_ms = monotonic_ms() + tcp.backoff_ms;
+}
 
-    if (!msg) {
+static int tcp_try_connect(int force) {
+    if (tcp.fd >= 0) {
+        return 0;
+    }
+    if (!force && monotonic_ms() < tcp.next_attempt_ms) {
+        tcp.stats.short_circuited++;
+        errno = ENOTCONN;
         return -1;
     }
 
-    sockfd = tcp_open_socket();
-    if (sockfd < 0) {
+    tcp.fd = tcp_open_socket();
+    if (tcp.fd < 0) {
+        int err = errno;
+        tcp.stats.reconnect_failures++;
+        tcp_mark_down();
+        errno = err;
         return -1;
     }
+    tcp.backoff_ms = 0;
+    tcp.next_attempt_ms = 0;
+    if (!force && tcp.stats.connects > 0) {
+        tcp.stats.reconnects++;
+    }
+    tcp.stats.connects++;
+    return 0;
+}
+
+/*
+ * A collector that restarted leaves us a socket that reads EOF, and the
+ * first send into it still succeeds. Peeking costs a system call, so it
+ * runs at most once per backoff_initial_ms; between peeks a closed peer
+ * shows up as EPIPE or ECONNRESET on the following send.
+ */
+static int tcp_peer_closed(void) {
+    long long now = monotonic_ms();
+    char c;
+    ssize_t r;
+
+    if (now < tcp.next_peek_ms) {
+        return 0;
+    }
+    tcp.next_peek_ms = now + tcp.backoff_initial_ms;
+    r = recv(tcp.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (r == 0) {
+        return 1;
+    }
+    return r < 0 && errno != EAGAIN && errno != EWOULDBLOCK;
+}
+
+/* SO_SNDTIMEO expiring shows up as EAGAIN; report it as the timeout. */
+static int tcp_send_failed(void) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        errno = ETIMEDOUT;
+    }
+    return -1;
+}
+
+static int tcp_send_all(const char *msg, size_t len) {
+    size_t sent_total = 0;
 
     while (sent_total < len) {
-        ssize_t sent =
-            send(sockfd, msg + sent_total, len - sent_total, 0);
+        ssize_t sent = send(tcp.fd, msg + sent_total, len - sent_total,
+                            MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
         if (sent <= 0) {
-            close(sockfd);
-            return -1;
+            return tcp_send_failed();
         }
         sent_total += (size_t)sent;
     }
+    return 0;
+}
+
+static int tcp_sendv_all(const struct iovec *iov, size_t n) {
+    while (n > 0) {
+        struct iovec chunk[TCP_IOV_CHUNK];
+        struct iovec *cur = chunk;
+        size_t cnt = n < TCP_IOV_CHUNK ? n : TCP_IOV_CHUNK;
+        struct msghdr msg;
+
+        memcpy(chunk, iov, cnt * sizeof(*iov));
+        iov += cnt;
+        n -= cnt;
+        while (cnt > 0) {
+            ssize_t sent;
+
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = cur;
+            msg.msg_iovlen = cnt;
+            sent = sendmsg(tcp.fd, &msg, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent <= 0) {
+                return tcp_send_failed();
+            }
+            iov_advance(&cur, &cnt, (size_t)sent);
+        }
+    }
+    return 0;
+}
+
+static void tcp_frame(char *dst, const char *msg, size_t len) {
+    uint32_t hdr = (uint32_t)len;
+
+    memcpy(dst, &hdr, sizeof(hdr));
+    memcpy(dst + sizeof(hdr), msg, len);
+}
+
+/*
+ * Sends the whole frames at the front of buf, up to TCP_SPOOL_IOV per
+ * vectored send. Returns the bytes they took (0 when the first frame is
+ * incomplete or empty) and their count in *records; -1 on a send failure.
+ */
+static long tcp_send_frames(const char *buf, size_t size, size_t *records) {
+    struct iovec iov[TCP_SPOOL_IOV];
+    size_t off = 0;
+    size_t k = 0;
+    uint32_t len;
+
+    while (k < TCP_SPOOL_IOV && off + sizeof(len) <= size) {
+        memcpy(&len, buf + off, sizeof(len));
+        if (len == 0 || off + sizeof(len) + len > size) {
+            break;
+        }
+        iov[k].iov_base = (void *)(buf + off + sizeof(len));
+        iov[k].iov_len = len;
+        off += sizeof(len) + len;
+        k++;
+    }
+    if (k > 0 && tcp_sendv_all(iov, k) < 0) {
+        return -1;
+    }
+    *records = k;
+    return (long)off;
+}
 
-    if (close(sockfd) < 0) {
+static int tcp_replay_push(const char *msg, size_t len) {
+    if (!tcp.replay && tcp.replay_cap > 0) {
+        tcp.replay = malloc(tcp.replay_cap);
+    }
+    if (!tcp.replay || len == 0 ||
+        tcp.replay_len + sizeof(uint32_t) + len > tcp.replay_cap) {
         return -1;
     }
+    tcp_frame(tcp.replay + tcp.replay_len, msg, len);
+    tcp.replay_len += sizeof(uint32_t) + len;
+    tcp.replay_records++;
+    return 0;
+}
 
+static int tcp_spool_pending(void) {
+    return tcp.spool_end > tcp.spool_read;
+}
+
+/* Opens the spool, picking up whatever an earlier run left in it. */
+static int tcp_spool_open(int create) {
+    struct stat st;
+
+    if (tcp.spool_fd >= 0) {
+        return 0;
+    }
+    if (tcp.spool_max == 0) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    tcp.spool_fd = open(tcp.spool_path,
+                        O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0644);
+    if (tcp.spool_fd < 0) {
+        return -1;
+    }
+    if (fstat(tcp.spool_fd, &st) < 0) {
+        close(tcp.spool_fd);
+        tcp.spool_fd = -1;
+        return -1;
+    }
+    tcp.spool_read = 0;
+    tcp.spool_end = st.st_size;
     return 0;
 }
 
-static int tcp_connect_capability(void) {
-    int sockfd = tcp_open_socket();
-    if (sockfd < 0) {
+/* Appends already framed records. */
+static int tcp_spool_write(const char *frames, size_t size, size_t records) {
+    ssize_t n;
+
+    if (tcp_spool_open(1) < 0 ||
+        (size_t)tcp.spool_end + size > tcp.spool_max) {
+        return -1;
+    }
+    n = pwrite(tcp.spool_fd, frames, size, tcp.spool_end);
+    if (n != (ssize_t)size) {
+        /* The next append overwrites a torn frame; trim it for restarts. */
+        if (n > 0 && ftruncate(tcp.spool_fd, tcp.spool_end) < 0) {
+            errno = EIO;
+        }
         return -1;
     }
-    close(sockfd);
+    tcp.spool_end += n;
+    tcp.stats.spooled += records;
     return 0;
 }
 
-static int tcp_disconnect_capability(void) {
+/*
+ * Moves the replay buffer to the spool, so the two never both hold records
+ * and replaying the buffer before the spool keeps them in order.
+ */
+static int tcp_spool_take_buffer(void) {
+    if (tcp.replay_len == 0) {
+        return 0;
+    }
+    if (tcp_spool_write(tcp.replay, tcp.replay_len, tcp.replay_records) < 0) {
+        return -1;
+    }
+    tcp.replay_len = 0;
+    tcp.replay_records = 0;
+    return 0;
+}
+
+static int tcp_spool_push(const char *msg, size_t len) {
+    char frame[sizeof(uint32_t) + MAX_BUFFER_SIZE];
+    uint32_t hdr = (uint32_t)len;
+    struct iovec iov[2];
+    ssize_t n;
+
+    if (len == 0 || len > UINT32_MAX) {
+        return -1;
+    }
+    if (len <= MAX_BUFFER_SIZE) {
+        tcp_frame(frame, msg, len);
+        return tcp_spool_write(frame, sizeof(hdr) + len, 1);
+    }
+    /* Oversized records skip the copy. */
+    if (tcp_spool_open(1) < 0 ||
+        (size_t)tcp.spool_end + sizeof(hdr) + len > tcp.spool_max) {
+        return -1;
+    }
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = (void *)msg;
+    iov[1].iov_len = len;
+    n = pwritev(tcp.spool_fd, iov, 2, tcp.spool_end);
+    if (n != (ssize_t)(sizeof(hdr) + len)) {
+        if (n > 0 && ftruncate(tcp.spool_fd, tcp.spool_end) < 0) {
+            errno = EIO;
+        }
+        return -1;
+    }
+    tcp.spool_end += n;
+    tcp.stats.spooled++;
+    return 0;
+}
+
+/* Empties a fully replayed spool; on failure, appends continue after it. */
+static void tcp_spool_reset(void) {
+    if (ftruncate(tcp.spool_fd, 0) == 0) {
+        tcp.spool_end = 0;
+    }
+    tcp.spool_read = tcp.spool_end;
+}
+
+static int tcp_spool_reserve(size_t size) {
+    char *buf;
+
+    if (tcp.spool_buf_cap >= size) {
+        return 0;
+    }
+    buf = realloc(tcp.spool_buf, size);
+    if (!buf) {
+        return -1;
+    }
+    tcp.spool_buf = buf;
+    tcp.spool_buf_cap = size;
+    return 0;
+}
+
+/*
+ * Replays spooled frames in file order until the spool is empty or about
+ * budget bytes have gone out, one pread of up to TCP_SPOOL_CHUNK at a time.
+ * A frame that outgrows the chunk gets a larger buffer, and failing to get
+ * one leaves the spool as it is; a torn frame at the end (a crash
+ * mid-append) ends the spool there.
+ */
+static int tcp_spool_drain(size_t budget) {
+    int torn = 0;
+
+    if (!tcp_spool_pending()) {
+        return 0;
+    }
+    if (tcp_spool_reserve(TCP_SPOOL_CHUNK) < 0) {
+        return -1;
+    }
+    while (tcp_spool_pending() && budget > 0) {
+        size_t want = (size_t)(tcp.spool_end - tcp.spool_read);
+        size_t records;
+        uint32_t len;
+        ssize_t n;
+        long used;
+
+        n = pread(tcp.spool_fd, tcp.spool_buf,
+                  want < tcp.spool_buf_cap ? want : tcp.spool_buf_cap,
+                  tcp.spool_read);
+        if (n < 0) {
+            return -1;
+        }
+        used = tcp_send_frames(tcp.spool_buf, (size_t)n, &records);
+        if (used < 0) {
+            return -1;
+        }
+        if (used == 0) {
+            if ((size_t)n < sizeof(len)) {
+                torn = 1;
+                break;
+            }
+            memcpy(&len, tcp.spool_buf, sizeof(len));
+            if (len == 0 || sizeof(len) + len > want) {
+                torn = 1;
+                break;
+            }
+            if (tcp_spool_reserve(sizeof(len) + len) < 0) {
+                return -1;
+            }
+            continue;
+        }
+        tcp.spool_read += used;
+        tcp.stats.spool_replayed += records;
+        budget = (size_t)used < budget ? budget - (size_t)used : 0;
+    }
+    if (torn || !tcp_spool_pending()) {
+        tcp_spool_reset();
+    }
+    return 0;
+}
+
+/* The buffer first, then up to spool_budget bytes of the spool. */
+static int tcp_replay_drain(size_t spool_budget) {
+    size_t off = 0;
+
+    /* On failure the whole buffer is kept and resent: at-least-once. */
+    while (off < tcp.replay_len) {
+        size_t records;
+        long used = tcp_send_frames(tcp.replay + off, tcp.replay_len - off,
+                                    &records);
+        if (used <= 0) {
+            return -1;
+        }
+        off += (size_t)used;
+    }
+    tcp.stats.replayed += tcp.replay_records;
+    tcp.replay_len = 0;
+    tcp.replay_records = 0;
+    return tcp_spool_drain(spool_budget);
+}
+
+/*
+ * Holds a record while the breaker is open: in the buffer while it has
+ * room and nothing is spooled, otherwise behind the spooled ones.
+ */
+static int tcp_park(const char *msg, size_t len) {
+    if ((!tcp_spool_pending() && tcp_replay_push(msg, len) == 0) ||
+        (tcp_spool_take_buffer() == 0 && tcp_spool_push(msg, len) == 0)) {
+        return 0;
+    }
+    tcp.stats.replay_dropped++;
+    errno = ENOBUFS;
+    return -1;
+}
+
+static int tcp_send_locked(const char *msg, size_t len) {
+    if (!msg) {
+        return -1;
+    }
+
+    if (tcp.fd >= 0 && tcp_peer_closed()) {
+        tcp_mark_down();
+    }
+    if (tcp.fd >= 0 || tcp_try_connect(0) == 0) {
+        if (tcp_replay_drain(TCP_SPOOL_DRAIN_BYTES) < 0) {
+            tcp_mark_down();
+        } else if (!tcp_spool_pending()) {
+            if (tcp_send_all(msg, len) == 0) {
+                return 0;
+            }
+            tcp_mark_down();
+        }
+    }
+
+    return tcp_park(msg, len);
+}
+
+static int tcp_send_batch_locked(const struct iovec *iov, size_t n) {
+    size_t i;
+
+    if (!iov) {
+        return -1;
+    }
+
+    if (tcp.fd >= 0 && tcp_peer_closed()) {
+        tcp_mark_down();
+    }
+    if (tcp.fd >= 0 || tcp_try_connect(0) == 0) {
+        if (tcp_replay_drain(TCP_SPOOL_DRAIN_BYTES) < 0) {
+            tcp_mark_down();
+        } else if (!tcp_spool_pending()) {
+            if (tcp_sendv_all(iov, n) == 0) {
+                return 0;
+            }
+            tcp_mark_down();
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        if (tcp_park(iov[i].iov_base, iov[i].iov_len) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int tcp_flush_locked(void) {
+    int zero = 0;
+    int one = 1;
+
+    if (tcp.fd < 0 || !tcp.cork) {
+        return 0;
+    }
+    /* Toggling the cork pushes out any partial frame immediately. */
+    if (setsockopt(tcp.fd, IPPROTO_TCP, TCP_CORK, &zero, sizeof(zero)) < 0 ||
+        setsockopt(tcp.fd, IPPROTO_TCP, TCP_CORK, &one, sizeof(one)) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int tcp_connect_capability_locked(void) {
+    if (tcp_try_connect(1) < 0) {
+        return -1;
+    }
+    /* Picks up a spool an earlier run left behind and replays all of it. */
+    if (tcp.spool_max > 0 && tcp_spool_open(0) < 0 && errno != ENOENT) {
+        tcp_mark_down();
+        return -1;
+    }
+    if (tcp_replay_drain((size_t)-1) < 0) {
+        tcp_mark_down();
+        return -1;
+    }
+    return 0;
+}
+
+static int tcp_disconnect_capability_locked(void) {
+    int rc = 0;
+
+    if (tcp.fd >= 0) {
+        rc = tcp_flush_locked();
+        if (close(tcp.fd) < 0) {
+            rc = -1;
+        }
+        tcp.fd = -1;
+    }
+    /* Parked records outlive the process in the spool, when there is one. */
+    if (tcp.spool_max > 0 && tcp_spool_take_buffer() < 0) {
+        rc = -1;
+    }
+    tcp.backoff_ms = 0;
+    tcp.next_attempt_ms = 0;
+    return rc;
+}
+
+static int tcp_configure_locked(const TcpTransportOptions *opts) {
+    const char *host;
+    const char *spool_path;
+    int spool_moved;
+
+    if (!opts || tcp.fd >= 0) {
+        return -1;
+    }
+
+    host = opts->host ? opts->host : LOG_HOST;
+    spool_path = opts->spool_path ? opts->spool_path : TCP_SPOOL_PATH;
+    if (strlen(host) >= sizeof(tcp.host) ||
+        strlen(spool_path) >= sizeof(tcp.spool_path)) {
+        return -1;
+    }
+    /* Spooled records stay where they are until they have been replayed. */
+    spool_moved = strcmp(spool_path, tcp.spool_path) != 0 ||
+                  opts->spool_max_bytes == 0;
+    if (spool_moved && tcp_spool_pending()) {
+        return -1;
+    }
+
+    strcpy(tcp.host, host);
+    tcp.port = opts->port ? opts->port : LOG_PORT;
+    tcp.nodelay = opts->nodelay;
+    tcp.cork = opts->cork;
+    tcp.backoff_initial_ms =
+        opts->backoff_initial_ms ? opts->backoff_initial_ms : 1;
+    tcp.backoff_max_ms = opts->backoff_max_ms > tcp.backoff_initial_ms
+                             ? opts->backoff_max_ms
+                             : tcp.backoff_initial_ms;
+    if (opts->replay_buffer_size != tcp.replay_cap) {
+        if (tcp.replay_len > 0) {
+            return -1;
+        }
+        free(tcp.replay);
+        tcp.replay = NULL;
+        tcp.replay_cap = opts->replay_buffer_size;
+    }
+    tcp.connect_timeout_ms = opts->connect_timeout_ms
+                                 ? opts->connect_timeout_ms
+                                 : TCP_CONNECT_TIMEOUT_MS;
+    tcp.send_timeout_ms =
+        opts->send_timeout_ms ? opts->send_timeout_ms : TCP_SEND_TIMEOUT_MS;
+    if (spool_moved && tcp.spool_fd >= 0) {
+        close(tcp.spool_fd);
+        tcp.spool_fd = -1;
+    }
+    strcpy(tcp.spool_path, spool_path);
+    tcp.spool_max = opts->spool_max_bytes;
     return 0;
 }
 
+static pthread_mutex_t tcp_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int tcp_send(const char *msg, size_t len) {
+    int rc;
+    pthread_mutex_lock(&tcp_lock);
+    rc = tcp_send_locked(msg, len);
+    pthread_mutex_unlock(&tcp_lock);
+    return rc;
+}
+
+static int tcp_send_batch(const struct iovec *iov, size_t n) {
+    int rc;
+    pthread_mutex_lock(&tcp_lock);
+    rc = tcp_send_batch_locked(iov, n);
+    pthread_mutex_unlock(&tcp_lock);
+    return rc;
+}
+
+static int tcp_flush(void) {
+    int rc;
+    pthread_mutex_lock(&tcp_lock);
+    rc = tcp_flush_locked();
+    pthread_mutex_unlock(&tcp_lock);
+    return rc;
+}
+
+static int tcp_connect_capability(void) {
+    int rc;
+    pthread_mutex_lock(&tcp_lock);
+    rc = tcp_connect_capability_locked();
+    pthread_mutex_unlock(&tcp_lock);
+    return rc;
+}
+
+static int tcp_disconnect_capability(void) {
+    int rc;
+    pthread_mutex_lock(&tcp_lock);
+    rc = tcp_disconnect_capability_locked();
+    pthread_mutex_unlock(&tcp_lock);
+    return rc;
+}
+
+int tcp_transport_configure(const TcpTransportOptions *opts) {
+    int rc;
+    pthread_mutex_lock(&tcp_lock);
+    rc = tcp_configure_locked(opts);
+    pthread_mutex_unlock(&tcp_lock);
+    return rc;
+}
+
+void tcp_transport_stats(TcpTransportStats *out) {
+    if (!out) {
+        return;
+    }
+    pthread_mutex_lock(&tcp_lock);
+    *out = tcp.stats;
+    out->replay_bytes = tcp.replay_len;
+    out->spool_bytes = (size_t)(tcp.spool_end - tcp.spool_read);
+    pthread_mutex_unlock(&tcp_lock);
+}
+
+static unsigned long long tcp_reconnects(void) {
+    unsigned long long n;
+    pthread_mutex_lock(&tcp_lock);
+    n = tcp.stats.reconnects;
+    pthread_mutex_unlock(&tcp_lock);
+    return n;
+}
+
 const Sender TCP_SENDER = { .send = tcp_send };
+const BatchSender TCP_BATCH_SENDER = { .send_batch = tcp_send_batch };
+const Flushable TCP_FLUSHABLE = { .flush = tcp_flush };
 const Connectable TCP_CONNECTABLE = {
     .connect = tcp_connect_capability,
     .disconnect = tcp_disconnect_capability,
+    .reconnects = tcp_reconnects,
 };
 const Transport TCP_TRANSPORT = {
     .sender = &TCP_SENDER,
-    .flushable = NULL,
+    .batch_sender = &TCP_BATCH_SENDER,
+    .flushable = &TCP_FLUSHABLE,
     .connectable = &TCP_CONNECTABLE,
 };
@@ -1,38 +1,331 @@
+#define _GNU_SOURCE
 #include "interfaces.h"
 #include "config.h"
+#include "udp_transport.h"
 #include <arpa/inet.h>
+#include <errno.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
-static int udp_send(const char *msg, size_t len) {
-    ssize_t sent;
-    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+#define UDP_HOST_MAX 64
+#define UDP_MMSG_CHUNK 64
+#define UDP_DATAGRAM_MAX_RECORDS 64
+#define UDP_GSO_MAX_SEGMENTS 64
+#define UDP_GSO_MAX_SEGMENT 1472 /* never ask GSO for more than one MTU */
+#define UDP_GSO_MAX_BYTES 65000
+
+/*
+ * One connected socket lives from the first send (or connect) until
+ * disconnect, so a send is a single send(2) with no address lookup. Batches
+ * are laid out straight from the caller's iovecs: consecutive records are
+ * packed into datagrams of up to datagram_size bytes, runs of equal-sized
+ * datagrams can go out as one GSO message, and the whole batch goes to the
+ * kernel through sendmmsg.
+ *
+ * A connected UDP socket reports an ICMP port unreachable for an earlier
+ * datagram as ECONNREFUSED on the next call, which never sent anything.
+ * That call is retried once so a collector that is down costs records, as
+ * it always did, without failing the ones that follow.
+ */
+static struct {
+    int fd;
+    char host[UDP_HOST_MAX];
+    unsigned short port;
+    size_t datagram_size;
+    int gso;
+    UdpTransportStats stats;
+} udp = {
+    .fd = -1,
+    .host = LOG_HOST,
+    .port = LOG_PORT,
+    .datagram_size = UDP_DATAGRAM_SIZE,
+    .gso = UDP_GSO_ENABLED,
+};
+
+static pthread_mutex_t udp_lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef union {
+    char buf[CMSG_SPACE(sizeof(uint16_t))];
+    size_t align; /* cmsghdr alignment */
+} UdpGsoControl;
+
+static int udp_open(void) {
+    struct sockaddr_in addr;
+    int fd;
+
+    if (udp.fd >= 0) {
+        return 0;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(udp.port);
+    if (inet_pton(AF_INET, udp.host, &addr.sin_addr) <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    udp.fd = fd;
+    return 0;
+}
+
+static int udp_send_locked(const char *msg, size_t len) {
+    int retried = 0;
+
     if (!msg) {
         return -1;
     }
-    if (sockfd < 0) {
+    if (udp_open() < 0) {
         return -1;
     }
 
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(LOG_PORT);
+    for (;;) {
+        ssize_t sent = send(udp.fd, msg, len, 0);
+
+        udp.stats.syscalls++;
+        if (sent == (ssize_t)len) {
+            udp.stats.records++;
+            udp.stats.datagrams++;
+            return 0;
+        }
+        if (sent < 0 && (errno == EINTR ||
+                         (errno == ECONNREFUSED && !retried++))) {
+            continue;
+        }
+        udp.stats.errors++;
+        return -1;
+    }
+}
+
+/* Number of records from iov that make up the next datagram; at least one. */
+static size_t udp_next_datagram(const struct iovec *iov, size_t n,
+                                size_t *bytes) {
+    size_t take = 1;
+    size_t total = iov[0].iov_len;
+
+    while (take < n && take < UDP_DATAGRAM_MAX_RECORDS &&
+           total + iov[take].iov_len <= udp.datagram_size) {
+        total += iov[take].iov_len;
+        take++;
+    }
+    *bytes = total;
+    return take;
+}
+
+/*
+ * Fills msgs from iov and returns how many were built; *used is the number
+ * of records they cover. Each message is one datagram, or with GSO a run
+ * of equal-sized datagrams (the last may be shorter) that the kernel
+ * splits at a fixed segment size.
+ */
+static size_t udp_build(const struct iovec *iov, size_t n,
+                        struct mmsghdr *msgs, UdpGsoControl *ctl,
+                        size_t *segs_out, size_t *used) {
+    size_t cnt = 0;
+    size_t off = 0;
+
+    memset(msgs, 0, UDP_MMSG_CHUNK * sizeof(*msgs));
+    while (cnt < UDP_MMSG_CHUNK && off < n) {
+        struct msghdr *h = &msgs[cnt].msg_hdr;
+        size_t bytes;
+        size_t take = udp_next_datagram(iov + off, n - off, &bytes);
+        size_t segs = 1;
+
+        /* Only the last segment of a GSO run may be shorter. */
+        while (udp.gso && bytes > 0 && bytes <= UDP_GSO_MAX_SEGMENT &&
+               off + take < n && segs < UDP_GSO_MAX_SEGMENTS &&
+               (segs + 1) * bytes <= UDP_GSO_MAX_BYTES) {
+            size_t next_bytes;
+            size_t next = udp_next_datagram(iov + off + take,
+                                            n - off - take, &next_bytes);
+            if (next_bytes > bytes || take + next > IOV_MAX) {
+                break;
+            }
+            take += next;
+            segs++;
+            if (next_bytes < bytes) {
+                break;
+            }
+        }
+
+        h->msg_iov = (struct iovec *)(iov + off);
+        h->msg_iovlen = take;
+        if (segs > 1) {
+            struct cmsghdr *cm;
+            uint16_t gso_size = (uint16_t)bytes;
 
-    if (inet_pton(AF_INET, LOG_HOST, &addr.sin_addr) <= 0) {
-        close(sockfd);
+            h->msg_control = ctl[cnt].buf;
+            h->msg_controllen = sizeof(ctl[cnt].buf);
+            cm = CMSG_FIRSTHDR(h);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(gso_size));
+            memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+        }
+        segs_out[cnt] = segs;
+        off += take;
+        cnt++;
+    }
+    *used = off;
+    return cnt;
+}
+
+static int udp_send_batch_locked(const struct iovec *iov, size_t n) {
+    struct mmsghdr msgs[UDP_MMSG_CHUNK];
+    UdpGsoControl ctl[UDP_MMSG_CHUNK];
+    size_t segs[UDP_MMSG_CHUNK];
+
+    if (!iov) {
+        return -1;
+    }
+    if (udp_open() < 0) {
         return -1;
     }
-    sent = sendto(sockfd, msg, len, 0, (struct sockaddr *)&addr, sizeof(addr));
-    close(sockfd);
-    return sent == (ssize_t)len ? 0 : -1;
+
+    while (n > 0) {
+        size_t used;
+        size_t cnt = udp_build(iov, n, msgs, ctl, segs, &used);
+        size_t done = 0;
+        int retried = 0;
+
+        while (done < cnt) {
+            int sent = sendmmsg(udp.fd, msgs + done, (unsigned int)(cnt - done),
+                                0);
+            udp.stats.syscalls++;
+            if (sent > 0) {
+                for (; sent > 0; sent--, done++) {
+                    udp.stats.records += msgs[done].msg_hdr.msg_iovlen;
+                    udp.stats.datagrams += segs[done];
+                    udp.stats.gso_writes += segs[done] > 1;
+                }
+                continue;
+            }
+            if (sent < 0 && (errno == EINTR ||
+                             (errno == ECONNREFUSED && !retried++))) {
+                continue;
+            }
+            if (sent < 0 && segs[done] > 1 &&
+                (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT ||
+                 errno == EOPNOTSUPP)) {
+                /* No GSO on this kernel or route: rebuild without it. */
+                udp.gso = 0;
+                used = (size_t)(msgs[done].msg_hdr.msg_iov - iov);
+                break;
+            }
+            udp.stats.errors++;
+            return -1;
+        }
+        iov += used;
+        n -= used;
+    }
+    return 0;
+}
+
+static int udp_disconnect_locked(void) {
+    int rc = 0;
+
+    if (udp.fd >= 0) {
+        rc = close(udp.fd);
+        udp.fd = -1;
+    }
+    return rc;
+}
+
+static int udp_configure_locked(const UdpTransportOptions *opts) {
+    const char *host;
+
+    if (!opts || udp.fd >= 0) {
+        return -1;
+    }
+
+    host = opts->host ? opts->host : LOG_HOST;
+    if (strlen(host) >= sizeof(udp.host)) {
+        return -1;
+    }
+
+    strcpy(udp.host, host);
+    udp.port = opts->port ? opts->port : LOG_PORT;
+    udp.datagram_size = opts->datagram_size;
+    udp.gso = opts->gso;
+    return 0;
+}
+
+static int udp_send(const char *msg, size_t len) {
+    int rc;
+    pthread_mutex_lock(&udp_lock);
+    rc = udp_send_locked(msg, len);
+    pthread_mutex_unlock(&udp_lock);
+    return rc;
+}
+
+static int udp_send_batch(const struct iovec *iov, size_t n) {
+    int rc;
+    pthread_mutex_lock(&udp_lock);
+    rc = udp_send_batch_locked(iov, n);
+    pthread_mutex_unlock(&udp_lock);
+    return rc;
+}
+
+static int udp_connect(void) {
+    int rc;
+    pthread_mutex_lock(&udp_lock);
+    rc = udp_open();
+    pthread_mutex_unlock(&udp_lock);
+    return rc;
+}
+
+static int udp_disconnect(void) {
+    int rc;
+    pthread_mutex_lock(&udp_lock);
+    rc = udp_disconnect_locked();
+    pthread_mutex_unlock(&udp_lock);
+    return rc;
+}
+
+int udp_transport_configure(const UdpTransportOptions *opts) {
+    int rc;
+    pthread_mutex_lock(&udp_lock);
+    rc = udp_configure_locked(opts);
+    pthread_mutex_unlock(&udp_lock);
+    return rc;
+}
+
+void udp_transport_stats(UdpTransportStats *out) {
+    if (!out) {
+        return;
+    }
+    pthread_mutex_lock(&udp_lock);
+    *out = udp.stats;
+    pthread_mutex_unlock(&udp_lock);
 }
 
 const Sender UDP_SENDER = { .send = udp_send };
+const BatchSender UDP_BATCH_SENDER = { .send_batch = udp_send_batch };
+const Connectable UDP_CONNECTABLE = {
+    .connect = udp_connect,
+    .disconnect = udp_disconnect,
+};
 const Transport UDP_TRANSPORT = {
     .sender = &UDP_SENDER,
+    .batch_sender = &UDP_BATCH_SENDER,
     .flushable = NULL,
-    .connectable = NULL,
+    .connectable = &UDP_CONNECTABLE,
 };
@@ -0,0 +1,187 @@
+#include "uring_ring.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* The ring indices are shared with the kernel; access them atomically. */
+#define RING_LOAD_ACQUIRE(p)                                                   \
+    atomic_load_explicit((_Atomic unsigned int *)(p), memory_order_acquire)
+#define RING_STORE_RELEASE(p, v)                                               \
+    atomic_store_explicit((_Atomic unsigned int *)(p), (v),                    \
+                          memory_order_release)
+
+static int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit,
+                              unsigned int min_complete, unsigned int flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned int opcode, const void *arg,
+                                 unsigned int nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+int uring_init(UringRing *r, unsigned int entries) {
+    struct io_uring_params p;
+    char *sq;
+    char *cq;
+
+    memset(r, 0, sizeof(*r));
+    memset(&p, 0, sizeof(p));
+    r->fd = sys_io_uring_setup(entries, &p);
+    if (r->fd < 0) {
+        r->fd = -1;
+        return -1;
+    }
+
+    r->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    r->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_map_len > r->sq_map_len) {
+            r->sq_map_len = r->cq_map_len;
+        }
+    }
+
+    r->sq_map = mmap(NULL, r->sq_map_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED) {
+        r->sq_map = NULL;
+        uring_close(r);
+        return -1;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_map = r->sq_map;
+    } else {
+        r->cq_map = mmap(NULL, r->cq_map_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_map == MAP_FAILED) {
+            r->cq_map = NULL;
+            uring_close(r);
+            return -1;
+        }
+    }
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        uring_close(r);
+        return -1;
+    }
+
+    sq = r->sq_map;
+    cq = r->cq_map;
+    r->sq_head = (unsigned int *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned int *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned int *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    r->sq_entries = p.sq_entries;
+    return 0;
+}
+
+void uring_close(UringRing *r) {
+    if (r->sqes) {
+        munmap(r->sqes, r->sqes_len);
+    }
+    if (r->cq_map && r->cq_map != r->sq_map) {
+        munmap(r->cq_map, r->cq_map_len);
+    }
+    if (r->sq_map) {
+        munmap(r->sq_map, r->sq_map_len);
+    }
+    if (r->fd >= 0) {
+        close(r->fd);
+    }
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+int uring_register_buffers(UringRing *r, const struct iovec *iov,
+                           unsigned int n) {
+    return sys_io_uring_register(r->fd, IORING_REGISTER_BUFFERS, iov, n);
+}
+
+int uring_register_files(UringRing *r, const int *fds, unsigned int n) {
+    return sys_io_uring_register(r->fd, IORING_REGISTER_FILES, fds, n);
+}
+
+int uring_supports(UringRing *r, const unsigned char *ops, size_t n) {
+    struct io_uring_probe *probe;
+    size_t i;
+    int ok;
+
+    probe = calloc(1, sizeof(*probe) +
+                          URING_PROBE_OPS * sizeof(struct io_uring_probe_op));
+    if (!probe) {
+        return 0;
+    }
+    ok = sys_io_uring_register(r->fd, IORING_REGISTER_PROBE, probe,
+                               URING_PROBE_OPS) == 0;
+    for (i = 0; ok && i < n; i++) {
+        ok = ops[i] <= probe->last_op &&
+             (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+struct io_uring_sqe *uring_get_sqe(UringRing *r) {
+    unsigned int head = RING_LOAD_ACQUIRE(r->sq_head);
+    unsigned int tail = *r->sq_tail + r->pending;
+    struct io_uring_sqe *sqe;
+    unsigned int idx;
+
+    if (tail - head >= r->sq_entries) {
+        return NULL;
+    }
+    idx = tail & *r->sq_mask;
+    sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[idx] = idx;
+    r->pending++;
+    return sqe;
+}
+
+int uring_submit(UringRing *r, unsigned int wait_nr) {
+    unsigned int flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    unsigned int n = r->pending;
+    int rc;
+
+    if (n == 0 && wait_nr == 0) {
+        return 0;
+    }
+    /* Publish the new SQEs before the kernel can see the tail move. */
+    RING_STORE_RELEASE(r->sq_tail, *r->sq_tail + n);
+    r->pending = 0;
+
+    /* On EINTR nothing was consumed; the SQEs are still in the ring. */
+    do {
+        rc = sys_io_uring_enter(r->fd, n, wait_nr, flags);
+    } while (rc < 0 && errno == EINTR);
+    return rc;
+}
+
+struct io_uring_cqe *uring_peek_cqe(UringRing *r) {
+    unsigned int head = *r->cq_head;
+
+    if (head == RING_LOAD_ACQUIRE(r->cq_tail)) {
+        return NULL;
+    }
+    return &r->cqes[head & *r->cq_mask];
+}
+
+void uring_cqe_seen(UringRing *r) {
+    RING_STORE_RELEASE(r->cq_head, *r->cq_head + 1);
+}
@@ -0,0 +1,705 @@
+#include "interfaces.h"
+#include "components.h"
+#include "config.h"
+#include "uring_ring.h"
+#include "uring_transport.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define URING_PATH_MAX 256
+#define URING_HOST_MAX 64
+
+/*
+ * io_uring variants of the disk, TCP and UDP transports.
+ *
+ * Records are copied into a small pool of registered buffers. Filled
+ * buffers are submitted together, as one linked chain of writes for the
+ * streams (so they land in order) or one send per record for UDP, in a
+ * single io_uring_enter. Completions are reaped from the CQ ring on later
+ * calls without a system call; only one chain is in flight at a time and a
+ * sender waits only when every buffer is busy. The disk target submits
+ * when a buffer fills, the sockets as soon as nothing is in flight.
+ *
+ * Errors from completions are reported by the next call on the transport.
+ * When io_uring cannot be set up or lacks an op the target needs, or the
+ * TCP connection fails, the target hands over to the matching blocking
+ * transport for the rest of the session; TCP passes its unsent records
+ * along, starting with any a short send cut in half, so its reconnect and
+ * replay logic takes over on a record boundary.
+ */
+
+typedef enum UringKind {
+    URING_KIND_DISK,
+    URING_KIND_TCP,
+    URING_KIND_UDP,
+} UringKind;
+
+typedef struct UringBuffer {
+    size_t len;           /* bytes staged */
+    size_t sent;          /* bytes the kernel has taken (or given up on) */
+    unsigned int pending; /* SQEs in flight */
+    unsigned int records; /* record ends, UDP and TCP */
+    uint32_t ends[URING_MAX_DATAGRAMS];
+} UringBuffer;
+
+typedef struct UringTarget {
+    UringKind kind;
+    const Transport *fallback;
+    pthread_mutex_t lock;
+    int connected;
+    int ring_up;
+    int use_fallback;
+    int eager; /* submit whenever nothing is in flight */
+    int fixed_file;
+    int fixed_bufs;
+    int fd;
+    int error; /* errno of a failed completion, reported once */
+    int broken; /* TCP: connection failed under us */
+    UringRing ring;
+    char *mem;
+    UringBuffer bufs[URING_BUFFER_COUNT];
+    unsigned int head;      /* oldest buffer holding data */
+    unsigned int count;     /* buffers holding data, from head */
+    unsigned int queued;    /* leading buffers submitted in the chain */
+    unsigned int in_flight; /* SQEs not completed yet */
+    UringTransportStats stats;
+} UringTarget;
+
+static struct {
+    char disk_path[URING_PATH_MAX];
+    char host[URING_HOST_MAX];
+    unsigned short port;
+    unsigned int queue_depth;
+} uring_opts = {
+    .disk_path = LOG_FILE,
+    .host = LOG_HOST,
+    .port = LOG_PORT,
+    .queue_depth = URING_QUEUE_DEPTH,
+};
+
+static UringTarget uring_disk = {
+    .kind = URING_KIND_DISK,
+    .fallback = &DISK_TRANSPORT,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .fd = -1,
+};
+static UringTarget uring_tcp = {
+    .kind = URING_KIND_TCP,
+    .fallback = &TCP_TRANSPORT,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .eager = 1,
+    .fd = -1,
+};
+static UringTarget uring_udp = {
+    .kind = URING_KIND_UDP,
+    .fallback = &UDP_TRANSPORT,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .eager = 1,
+    .fd = -1,
+};
+
+static UringBuffer *buf_at(UringTarget *t, unsigned int i) {
+    return &t->bufs[(t->head + i) % URING_BUFFER_COUNT];
+}
+
+static unsigned int buf_index(UringTarget *t, unsigned int i) {
+    return (t->head + i) % URING_BUFFER_COUNT;
+}
+
+static char *buf_mem(UringTarget *t, unsigned int idx) {
+    return t->mem + (size_t)idx * URING_BUFFER_SIZE;
+}
+
+static int buf_full(const UringTarget *t, const UringBuffer *b) {
+    return URING_BUFFER_SIZE - b->len < MAX_BUFFER_SIZE ||
+           (t->kind != URING_KIND_DISK && b->records == URING_MAX_DATAGRAMS);
+}
+
+/* ---- socket and file setup ---- */
+
+static int open_target_fd(UringTarget *t) {
+    struct sockaddr_in addr;
+    int one = 1;
+    int fd;
+
+    if (t->kind == URING_KIND_DISK) {
+        return open(uring_opts.disk_path,
+                    O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(uring_opts.port);
+    if (inet_pton(AF_INET, uring_opts.host, &addr.sin_addr) <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    fd = socket(AF_INET,
+                (t->kind == URING_KIND_TCP ? SOCK_STREAM : SOCK_DGRAM) |
+                    SOCK_CLOEXEC,
+                0);
+    if (fd < 0) {
+        return -1;
+    }
+    /* UDP is connected too, so every send can go out without an address. */
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    if (t->kind == URING_KIND_TCP && TCP_NODELAY_ENABLED) {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static void uring_teardown(UringTarget *t) {
+    if (t->ring_up) {
+        uring_close(&t->ring);
+        t->ring_up = 0;
+    }
+    if (t->fd >= 0) {
+        close(t->fd);
+        t->fd = -1;
+    }
+    free(t->mem);
+    t->mem = NULL;
+    memset(t->bufs, 0, sizeof(t->bufs));
+    t->head = 0;
+    t->count = 0;
+    t->queued = 0;
+    t->in_flight = 0;
+    t->connected = 0;
+}
+
+static int uring_setup(UringTarget *t) {
+    static const unsigned char disk_ops[] = {IORING_OP_WRITE,
+                                             IORING_OP_WRITE_FIXED};
+    static const unsigned char socket_ops[] = {IORING_OP_SEND};
+    struct iovec iov[URING_BUFFER_COUNT];
+    unsigned int i;
+    int supported;
+
+    if (uring_init(&t->ring, uring_opts.queue_depth) < 0) {
+        return -1;
+    }
+    t->ring_up = 1;
+    /*
+     * A kernel with io_uring but without these ops would fail every SQE
+     * with -EINVAL, so such a ring counts as no io_uring at all.
+     */
+    supported = t->kind == URING_KIND_DISK
+                    ? uring_supports(&t->ring, disk_ops, sizeof(disk_ops))
+                    : uring_supports(&t->ring, socket_ops, sizeof(socket_ops));
+    if (!supported) {
+        uring_teardown(t);
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+    t->mem = aligned_alloc(4096, (size_t)URING_BUFFER_COUNT * URING_BUFFER_SIZE);
+    if (!t->mem) {
+        uring_teardown(t);
+        return -1;
+    }
+    t->fd = open_target_fd(t);
+    if (t->fd < 0) {
+        int err = errno;
+        uring_teardown(t);
+        errno = err;
+        return -1;
+    }
+
+    /* Registration is an optimisation; plain fds and buffers still work. */
+    t->fixed_file = uring_register_files(&t->ring, &t->fd, 1) == 0;
+    for (i = 0; i < URING_BUFFER_COUNT; i++) {
+        iov[i].iov_base = buf_mem(t, i);
+        iov[i].iov_len = URING_BUFFER_SIZE;
+    }
+    t->fixed_bufs = t->kind == URING_KIND_DISK &&
+                    uring_register_buffers(&t->ring, iov, URING_BUFFER_COUNT) ==
+                        0;
+    t->connected = 1;
+    return 0;
+}
+
+/* ---- completions ---- */
+
+static void complete(UringTarget *t, unsigned int idx, int res) {
+    UringBuffer *b = &t->bufs[idx];
+
+    t->stats.completions++;
+    t->in_flight--;
+    b->pending--;
+
+    if (res == -ECANCELED) {
+        return; /* an earlier link was short; resubmitted from b->sent */
+    }
+    if (res < 0 || (res == 0 && t->kind != URING_KIND_UDP)) {
+        t->stats.failures++;
+        t->error = res < 0 ? -res : EIO;
+        if (t->kind == URING_KIND_TCP) {
+            t->broken = 1;
+            return; /* unsent bytes are handed to the fallback */
+        }
+        if (t->kind == URING_KIND_DISK) {
+            b->sent = b->len; /* drop, like a failed write() */
+        }
+    } else if (t->kind != URING_KIND_UDP) {
+        b->sent += (size_t)res;
+    }
+    if (t->kind == URING_KIND_UDP && b->pending == 0) {
+        b->sent = b->len;
+    }
+}
+
+static void reap(UringTarget *t) {
+    struct io_uring_cqe *cqe;
+
+    while ((cqe = uring_peek_cqe(&t->ring)) != NULL) {
+        complete(t, (unsigned int)cqe->user_data, cqe->res);
+        uring_cqe_seen(&t->ring);
+    }
+}
+
+/* Frees fully written buffers once the chain in flight has finished. */
+static void retire(UringTarget *t) {
+    if (t->in_flight > 0) {
+        return;
+    }
+    t->queued = 0;
+    while (t->count > 0) {
+        UringBuffer *b = buf_at(t, 0);
+        if (b->len == 0 || b->sent < b->len) {
+            break;
+        }
+        memset(b, 0, sizeof(*b));
+        t->head = (t->head + 1) % URING_BUFFER_COUNT;
+        t->count--;
+    }
+}
+
+/* ---- submission ---- */
+
+static struct io_uring_sqe *next_sqe(UringTarget *t) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&t->ring);
+
+    if (!sqe) {
+        /* SQ ring full: hand what we have to the kernel and retry. */
+        t->stats.enters++;
+        if (uring_submit(&t->ring, 0) < 0) {
+            return NULL;
+        }
+        sqe = uring_get_sqe(&t->ring);
+    }
+    return sqe;
+}
+
+static void prep(UringTarget *t, struct io_uring_sqe *sqe, unsigned int idx,
+                 const char *p, size_t len) {
+    if (t->kind == URING_KIND_DISK) {
+        sqe->opcode = t->fixed_bufs ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe->buf_index = (unsigned short)idx;
+        sqe->off = (uint64_t)-1; /* current position; the file is O_APPEND */
+    } else {
+        sqe->opcode = IORING_OP_SEND;
+        sqe->msg_flags = MSG_NOSIGNAL |
+                         (t->kind == URING_KIND_TCP ? MSG_WAITALL : 0);
+    }
+    sqe->fd = t->fixed_file ? 0 : t->fd;
+    if (t->fixed_file) {
+        sqe->flags |= IOSQE_FIXED_FILE;
+    }
+    sqe->addr = (uint64_t)(uintptr_t)p;
+    sqe->len = (uint32_t)len;
+    sqe->user_data = idx;
+    t->in_flight++;
+    t->stats.sqes++;
+}
+
+/*
+ * Submits every buffer with unsent data (or, unless force, only the full
+ * ones) in one io_uring_enter. Stream writes are linked so they complete in
+ * order; a short write cancels the rest of the chain and retire() leaves
+ * them queued for the next round.
+ */
+static int submit_buffers(UringTarget *t, int force) {
+    struct io_uring_sqe *last = NULL;
+    unsigned int i;
+
+    if (t->in_flight > 0) {
+        return 0;
+    }
+    for (i = 0; i < t->count; i++) {
+        unsigned int idx = buf_index(t, i);
+        UringBuffer *b = &t->bufs[idx];
+        char *base = buf_mem(t, idx);
+        unsigned int r;
+
+        if (b->sent == b->len || (!force && !buf_full(t, b))) {
+            break;
+        }
+        if (t->kind != URING_KIND_UDP) {
+            struct io_uring_sqe *sqe = next_sqe(t);
+            if (!sqe) {
+                return -1;
+            }
+            if (last) {
+                last->flags |= IOSQE_IO_LINK;
+            }
+            prep(t, sqe, idx, base + b->sent, b->len - b->sent);
+            b->pending = 1;
+            last = sqe;
+        } else {
+            for (r = 0; r < b->records; r++) {
+                size_t start = r ? b->ends[r - 1] : 0;
+                struct io_uring_sqe *sqe = next_sqe(t);
+                if (!sqe) {
+                    return -1;
+                }
+                prep(t, sqe, idx, base + start, b->ends[r] - start);
+                b->pending++;
+            }
+        }
+        t->queued = i + 1;
+    }
+    if (t->ring.pending == 0) {
+        return 0;
+    }
+    t->stats.enters++;
+    return uring_submit(&t->ring, 0) < 0 ? -1 : 0;
+}
+
+/* Blocks until the chain in flight has completed. */
+static int wait_idle(UringTarget *t) {
+    while (t->in_flight > 0) {
+        t->stats.enters++;
+        if (uring_submit(&t->ring, 1) < 0) {
+            return -1;
+        }
+        reap(t);
+    }
+    retire(t);
+    return 0;
+}
+
+/* Non-blocking: reap, then start the next chain if the last one is done. */
+static int progress(UringTarget *t) {
+    reap(t);
+    retire(t);
+    return submit_buffers(t, t->eager);
+}
+
+/* ---- fallback ---- */
+
+static int enter_fallback(UringTarget *t) {
+    const Connectable *c = t->fallback->connectable;
+
+    t->use_fallback = 1;
+    t->stats.using_fallback = 1;
+    if (c && c->connect && c->connect() < 0 && t->kind != URING_KIND_TCP) {
+        return -1; /* TCP keeps retrying with backoff on its own */
+    }
+    return 0;
+}
+
+/* Start of the record holding byte off, so a resend begins on a boundary. */
+static size_t record_start(const UringBuffer *b, size_t off) {
+    size_t start = 0;
+    unsigned int r;
+
+    for (r = 0; r < b->records && b->ends[r] <= off; r++) {
+        start = b->ends[r];
+    }
+    return start;
+}
+
+/*
+ * TCP lost its connection: pass unsent records on and stop using the ring.
+ * The fallback opens a fresh stream, so a record the old one took only
+ * part of is sent again whole.
+ */
+static int tcp_hand_over(UringTarget *t) {
+    int rc = 0;
+    unsigned int i;
+
+    wait_idle(t);
+    if (enter_fallback(t) < 0) {
+        rc = -1;
+    }
+    for (i = 0; i < t->count; i++) {
+        unsigned int idx = buf_index(t, i);
+        UringBuffer *b = &t->bufs[idx];
+        size_t start = record_start(b, b->sent);
+
+        if (b->sent < b->len &&
+            t->fallback->sender->send(buf_mem(t, idx) + start,
+                                      b->len - start) < 0) {
+            rc = -1;
+        }
+    }
+    uring_teardown(t);
+    return rc;
+}
+
+/* Surfaces an asynchronous failure once; returns -1 if there was one. */
+static int take_error(UringTarget *t) {
+    int err = t->error;
+
+    if (t->broken) {
+        t->broken = 0;
+        tcp_hand_over(t);
+    }
+    if (err == 0) {
+        return 0;
+    }
+    t->error = 0;
+    errno = err;
+    return -1;
+}
+
+/* ---- entry points, called with t->lock held ---- */
+
+static int connect_locked(UringTarget *t) {
+    if (t->connected || t->use_fallback) {
+        return 0;
+    }
+    if (uring_setup(t) == 0) {
+        return 0;
+    }
+    return enter_fallback(t);
+}
+
+static int stage(UringTarget *t, const char *msg, size_t len) {
+    if (len > URING_BUFFER_SIZE) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    for (;;) {
+        UringBuffer *b = t->count > t->queued ? buf_at(t, t->count - 1) : NULL;
+
+        if (b && URING_BUFFER_SIZE - b->len >= len &&
+            (t->kind == URING_KIND_DISK || b->records < URING_MAX_DATAGRAMS)) {
+            memcpy(buf_mem(t, buf_index(t, t->count - 1)) + b->len, msg, len);
+            b->len += len;
+            if (t->kind != URING_KIND_DISK) {
+                b->ends[b->records++] = (uint32_t)b->len;
+            }
+            return 0;
+        }
+        if (t->count < URING_BUFFER_COUNT) {
+            t->count++; /* the next buffer is already zeroed */
+            continue;
+        }
+        /* Every buffer is busy: push them out and wait for the chain. */
+        if (submit_buffers(t, 1) < 0 || wait_idle(t) < 0) {
+            return -1;
+        }
+        if (t->broken) {
+            return -1;
+        }
+    }
+}
+
+static int send_locked(UringTarget *t, const struct iovec *iov, size_t n) {
+    size_t i;
+    int rc = 0;
+
+    if (!t->use_fallback && !t->connected && connect_locked(t) < 0) {
+        return -1;
+    }
+    if (t->use_fallback) {
+        if (n == 1) {
+            return t->fallback->sender->send(iov[0].iov_base, iov[0].iov_len);
+        }
+        if (t->fallback->batch_sender) {
+            return t->fallback->batch_sender->send_batch(iov, n);
+        }
+        for (i = 0; i < n; i++) {
+            if (t->fallback->sender->send(iov[i].iov_base, iov[i].iov_len) <
+                0) {
+                rc = -1;
+            }
+        }
+        return rc;
+    }
+
+    for (i = 0; i < n && rc == 0; i++) {
+        rc = stage(t, iov[i].iov_base, iov[i].iov_len);
+    }
+    if (rc == 0 && progress(t) < 0) {
+        rc = -1;
+    }
+    if (take_error(t) < 0) {
+        rc = -1;
+    }
+    return rc;
+}
+
+static int flush_locked(UringTarget *t) {
+    int rc = 0;
+
+    if (t->use_fallback) {
+        const Flushable *f = t->fallback->flushable;
+        return f && f->flush ? f->flush() : 0;
+    }
+    if (!t->connected) {
+        return 0;
+    }
+    /* Short writes leave data behind; keep going until everything is out. */
+    do {
+        if (wait_idle(t) < 0 || submit_buffers(t, 1) < 0 || wait_idle(t) < 0) {
+            rc = -1;
+            break;
+        }
+    } while (!t->broken && t->count > 0 && buf_at(t, 0)->len > 0);
+    if (take_error(t) < 0) {
+        rc = -1;
+    }
+    return rc;
+}
+
+static int disconnect_locked(UringTarget *t) {
+    const Connectable *c = t->fallback->connectable;
+    int rc = flush_locked(t);
+
+    if (t->use_fallback) {
+        if (c && c->disconnect && c->disconnect() < 0) {
+            rc = -1;
+        }
+        t->use_fallback = 0; /* try io_uring again on the next connect */
+        t->stats.using_fallback = 0;
+    }
+    uring_teardown(t);
+    return rc;
+}
+
+/*
+ * The vtables take no context argument, so each target gets its own set of
+ * thin wrappers that lock the target and forward to the shared code.
+ */
+#define URING_TARGET_ENTRY_POINTS(name, target)                                \
+    static int name##_send(const char *msg, size_t len) {                      \
+        struct iovec iov = {(void *)msg, len};                                 \
+        int rc;                                                                \
+        if (!msg) {                                                            \
+            return -1;                                                         \
+        }                                                                      \
+        pthread_mutex_lock(&target.lock);                                      \
+        rc = send_locked(&target, &iov, 1);                                    \
+        pthread_mutex_unlock(&target.lock);                                    \
+        return rc;                                                             \
+    }                                                                          \
+    static int name##_send_batch(const struct iovec *iov, size_t n) {          \
+        int rc;                                                                \
+        if (!iov && n > 0) {                                                   \
+            return -1;                                                         \
+        }                                                                      \
+        pthread_mutex_lock(&target.lock);                                      \
+        rc = send_locked(&target, iov, n);                                     \
+        pthread_mutex_unlock(&target.lock);                                    \
+        return rc;                                                             \
+    }                                                                          \
+    static int name##_flush(void) {                                            \
+        int rc;                                                                \
+        pthread_mutex_lock(&target.lock);                                      \
+        rc = flush_locked(&target);                                            \
+        pthread_mutex_unlock(&target.lock);                                    \
+        return rc;                                                             \
+    }                                                                          \
+    static int name##_connect(void) {                                          \
+        int rc;                                                                \
+        pthread_mutex_lock(&target.lock);                                      \
+        rc = connect_locked(&target);                                          \
+        pthread_mutex_unlock(&target.lock);                                    \
+        return rc;                                                             \
+    }                                                                          \
+    static int name##_disconnect(void) {                                       \
+        int rc;                                                                \
+        pthread_mutex_lock(&target.lock);                                      \
+        rc = disconnect_locked(&target);                                       \
+        pthread_mutex_unlock(&target.lock);                                    \
+        return rc;                                                             \
+    }                                                                          \
+    static const Sender name##_sender = {.send = name##_send};                 \
+    static const BatchSender name##_batch_sender = {                           \
+        .send_batch = name##_send_batch};                                      \
+    static const Flushable name##_flushable = {.flush = name##_flush};         \
+    static const Connectable name##_connectable = {                            \
+        .connect = name##_connect,                                             \
+        .disconnect = name##_disconnect,                                       \
+    };
+
+URING_TARGET_ENTRY_POINTS(uring_disk, uring_disk)
+URING_TARGET_ENTRY_POINTS(uring_tcp, uring_tcp)
+URING_TARGET_ENTRY_POINTS(uring_udp, uring_udp)
+
+int uring_transport_configure(const UringTransportOptions *opts) {
+    const char *path;
+    const char *host;
+
+    if (!opts || uring_disk.connected || uring_tcp.connected ||
+        uring_udp.connected) {
+        return -1;
+    }
+    path = opts->disk_path ? opts->disk_path : LOG_FILE;
+    host = opts->host ? opts->host : LOG_HOST;
+    if (strlen(path) >= sizeof(uring_opts.disk_path) ||
+        strlen(host) >= sizeof(uring_opts.host)) {
+        return -1;
+    }
+    strcpy(uring_opts.disk_path, path);
+    strcpy(uring_opts.host, host);
+    uring_opts.port = opts->port ? opts->port : LOG_PORT;
+    uring_opts.queue_depth =
+        opts->queue_depth ? opts->queue_depth : URING_QUEUE_DEPTH;
+    return 0;
+}
+
+const Transport URING_DISK_TRANSPORT = {
+    .sender = &uring_disk_sender,
+    .batch_sender = &uring_disk_batch_sender,
+    .flushable = &uring_disk_flushable,
+    .connectable = &uring_disk_connectable,
+};
+const Transport URING_TCP_TRANSPORT = {
+    .sender = &uring_tcp_sender,
+    .batch_sender = &uring_tcp_batch_sender,
+    .flushable = &uring_tcp_flushable,
+    .connectable = &uring_tcp_connectable,
+};
+const Transport URING_UDP_TRANSPORT = {
+    .sender = &uring_udp_sender,
+    .batch_sender = &uring_udp_batch_sender,
+    .flushable = &uring_udp_flushable,
+    .connectable = &uring_udp_connectable,
+};
+
+int uring_transport_stats(const Transport *tr, UringTransportStats *out) {
+    UringTarget *t;
+
+    if (tr == &URING_DISK_TRANSPORT) {
+        t = &uring_disk;
+    } else if (tr == &URING_TCP_TRANSPORT) {
+        t = &uring_tcp;
+    } else if (tr == &URING_UDP_TRANSPORT) {
+        t = &uring_udp;
+    } else {
+        return -1;
+    }
+    if (!out) {
+        return -1;
+    }
+    pthread_mutex_lock(&t->lock);
+    *out = t->stats;
+    pthread_mutex_unlock(&t->lock);
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include "include/user_table.h"
+#include "include/json_quote.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define USER_TABLE_INITIAL 64
+
+static uint64_t user_hash(const char *s, size_t len) {
+    uint64_t h = 1469598103934665603ULL;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)s[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+/* The slot holding name, or the free slot it would take. */
+static unsigned int *index_slot(const UserTable *t, const char *name,
+                                size_t len) {
+    size_t mask = t->index_cap - 1;
+    size_t i = (size_t)user_hash(name, len) & mask;
+
+    for (;;) {
+        unsigned int *slot = &t->index[i];
+        const InternedUser *u;
+
+        if (*slot == 0) {
+            return slot;
+        }
+        u = &t->users[*slot - 1];
+        if (u->name_len == len && memcmp(u->name, name, len) == 0) {
+            return slot;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+static int index_grow(UserTable *t) {
+    size_t cap = t->index_cap ? t->index_cap * 2 : USER_TABLE_INITIAL * 2;
+    unsigned int *old = t->index;
+    size_t i;
+
+    t->index = calloc(cap, sizeof(*t->index));
+    if (!t->index) {
+        t->index = old;
+        return -1;
+    }
+    t->index_cap = cap;
+    for (i = 0; i < t->count; i++) {
+        const InternedUser *u = &t->users[i];
+        *index_slot(t, u->name, u->name_len) = (unsigned int)i + 1;
+    }
+    free(old);
+    return 0;
+}
+
+int user_table_init(UserTable *t) {
+    if (!t) {
+        return -1;
+    }
+    memset(t, 0, sizeof(*t));
+    return index_grow(t);
+}
+
+void user_table_clear(UserTable *t) {
+    size_t i;
+
+    if (!t) {
+        return;
+    }
+    /* name and json share one allocation. */
+    for (i = 0; i < t->count; i++) {
+        free((char *)t->users[i].name);
+    }
+    t->count = 0;
+    if (t->index) {
+        memset(t->index, 0, t->index_cap * sizeof(*t->index));
+    }
+}
+
+void user_table_destroy(UserTable *t) {
+    if (!t) {
+        return;
+    }
+    user_table_clear(t);
+    free(t->users);
+    free(t->index);
+    memset(t, 0, sizeof(*t));
+}
+
+long user_table_intern(UserTable *t, const char *user) {
+    size_t len;
+    unsigned int *slot;
+    InternedUser *u;
+    char *mem;
+    int json_len;
+
+    if (!t || !t->index || !user) {
+        return -1;
+    }
+    len = strlen(user);
+    slot = index_slot(t, user, len);
+    if (*slot != 0) {
+        return (long)*slot - 1;
+    }
+    if (t->count >= UINT32_MAX - 1) {
+        return -1;
+    }
+    /*
+     * Keep the index at most half full so probes stay short. If it cannot
+     * grow, it may fill up to one free slot, which every probe stops at.
+     */
+    if ((t->count + 1) * 2 > t->index_cap) {
+        if (index_grow(t) == 0) {
+            slot = index_slot(t, user, len);
+        } else if (t->count + 2 > t->index_cap) {
+            return -1;
+        }
+    }
+
+    if (t->count == t->cap) {
+        size_t cap = t->cap ? t->cap * 2 : USER_TABLE_INITIAL;
+        InternedUser *users = realloc(t->users, cap * sizeof(*users));
+
+        if (!users) {
+            return -1;
+        }
+        t->users = users;
+        t->cap = cap;
+    }
+    mem = malloc(len + 1 + JSON_QUOTE_MAX_LEN(len));
+    if (!mem) {
+        return -1;
+    }
+    memcpy(mem, user, len + 1);
+    json_len = json_quote(user, mem + len + 1, JSON_QUOTE_MAX_LEN(len));
+    if (json_len < 0) {
+        free(mem);
+        return -1;
+    }
+
+    u = &t->users[t->count];
+    u->name = mem;
+    u->name_len = len;
+    u->json = mem + len + 1;
+    u->json_len = (size_t)json_len;
+    *slot = (unsigned int)++t->count;
+    return (long)t->count - 1;
+}
+
+void user_table_bind(const UserTable *t, TransactionBatch *b) {
+    if (!t || !b) {
+        return;
+    }
+    b->users = t->users;
+    b->user_count = t->count;
+}
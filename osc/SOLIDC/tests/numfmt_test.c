@@ -0,0 +1,286 @@
+#include "numfmt.h"
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Checks numfmt byte for byte against the snprintf conversions it
+ * replaces: "%.2f", cJSON's "%1.15g"/"%1.17g" rule, "%u" and "%d". Values
+ * come from fixed grids, every exact half-cent tie in range, edge cases
+ * and a seeded stream of random bit patterns, so a run is reproducible.
+ * Every truncating buffer size is tried for a prefix of each set.
+ */
+
+#define REF_BUF 512
+#define RANDOM_DOUBLES 500000
+#define RANDOM_U32 2000000
+#define CENTS_LIMIT 2000000 /* the cents grid spans -20000.00..20000.00 */
+#define TRUNCATE_CHECKS 200000
+#define MAX_REPORTS 20
+
+typedef int (*DoubleFormat)(char *buf, size_t sz, double v);
+typedef int (*DoubleReference)(char *buf, size_t sz, double v);
+
+static unsigned long checks;
+static unsigned long failures;
+static unsigned long truncate_budget;
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t next_random(void) {
+    uint64_t x = rng_state;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    rng_state = x;
+    return x;
+}
+
+static double from_bits(uint64_t bits) {
+    double v;
+
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+static double random_double(void) {
+    return from_bits(next_random());
+}
+
+static int ref_fixed2(char *buf, size_t sz, double v) {
+    return snprintf(buf, sz, "%.2f", v);
+}
+
+/* cJSON's print_number before numfmt, for a non-integer value. */
+static int ref_g15(char *buf, size_t sz, double v) {
+    double test = 0.0;
+    double max_val;
+    int n = snprintf(buf, sz, "%1.15g", v);
+
+    if (sscanf(buf, "%lg", &test) == 1) {
+        max_val = fabs(test) > fabs(v) ? fabs(test) : fabs(v);
+        if (fabs(test - v) <= max_val * DBL_EPSILON) {
+            return n;
+        }
+    }
+    return snprintf(buf, sz, "%1.17g", v);
+}
+
+static int ref_json(char *buf, size_t sz, double v) {
+    int valueint;
+
+    if (isnan(v) || isinf(v)) {
+        return snprintf(buf, sz, "null");
+    }
+    if (v >= INT_MAX) {
+        valueint = INT_MAX;
+    } else if (v <= (double)INT_MIN) {
+        valueint = INT_MIN;
+    } else {
+        valueint = (int)v;
+    }
+    if (v == (double)valueint) {
+        return snprintf(buf, sz, "%d", valueint);
+    }
+    return ref_g15(buf, sz, v);
+}
+
+static void report(const char *what, double v, const char *want, int want_len,
+                   const char *got, int got_len, size_t sz) {
+    failures++;
+    if (failures <= MAX_REPORTS) {
+        fprintf(stderr, "%s(%a, sz %zu): want %d \"%.*s\", got %d \"%.*s\"\n",
+                what, v, sz, want_len, want_len > 0 ? want_len : 0, want,
+                got_len, got_len > 0 ? got_len : 0, got);
+    }
+}
+
+/* Full-size buffer, then every size too small by at least one byte. */
+static void check_double(const char *what, DoubleFormat f,
+                         DoubleReference ref, double v) {
+    char want[REF_BUF];
+    char got[REF_BUF];
+    int want_len = ref(want, sizeof(want), v);
+    int got_len;
+    size_t sz;
+
+    checks++;
+    got_len = f(got, sizeof(got), v);
+    if (got_len != want_len || memcmp(got, want, (size_t)want_len) != 0) {
+        report(what, v, want, want_len, got, got_len, sizeof(got));
+        return;
+    }
+    if (truncate_budget == 0) {
+        return;
+    }
+    truncate_budget--;
+    for (sz = 0; sz <= (size_t)want_len; sz++) {
+        int expect = sz < (size_t)want_len ? -1 : want_len;
+
+        checks++;
+        memset(got, '#', sizeof(got));
+        got_len = f(got, sz, v);
+        if (got_len != expect || got[sz] != '#' ||
+            (expect > 0 && memcmp(got, want, (size_t)want_len) != 0)) {
+            report(what, v, want, expect, got, got_len, sz);
+        }
+    }
+}
+
+static void check_all(double v) {
+    check_double("numfmt_fixed2", numfmt_fixed2, ref_fixed2, v);
+    check_double("numfmt_json", numfmt_json, ref_json, v);
+    if (!isnan(v) && !isinf(v)) {
+        check_double("numfmt_g15", numfmt_g15, ref_g15, v);
+    }
+}
+
+static void check_u32(uint32_t v) {
+    char want[REF_BUF];
+    char got[NUMFMT_U32_MAX_LEN];
+    int want_len = snprintf(want, sizeof(want), "%u", v);
+    size_t got_len = numfmt_u32(got, v);
+
+    checks++;
+    if (got_len != (size_t)want_len || memcmp(got, want, got_len) != 0) {
+        report("numfmt_u32", v, want, want_len, got, (int)got_len,
+               sizeof(got));
+    }
+}
+
+static void check_i32(int32_t v) {
+    char want[REF_BUF];
+    char got[NUMFMT_I32_MAX_LEN];
+    int want_len = snprintf(want, sizeof(want), "%d", v);
+    size_t got_len = numfmt_i32(got, v);
+
+    checks++;
+    if (got_len != (size_t)want_len || memcmp(got, want, got_len) != 0) {
+        report("numfmt_i32", v, want, want_len, got, (int)got_len,
+               sizeof(got));
+    }
+}
+
+/* The column variants must agree with the scalar calls cell for cell. */
+static void check_columns(void) {
+    enum { N = 4096 };
+    static double amounts[N];
+    static unsigned int tids[N];
+    static NumfmtCell fixed[N];
+    static NumfmtCell json[N];
+    static NumfmtCell u32[N];
+    char want[REF_BUF];
+    size_t i;
+
+    for (i = 0; i < N; i++) {
+        amounts[i] = i % 2 ? random_double() : (double)(i * 37) / 100.0;
+        tids[i] = (unsigned int)next_random();
+    }
+    numfmt_fixed2_column(amounts, N, fixed);
+    numfmt_json_column(amounts, N, json);
+    numfmt_u32_column(tids, N, u32);
+
+    for (i = 0; i < N; i++) {
+        int len = numfmt_fixed2(want, sizeof(want), amounts[i]);
+        int cell = len <= NUMFMT_CELL_SIZE ? len : 0;
+
+        checks += 3;
+        if (fixed[i].len != cell ||
+            memcmp(fixed[i].s, want, fixed[i].len) != 0) {
+            report("numfmt_fixed2_column", amounts[i], want, cell,
+                   fixed[i].s, fixed[i].len, NUMFMT_CELL_SIZE);
+        }
+        len = numfmt_json(want, sizeof(want), amounts[i]);
+        if (json[i].len != len || memcmp(json[i].s, want, (size_t)len) != 0) {
+            report("numfmt_json_column", amounts[i], want, len, json[i].s,
+                   json[i].len, NUMFMT_CELL_SIZE);
+        }
+        len = (int)numfmt_u32(want, tids[i]);
+        if (u32[i].len != len || memcmp(u32[i].s, want, (size_t)len) != 0) {
+            report("numfmt_u32_column", tids[i], want, len, u32[i].s,
+                   u32[i].len, NUMFMT_CELL_SIZE);
+        }
+    }
+}
+
+int main(void) {
+    static const double edges[] = {
+        0.0, -0.0, 0.005, -0.005, 0.015, 0.025, 0.125, 0.375, 1e-4, 9.9999e-5,
+        1e-300, 4.9406564584124654e-324, 2.2250738585072014e-308,
+        DBL_MAX, -DBL_MAX, 1e15, 1e15 - 1, 999999999999999.9, 1e16, 1e20,
+        1e21, 1e22, 4503599627370496.5, 9007199254740993.0, 2147483647.0,
+        2147483648.0, -2147483648.0, -2147483649.0, 2147483647.5,
+        0.1 + 0.2, 1.0 / 3.0, 123456789.125, 5e-5, 1e300,
+    };
+    long c;
+    long k;
+    size_t i;
+
+    truncate_budget = TRUNCATE_CHECKS;
+
+    for (i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        check_all(edges[i]);
+        check_all(-edges[i]);
+    }
+    check_all(NAN);
+    check_all(-NAN);
+    check_all(INFINITY);
+    check_all(-INFINITY);
+    /* Quiet and signalling NaN payloads, smallest subnormal bits. */
+    check_all(from_bits(0x7ff8000000000001ULL));
+    check_all(from_bits(0x7ff0000000000001ULL));
+    check_all(from_bits(0x0000000000000001ULL));
+    check_all(from_bits(0x000fffffffffffffULL));
+
+    for (c = -CENTS_LIMIT; c <= CENTS_LIMIT; c++) {
+        check_all((double)c / 100.0);
+    }
+    /* Half-cent midpoints, which only come close to a tie... */
+    for (c = -CENTS_LIMIT; c < CENTS_LIMIT; c++) {
+        check_all(((double)c + 0.5) / 100.0);
+    }
+    /* ...and exact binary ties such as x.125 and x.375. */
+    for (k = -20000 * 8; k <= 20000 * 8; k++) {
+        check_all((double)k / 8.0);
+        check_all((double)k / 1024.0);
+    }
+
+    for (i = 0; i < RANDOM_DOUBLES; i++) {
+        check_all(random_double());
+    }
+    /* Random values in the range amounts actually take. */
+    for (i = 0; i < RANDOM_DOUBLES; i++) {
+        check_all((double)(next_random() >> 11) / 9007199254740992.0 * 1e6);
+    }
+
+    for (i = 0; i < 1000000; i++) {
+        check_u32((uint32_t)i);
+        check_i32((int32_t)i);
+        check_i32(-(int32_t)i);
+    }
+    for (i = 0; i < 32; i++) {
+        uint32_t p = (uint32_t)1 << i;
+
+        check_u32(p - 1);
+        check_u32(p);
+        check_u32(p + 1);
+    }
+    check_u32(UINT32_MAX);
+    check_i32(INT32_MAX);
+    check_i32(INT32_MIN);
+    for (i = 0; i < RANDOM_U32; i++) {
+        uint64_t r = next_random();
+
+        check_u32((uint32_t)r);
+        check_i32((int32_t)(uint32_t)(r >> 32));
+    }
+
+    check_columns();
+
+    printf("numfmt: %lu checks, %lu failures\n", checks, failures);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,709 @@
+#define _GNU_SOURCE
+#include "binlog.h"
+#include "cJSON.h"
+#include "config.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Stand-in for the collector at LOG_HOST:LOG_PORT. One epoll loop accepts
+ * TCP_TRANSPORT connections and reads UDP_TRANSPORT datagrams on the same
+ * port, splits the byte streams into records (JSON objects, TEXT lines or
+ * BINARY frames, detected per connection from the first whole record),
+ * validates each one and counts it.
+ *
+ * Faults can be injected to exercise the transports' recovery paths: a
+ * delay after every read (a slow consumer), periodic stalls during which
+ * nothing is read, and closing a connection after it delivered N records.
+ *
+ * When a record's user is "t<ns>" (as trload writes them), the collector
+ * also records now - ns on CLOCK_MONOTONIC: the latency from the time the
+ * record was scheduled to be sent, not from when it actually was.
+ */
+
+#define COLLECT_MAX_CONNS 64
+#define COLLECT_BUFFER (256 * 1024)
+#define COLLECT_DATAGRAM 65536
+#define COLLECT_EVENTS 64
+/* 16 linear sub-buckets per power of two: under 7% relative error. */
+#define LAT_SUB_BITS 4
+#define LAT_SUB (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS (64 * LAT_SUB)
+
+typedef enum RecordFormat {
+    FORMAT_AUTO = 0,
+    FORMAT_JSON,
+    FORMAT_TEXT,
+    FORMAT_BINARY,
+} RecordFormat;
+
+typedef struct CollectOptions {
+    const char *host;
+    unsigned short port;
+    RecordFormat format;
+    unsigned int delay_us;          /* after every read */
+    unsigned int stall_every_ms;    /* 0 = no stalls */
+    unsigned int stall_ms;
+    unsigned long long disconnect_every; /* records per connection, 0 = never */
+    unsigned int duration_s;        /* 0 = until SIGINT/SIGTERM */
+    unsigned long long expect;      /* stop after this many records */
+    unsigned int report_ms;         /* periodic progress, 0 = none */
+} CollectOptions;
+
+typedef struct Conn {
+    int fd;
+    RecordFormat format;
+    unsigned long long records;
+    size_t used;
+    char buf[COLLECT_BUFFER];
+} Conn;
+
+typedef struct CollectStats {
+    unsigned long long records;
+    unsigned long long bytes;
+    unsigned long long malformed;
+    unsigned long long aggregates; /* of records, aggregate_by_user windows */
+    unsigned long long datagrams;
+    unsigned long long accepted;
+    unsigned long long closed_by_peer;
+    unsigned long long injected_disconnects;
+    unsigned long long stalls;
+    unsigned long long lat_count;
+    unsigned long long lat_max;
+    unsigned long long lat[LAT_BUCKETS];
+} CollectStats;
+
+static volatile sig_atomic_t stop_requested;
+static CollectStats stats;
+static Conn *conns[COLLECT_MAX_CONNS];
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_us(unsigned long long us) {
+    struct timespec ts;
+
+    ts.tv_sec = (time_t)(us / 1000000);
+    ts.tv_nsec = (long)(us % 1000000) * 1000L;
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR && !stop_requested) {
+    }
+}
+
+static size_t lat_bucket(unsigned long long v) {
+    int msb;
+
+    if (v < LAT_SUB) {
+        return (size_t)v;
+    }
+    msb = 63 - __builtin_clzll(v);
+    return (size_t)(msb - LAT_SUB_BITS + 1) * LAT_SUB +
+           (size_t)((v >> (msb - LAT_SUB_BITS)) & (LAT_SUB - 1));
+}
+
+/* Lowest value that falls into bucket b. */
+static unsigned long long lat_bucket_floor(size_t b) {
+    size_t major = b / LAT_SUB;
+
+    if (major == 0) {
+        return b;
+    }
+    return (unsigned long long)(LAT_SUB + b % LAT_SUB)
+           << (major - 1);
+}
+
+static void lat_record(const char *user, size_t len) {
+    unsigned long long sent = 0;
+    long long now;
+    size_t i;
+
+    if (len < 2 || user[0] != 't') {
+        return;
+    }
+    for (i = 1; i < len; i++) {
+        if (user[i] < '0' || user[i] > '9') {
+            return;
+        }
+        sent = sent * 10 + (unsigned long long)(user[i] - '0');
+    }
+    now = now_ns();
+    if ((unsigned long long)now < sent) {
+        return;
+    }
+    sent = (unsigned long long)now - sent;
+    stats.lat[lat_bucket(sent)]++;
+    stats.lat_count++;
+    if (sent > stats.lat_max) {
+        stats.lat_max = sent;
+    }
+}
+
+static unsigned long long lat_quantile(double q) {
+    unsigned long long rank = (unsigned long long)(q * (double)stats.lat_count);
+    unsigned long long seen = 0;
+    size_t b;
+
+    for (b = 0; b < LAT_BUCKETS; b++) {
+        seen += stats.lat[b];
+        if (seen > rank) {
+            return lat_bucket_floor(b);
+        }
+    }
+    return stats.lat_max;
+}
+
+/* Length of the JSON object at p, 0 if incomplete, -1 if not an object. */
+static long json_extent(const char *p, size_t n) {
+    int depth = 0;
+    int in_str = 0;
+    size_t i;
+
+    if (p[0] != '{') {
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        char c = p[i];
+
+        if (in_str) {
+            if (c == '\\') {
+                i++;
+            } else if (c == '"') {
+                in_str = 0;
+            }
+        } else if (c == '"') {
+            in_str = 1;
+        } else if (c == '{') {
+            depth++;
+        } else if (c == '}' && --depth == 0) {
+            return (long)(i + 1);
+        }
+    }
+    return 0;
+}
+
+static int json_number(const cJSON *root, const char *key) {
+    return cJSON_IsNumber(cJSON_GetObjectItemCaseSensitive(root, key));
+}
+
+static int json_valid(const char *p, size_t n) {
+    cJSON *root = cJSON_ParseWithLength(p, n);
+    const cJSON *user;
+    int ok;
+
+    if (!root) {
+        return 0;
+    }
+    user = cJSON_GetObjectItemCaseSensitive(root, "user");
+    ok = cJSON_IsString(user) && json_number(root, "tid") &&
+         json_number(root, "amount");
+    if (ok) {
+        lat_record(user->valuestring, strlen(user->valuestring));
+    } else if (cJSON_IsString(user) && json_number(root, "count") &&
+               json_number(root, "sum") && json_number(root, "window_ms")) {
+        stats.aggregates++;
+        ok = 1;
+    }
+    cJSON_Delete(root);
+    return ok;
+}
+
+/* "Aggregate: User %s count %u sum %.2f window_ms %u", no newline. */
+static int text_aggregate_valid(const char *p, size_t n) {
+    static const char prefix[] = "Aggregate: User ";
+    const char *end = p + n;
+    const char *count;
+    const char *sum;
+
+    if (n < sizeof(prefix) - 1 || memcmp(p, prefix, sizeof(prefix) - 1)) {
+        return 0;
+    }
+    p += sizeof(prefix) - 1;
+    count = memmem(p, (size_t)(end - p), " count ", 7);
+    sum = count ? memmem(count, (size_t)(end - count), " sum ", 5) : NULL;
+    if (!sum || !memmem(sum, (size_t)(end - sum), " window_ms ", 11)) {
+        return 0;
+    }
+    stats.aggregates++;
+    return 1;
+}
+
+/* "Transaction %u: User %s sent %.2f" without the newline. */
+static int text_valid(const char *p, size_t n) {
+    static const char prefix[] = "Transaction ";
+    static const char user_tag[] = ": User ";
+    const char *end = p + n;
+    const char *user;
+    const char *sent;
+
+    if (n > 0 && p[0] == 'A') {
+        return text_aggregate_valid(p, n);
+    }
+    if (n < sizeof(prefix) - 1 || memcmp(p, prefix, sizeof(prefix) - 1)) {
+        return 0;
+    }
+    p += sizeof(prefix) - 1;
+    if (p == end || *p < '0' || *p > '9') {
+        return 0;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+        p++;
+    }
+    if ((size_t)(end - p) < sizeof(user_tag) - 1 ||
+        memcmp(p, user_tag, sizeof(user_tag) - 1)) {
+        return 0;
+    }
+    user = p + sizeof(user_tag) - 1;
+    sent = memmem(user, (size_t)(end - user), " sent ", 6);
+    if (!sent) {
+        return 0;
+    }
+    lat_record(user, (size_t)(sent - user));
+    return 1;
+}
+
+/* 1 when p starts with tag, 0 when it cannot, -1 when n is too short. */
+static int starts_with(const char *p, size_t n, const char *tag) {
+    size_t len = strlen(tag);
+
+    if (memcmp(p, tag, n < len ? n : len) != 0) {
+        return 0;
+    }
+    return n < len ? -1 : 1;
+}
+
+/*
+ * Detects the format from the first whole record: a BINARY frame that
+ * decodes, a TEXT line prefix, or a JSON object that parses, tried in that
+ * order since a frame's length varint can be 'T' or '{'. FORMAT_AUTO means
+ * p does not hold enough to tell yet; FORMAT_BINARY when nothing fits, so
+ * consume() counts the bytes as malformed.
+ */
+static RecordFormat detect(const char *p, size_t n, RecordFormat forced) {
+    BinlogRecord r;
+    BinlogStatus st;
+    size_t len;
+    int text;
+    int agg;
+    long ext;
+
+    if (forced != FORMAT_AUTO) {
+        return forced;
+    }
+    st = binlog_decode((const unsigned char *)p, n, &r, &len);
+    if (st == BINLOG_OK) {
+        return FORMAT_BINARY;
+    }
+    text = starts_with(p, n, "Transaction ");
+    agg = starts_with(p, n, "Aggregate: User ");
+    if (text == 1 || agg == 1) {
+        return FORMAT_TEXT;
+    }
+    ext = json_extent(p, n);
+    if (ext > 0) {
+        cJSON *root = cJSON_ParseWithLength(p, (size_t)ext);
+
+        if (cJSON_IsObject(root)) {
+            cJSON_Delete(root);
+            return FORMAT_JSON;
+        }
+        cJSON_Delete(root);
+    }
+    if (st == BINLOG_INCOMPLETE || text < 0 || agg < 0 || ext == 0) {
+        return FORMAT_AUTO;
+    }
+    return FORMAT_BINARY;
+}
+
+/*
+ * Consumes whole records from p and returns the bytes used; a trailing
+ * partial record is left for the next read. A framing error skips the
+ * rest of the buffer, since the stream cannot be resynchronised.
+ */
+static size_t consume(const char *p, size_t n, RecordFormat format,
+                      unsigned long long *records) {
+    size_t off = 0;
+
+    while (off < n) {
+        const char *rec = p + off;
+        size_t avail = n - off;
+        size_t len;
+        int ok;
+
+        if (format == FORMAT_JSON) {
+            long ext = json_extent(rec, avail);
+            if (ext == 0) {
+                break;
+            }
+            if (ext < 0) {
+                stats.malformed++;
+                return n;
+            }
+            len = (size_t)ext;
+            ok = json_valid(rec, len);
+        } else if (format == FORMAT_TEXT) {
+            const char *nl = memchr(rec, '\n', avail);
+            if (!nl) {
+                break;
+            }
+            len = (size_t)(nl - rec) + 1;
+            ok = text_valid(rec, len - 1);
+        } else {
+            BinlogRecord r;
+            BinlogStatus st = binlog_decode((const unsigned char *)rec, avail,
+                                            &r, &len);
+            if (st == BINLOG_INCOMPLETE) {
+                break;
+            }
+            if (st == BINLOG_MALFORMED) {
+                stats.malformed++;
+                return n;
+            }
+            ok = st == BINLOG_OK;
+            if (ok && r.version == BINLOG_AGGREGATE_VERSION) {
+                stats.aggregates++;
+            } else if (ok) {
+                lat_record(r.user, r.user_len);
+            }
+        }
+        if (ok) {
+            stats.records++;
+            (*records)++;
+        } else {
+            stats.malformed++;
+        }
+        off += len;
+    }
+    return off;
+}
+
+static void conn_close(Conn **slot, int epfd) {
+    Conn *c = *slot;
+
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    if (c->used > 0) {
+        stats.malformed++; /* truncated record */
+    }
+    free(c);
+    *slot = NULL;
+}
+
+static void conn_read(Conn **slot, int epfd, const CollectOptions *opts) {
+    Conn *c = *slot;
+
+    for (;;) {
+        ssize_t r = read(c->fd, c->buf + c->used, sizeof(c->buf) - c->used);
+        size_t used;
+
+        if (r == 0) {
+            stats.closed_by_peer++;
+            conn_close(slot, epfd);
+            return;
+        }
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                conn_close(slot, epfd);
+            }
+            return;
+        }
+        stats.bytes += (unsigned long long)r;
+        c->used += (size_t)r;
+        if (c->format == FORMAT_AUTO) {
+            c->format = detect(c->buf, c->used, opts->format);
+        }
+        used = c->format == FORMAT_AUTO
+                   ? 0
+                   : consume(c->buf, c->used, c->format, &c->records);
+        memmove(c->buf, c->buf + used, c->used - used);
+        c->used -= used;
+        if (c->used == sizeof(c->buf)) {
+            stats.malformed++; /* a record larger than the buffer */
+            c->used = 0;
+        }
+        if (opts->delay_us) {
+            sleep_us(opts->delay_us);
+        }
+        if (opts->disconnect_every && c->records >= opts->disconnect_every) {
+            stats.injected_disconnects++;
+            c->used = 0;
+            conn_close(slot, epfd);
+            return;
+        }
+    }
+}
+
+static void udp_read(int fd, const CollectOptions *opts) {
+    static char buf[COLLECT_DATAGRAM];
+    unsigned long long records = 0;
+
+    for (;;) {
+        ssize_t r = recv(fd, buf, sizeof(buf), 0);
+        RecordFormat format;
+        size_t used;
+
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        stats.datagrams++;
+        stats.bytes += (unsigned long long)r;
+        if (r == 0) {
+            continue;
+        }
+        format = detect(buf, (size_t)r, opts->format);
+        /* A datagram holds whole records; undecided means malformed. */
+        used = consume(buf, (size_t)r,
+                       format == FORMAT_AUTO ? FORMAT_BINARY : format,
+                       &records);
+        if (used < (size_t)r) {
+            stats.malformed++; /* a record split across datagrams */
+        }
+        if (opts->delay_us) {
+            sleep_us(opts->delay_us);
+        }
+    }
+}
+
+static void accept_all(int lfd, int epfd) {
+    for (;;) {
+        struct epoll_event ev;
+        int fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        size_t i;
+
+        if (fd < 0) {
+            return;
+        }
+        for (i = 0; i < COLLECT_MAX_CONNS && conns[i]; i++) {
+        }
+        if (i == COLLECT_MAX_CONNS ||
+            !(conns[i] = calloc(1, sizeof(Conn)))) {
+            close(fd);
+            continue;
+        }
+        conns[i]->fd = fd;
+        ev.events = EPOLLIN;
+        ev.data.u64 = i + 2;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            free(conns[i]);
+            conns[i] = NULL;
+            continue;
+        }
+        stats.accepted++;
+    }
+}
+
+static int open_socket(const CollectOptions *opts, int type) {
+    struct sockaddr_in addr;
+    int one = 1;
+    int fd = socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opts->port);
+    if (inet_pton(AF_INET, opts->host, &addr.sin_addr) <= 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+        bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        (type == SOCK_STREAM && listen(fd, 64) < 0)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void print_stats(FILE *out) {
+    fprintf(out,
+            "records=%llu aggregates=%llu bytes=%llu malformed=%llu "
+            "datagrams=%llu connections=%llu peer_closed=%llu "
+            "injected_disconnects=%llu stalls=%llu\n",
+            stats.records, stats.aggregates, stats.bytes, stats.malformed,
+            stats.datagrams, stats.accepted, stats.closed_by_peer,
+            stats.injected_disconnects, stats.stalls);
+    if (stats.lat_count > 0) {
+        fprintf(out,
+                "latency from scheduled send (us): n=%llu p50=%.1f p90=%.1f "
+                "p99=%.1f p99.9=%.1f max=%.1f\n",
+                stats.lat_count, (double)lat_quantile(0.5) / 1e3,
+                (double)lat_quantile(0.9) / 1e3,
+                (double)lat_quantile(0.99) / 1e3,
+                (double)lat_quantile(0.999) / 1e3,
+                (double)stats.lat_max / 1e3);
+    }
+    fflush(out);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [--host ADDR] [--port N] [--format auto|json|text|"
+            "binary]\n"
+            "          [--delay-us N] [--stall-ms N --stall-every-ms N]\n"
+            "          [--disconnect-every N] [--duration-s N] "
+            "[--expect N] [--report-ms N]\n"
+            "  listens for TCP and UDP on the same port (default %s:%d)\n",
+            prog, LOG_HOST, LOG_PORT);
+}
+
+static int parse_args(int argc, char **argv, CollectOptions *o) {
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (!v) {
+            return -1;
+        }
+        i++;
+        if (strcmp(a, "--host") == 0) {
+            o->host = v;
+        } else if (strcmp(a, "--port") == 0) {
+            o->port = (unsigned short)strtoul(v, NULL, 10);
+        } else if (strcmp(a, "--format") == 0) {
+            if (strcmp(v, "json") == 0) {
+                o->format = FORMAT_JSON;
+            } else if (strcmp(v, "text") == 0) {
+                o->format = FORMAT_TEXT;
+            } else if (strcmp(v, "binary") == 0) {
+                o->format = FORMAT_BINARY;
+            } else if (strcmp(v, "auto") != 0) {
+                return -1;
+            }
+        } else if (strcmp(a, "--delay-us") == 0) {
+            o->delay_us = (unsigned int)strtoul(v, NULL, 10);
+        } else if (strcmp(a, "--stall-ms") == 0) {
+            o->stall_ms = (unsigned int)strtoul(v, NULL, 10);
+        } else if (strcmp(a, "--stall-every-ms") == 0) {
+            o->stall_every_ms = (unsigned int)strtoul(v, NULL, 10);
+        } else if (strcmp(a, "--disconnect-every") == 0) {
+            o->disconnect_every = strtoull(v, NULL, 10);
+        } else if (strcmp(a, "--duration-s") == 0) {
+            o->duration_s = (unsigned int)strtoul(v, NULL, 10);
+        } else if (strcmp(a, "--expect") == 0) {
+            o->expect = strtoull(v, NULL, 10);
+        } else if (strcmp(a, "--report-ms") == 0) {
+            o->report_ms = (unsigned int)strtoul(v, NULL, 10);
+        } else {
+            return -1;
+        }
+    }
+    return o->port ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+    CollectOptions opts = {.host = LOG_HOST, .port = LOG_PORT};
+    struct epoll_event events[COLLECT_EVENTS];
+    struct epoll_event ev;
+    struct sigaction sa;
+    long long start;
+    long long next_stall;
+    long long next_report;
+    int lfd;
+    int ufd;
+    int epfd;
+    size_t i;
+
+    if (parse_args(argc, argv, &opts) < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    lfd = open_socket(&opts, SOCK_STREAM);
+    ufd = open_socket(&opts, SOCK_DGRAM);
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (lfd < 0 || ufd < 0 || epfd < 0) {
+        perror("trcollect: listen");
+        return EXIT_FAILURE;
+    }
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev);
+    ev.data.u64 = 1;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, ufd, &ev);
+    fprintf(stderr, "trcollect: listening on %s:%u (tcp+udp)\n", opts.host,
+            opts.port);
+
+    start = now_ns();
+    next_stall = opts.stall_every_ms
+                     ? start + (long long)opts.stall_every_ms * 1000000LL
+                     : 0;
+    next_report =
+        opts.report_ms ? start + (long long)opts.report_ms * 1000000LL : 0;
+
+    while (!stop_requested) {
+        int n = epoll_wait(epfd, events, COLLECT_EVENTS, 50);
+        long long now;
+        int k;
+
+        for (k = 0; k < n; k++) {
+            unsigned long long id = events[k].data.u64;
+
+            if (id == 0) {
+                accept_all(lfd, epfd);
+            } else if (id == 1) {
+                udp_read(ufd, &opts);
+            } else if (conns[id - 2]) {
+                conn_read(&conns[id - 2], epfd, &opts);
+            }
+        }
+
+        now = now_ns();
+        if (next_stall && now >= next_stall) {
+            stats.stalls++;
+            sleep_us((unsigned long long)opts.stall_ms * 1000);
+            now = now_ns();
+            next_stall = now + (long long)opts.stall_every_ms * 1000000LL;
+        }
+        if (next_report && now >= next_report) {
+            print_stats(stderr);
+            next_report = now + (long long)opts.report_ms * 1000000LL;
+        }
+        if ((opts.duration_s &&
+             now - start >= (long long)opts.duration_s * 1000000000LL) ||
+            (opts.expect && stats.records >= opts.expect)) {
+            break;
+        }
+    }
+
+    for (i = 0; i < COLLECT_MAX_CONNS; i++) {
+        if (conns[i]) {
+            conn_close(&conns[i], epfd);
+        }
+    }
+    close(epfd);
+    close(lfd);
+    close(ufd);
+    print_stats(stdout);
+    return stats.malformed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
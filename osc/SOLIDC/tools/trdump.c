@@ -0,0 +1,190 @@
+#include "binlog.h"
+#include "numfmt.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Converts a BINARY_FORMATTER log back to the TEXT_FORMATTER layout:
+ * "Transaction %u: User %s sent %.2f\n", and aggregate records to
+ * "Aggregate: User %s count %u sum %.2f window_ms %u\n".
+ *
+ * The input is mapped read-only and decoded in one pass; lines are
+ * assembled with numfmt into a large output buffer that is written out
+ * in big chunks, so the tool is bound by memory and pipe bandwidth rather
+ * than per-record stdio calls.
+ */
+
+#define DUMP_OUT_BUFFER (4 * 1024 * 1024)
+/* "%.2f" of -DBL_MAX is 313 bytes. */
+#define DUMP_AMOUNT_MAX 320
+/* Longest line apart from the user bytes. */
+#define DUMP_LINE_SLACK (64 + DUMP_AMOUNT_MAX)
+
+#define TEXT_PREFIX "Transaction "
+#define TEXT_USER ": User "
+#define TEXT_SENT " sent "
+#define TEXT_AGG_PREFIX "Aggregate: User "
+#define TEXT_AGG_COUNT " count "
+#define TEXT_AGG_SUM " sum "
+#define TEXT_AGG_WINDOW " window_ms "
+
+typedef struct DumpStats {
+    unsigned long long records;
+    unsigned long long skipped;   /* unknown version */
+    unsigned long long malformed; /* framing errors; decoding stops */
+} DumpStats;
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static char *put(char *p, const char *s, size_t n) {
+    memcpy(p, s, n);
+    return p + n;
+}
+
+/* As format_line, for a BINLOG_AGGREGATE_VERSION record. */
+static char *format_aggregate_line(char *p, const BinlogRecord *r) {
+    int n;
+
+    p = put(p, TEXT_AGG_PREFIX, sizeof(TEXT_AGG_PREFIX) - 1);
+    p = put(p, r->user, r->user_len);
+    p = put(p, TEXT_AGG_COUNT, sizeof(TEXT_AGG_COUNT) - 1);
+    p += numfmt_u32(p, r->count);
+    p = put(p, TEXT_AGG_SUM, sizeof(TEXT_AGG_SUM) - 1);
+    n = numfmt_fixed2(p, DUMP_AMOUNT_MAX, r->amount);
+    if (n > 0) {
+        p += n;
+    }
+    p = put(p, TEXT_AGG_WINDOW, sizeof(TEXT_AGG_WINDOW) - 1);
+    p += numfmt_u32(p, r->window_ms);
+    *p++ = '\n';
+    return p;
+}
+
+/* Caller guarantees r->user_len + DUMP_LINE_SLACK bytes at p. */
+static char *format_line(char *p, const BinlogRecord *r) {
+    int n;
+
+    if (r->version == BINLOG_AGGREGATE_VERSION) {
+        return format_aggregate_line(p, r);
+    }
+    p = put(p, TEXT_PREFIX, sizeof(TEXT_PREFIX) - 1);
+    p += numfmt_u32(p, r->tid);
+    p = put(p, TEXT_USER, sizeof(TEXT_USER) - 1);
+    p = put(p, r->user, r->user_len);
+    p = put(p, TEXT_SENT, sizeof(TEXT_SENT) - 1);
+    n = numfmt_fixed2(p, DUMP_AMOUNT_MAX, r->amount);
+    if (n > 0) {
+        p += n;
+    }
+    *p++ = '\n';
+    return p;
+}
+
+static int dump(const unsigned char *in, size_t len, int out_fd,
+                DumpStats *stats) {
+    char *out = malloc(DUMP_OUT_BUFFER);
+    size_t used = 0;
+    size_t off = 0;
+
+    if (!out) {
+        return -1;
+    }
+
+    while (off < len) {
+        BinlogRecord r;
+        size_t consumed;
+        BinlogStatus st = binlog_decode(in + off, len - off, &r, &consumed);
+
+        if (st == BINLOG_UNKNOWN_VERSION) {
+            stats->skipped++;
+            off += consumed;
+            continue;
+        }
+        if (st != BINLOG_OK) {
+            stats->malformed++; /* also covers a truncated tail */
+            break;
+        }
+        off += consumed;
+
+        if (DUMP_OUT_BUFFER - used < r.user_len + DUMP_LINE_SLACK) {
+            if (write_all(out_fd, out, used) < 0) {
+                free(out);
+                return -1;
+            }
+            used = 0;
+            if (DUMP_OUT_BUFFER < r.user_len + DUMP_LINE_SLACK) {
+                stats->malformed++;
+                continue;
+            }
+        }
+        used = (size_t)(format_line(out + used, &r) - out);
+        stats->records++;
+    }
+
+    if (write_all(out_fd, out, used) < 0) {
+        free(out);
+        return -1;
+    }
+    free(out);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    DumpStats stats = {0};
+    struct stat st;
+    void *map = NULL;
+    int fd;
+    int rc = 0;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s BINARY_LOG > text.log\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        fprintf(stderr, "%s: cannot open regular file %s\n", argv[0],
+                argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    if (st.st_size > 0) {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            perror("mmap");
+            close(fd);
+            return EXIT_FAILURE;
+        }
+        madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+        rc = dump(map, (size_t)st.st_size, STDOUT_FILENO, &stats);
+        munmap(map, (size_t)st.st_size);
+    }
+    close(fd);
+
+    if (rc < 0) {
+        perror("write");
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "%llu records, %llu skipped, %llu malformed\n",
+            stats.records, stats.skipped, stats.malformed);
+    return stats.malformed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,165 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Open-loop load generator for `trlog --replay -`:
+ *
+ *   trload --rate 50000 --duration-s 10 | bin/trlog --replay - ...
+ *
+ * Record i is scheduled at start + i / rate, whatever happened to the
+ * records before it. Its user is "t<ns>", the scheduled time on
+ * CLOCK_MONOTONIC, so trcollect can measure latency from when the record
+ * should have been sent. When trlog (or the pipe) cannot keep up, the
+ * generator falls behind and writes the overdue records in one go; their
+ * latency still counts from their scheduled time, so a stall is charged
+ * to every record it delayed rather than hidden (no coordinated omission).
+ */
+
+#define LOAD_BUFFER (256 * 1024)
+#define LOAD_LINE_MAX 96
+/* Keeps "%.2f" of the amount to 19 bytes, so a line fits LOAD_LINE_MAX. */
+#define LOAD_AMOUNT_MAX 1e15
+#define LOAD_LATE_NS 1000000LL /* a record written >1 ms late counts late */
+
+typedef struct LoadOptions {
+    double rate;
+    unsigned long long count;
+    double duration_s;
+    double amount;
+} LoadOptions;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_until(long long ns) {
+    struct timespec ts;
+
+    ts.tv_sec = (time_t)(ns / 1000000000LL);
+    ts.tv_nsec = (long)(ns % 1000000000LL);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+           EINTR) {
+    }
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s --rate N (--count N | --duration-s S) [--amount X]\n"
+            "  writes replay lines \"i t<scheduled ns> amount\" to stdout at "
+            "a fixed rate; |X| < %g\n",
+            prog, LOAD_AMOUNT_MAX);
+}
+
+static int parse_args(int argc, char **argv, LoadOptions *o) {
+    int i;
+
+    for (i = 1; i + 1 < argc; i += 2) {
+        const char *a = argv[i];
+        const char *v = argv[i + 1];
+
+        if (strcmp(a, "--rate") == 0) {
+            o->rate = strtod(v, NULL);
+        } else if (strcmp(a, "--count") == 0) {
+            o->count = strtoull(v, NULL, 10);
+        } else if (strcmp(a, "--duration-s") == 0) {
+            o->duration_s = strtod(v, NULL);
+        } else if (strcmp(a, "--amount") == 0) {
+            o->amount = strtod(v, NULL);
+        } else {
+            return -1;
+        }
+    }
+    if (i != argc || o->rate <= 0 ||
+        !(o->amount > -LOAD_AMOUNT_MAX && o->amount < LOAD_AMOUNT_MAX)) {
+        return -1;
+    }
+    if (o->count == 0) {
+        o->count = (unsigned long long)(o->duration_s * o->rate);
+    }
+    return o->count > 0 ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+    LoadOptions opts = {.amount = 1.0};
+    static char buf[LOAD_BUFFER];
+    unsigned long long late = 0;
+    unsigned long long i = 0;
+    long long max_lag = 0;
+    double interval_ns;
+    long long start;
+    long long end;
+
+    if (parse_args(argc, argv, &opts) < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    interval_ns = 1e9 / opts.rate;
+
+    start = now_ns();
+    while (i < opts.count) {
+        long long now = now_ns();
+        size_t used = 0;
+
+        /* Everything scheduled up to now, as one write. */
+        while (i < opts.count && used + LOAD_LINE_MAX <= sizeof(buf)) {
+            long long due = start + (long long)((double)i * interval_ns);
+            long long lag = now - due;
+            int n;
+
+            if (due > now) {
+                break;
+            }
+            if (lag > max_lag) {
+                max_lag = lag;
+            }
+            late += lag > LOAD_LATE_NS;
+            n = snprintf(buf + used, LOAD_LINE_MAX, "%llu t%lld %.2f\n", i,
+                         due, opts.amount);
+            if (n < 0 || n >= LOAD_LINE_MAX) {
+                fprintf(stderr, "trload: line %llu does not fit\n", i);
+                return EXIT_FAILURE;
+            }
+            used += (size_t)n;
+            i++;
+        }
+        if (used > 0 && write_all(STDOUT_FILENO, buf, used) < 0) {
+            perror("trload: write");
+            break;
+        }
+        if (used == 0) {
+            sleep_until(start + (long long)((double)i * interval_ns));
+        }
+    }
+    end = now_ns();
+
+    fprintf(stderr,
+            "trload: %llu records in %.3f s (%.0f/s, target %.0f/s), "
+            "%llu written >1 ms late, max lag %.3f ms\n",
+            i, (double)(end - start) / 1e9,
+            (double)i * 1e9 / (double)(end - start), opts.rate, late,
+            (double)max_lag / 1e6);
+    return i == opts.count ? EXIT_SUCCESS : EXIT_FAILURE;
+}